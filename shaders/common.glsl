@@ -6,6 +6,7 @@ struct Camera {
     mat4 view;
     mat4 proj;
     vec3 position;
+    vec4 frustumPlanes[6];
 };
 
 layout(std430, buffer_reference, buffer_reference_align = 8) buffer CameraBuffer {
@@ -59,9 +60,13 @@ struct AABB {
 struct DrawData {
     uint modelMatrixIndex;
     uint materialIndex;
+    uint meshIndex;
+    uint meshletIndex; // NO_MESHLET when the draw covers the whole mesh
     AABB aabb;
 };
 
+const uint NO_MESHLET = 0xFFFFFFFFu;
+
 layout(std430, buffer_reference, buffer_reference_align = 8) buffer DrawDataBuffer {
     DrawData drawData[];
 };
@@ -70,4 +75,128 @@ layout(std430, buffer_reference, buffer_reference_align = 8) buffer ModelMatrice
     mat4 matrices[];
 };
 
+// Model matrix of every instance, a draw's instances start at its firstInstance
+layout(std430, buffer_reference, buffer_reference_align = 4) readonly buffer InstancesBuffer {
+    uint modelMatrixIndices[];
+};
+
+struct Mesh {
+    uint firstIndex;
+    uint indexCount;
+    int materialIndex;
+    uint firstMeshlet;
+    uint meshletCount;
+    uint firstLod;
+    uint lodCount;
+    uint vertexOffset;
+    uint vertexCount;
+    AABB aabb;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 8) buffer MeshesBuffer {
+    Mesh meshes[];
+};
+
+// See Scene::Meshlet
+struct Meshlet {
+    vec4 boundingSphere; // xyz center, w radius, in mesh space
+    vec4 cone; // xyz axis, w cutoff
+    uint firstIndex;
+    uint indexCount;
+};
+
+layout(std430, buffer_reference, buffer_reference_align = 8) readonly buffer MeshletsBuffer {
+    Meshlet meshlets[];
+};
+
+// See Scene::MeshLod
+struct MeshLod {
+    uint firstIndex;
+    uint indexCount;
+    float error; // mesh space
+};
+
+layout(scalar, buffer_reference, buffer_reference_align = 4) readonly buffer MeshLodsBuffer {
+    MeshLod lods[];
+};
+
+// Farthest depth of every texel's footprint, level 0 is the depth buffer and every level halves the previous one,
+// rounding up. The levels are stored one after another. See depthPyramid.comp
+// NOTE: Coherent, the group that reduces the last levels reads what the other groups wrote
+layout(std430, buffer_reference, buffer_reference_align = 4) coherent buffer DepthPyramidBuffer {
+    uint width;
+    uint height;
+    uint levelCount;
+    uint finishedGroups; // Reset to 0 before every build
+    float depths[];
+};
+
+uvec2 GetDepthPyramidLevelSize(uvec2 size, uint level) {
+    return (size + (1u << level) - 1u) >> level;
+}
+
+uint GetDepthPyramidLevelOffset(uvec2 size, uint level) {
+    uint offset = 0;
+    for (uint i = 0; i < level; i++) {
+        uvec2 levelSize = GetDepthPyramidLevelSize(size, i);
+        offset += levelSize.x * levelSize.y;
+    }
+    return offset;
+}
+
+// Texels outside the level read as 0, which never raises a maximum
+float LoadPyramidDepth(DepthPyramidBuffer pyramid, uvec2 size, uint level, uvec2 texel) {
+    uvec2 levelSize = GetDepthPyramidLevelSize(size, level);
+    if (any(greaterThanEqual(texel, levelSize))) {
+        return 0.0f;
+    }
+    return pyramid.depths[GetDepthPyramidLevelOffset(size, level) + texel.y * levelSize.x + texel.x];
+}
+
+// Vertex streams, see Scene::VertexPosition and Scene::Vertex. Vertices are pulled with gl_VertexIndex
+layout(scalar, buffer_reference, buffer_reference_align = 8) readonly buffer VertexPositionsBuffer {
+    uvec2 positions[]; // unorm16 xyz inside the bounding box of the mesh, w is unused
+};
+
+layout(scalar, buffer_reference, buffer_reference_align = 4) readonly buffer VerticesBuffer {
+    uvec3 vertices[]; // snorm16 octahedral normal, half float UV0, half float UV1
+};
+
+layout(scalar, buffer_reference, buffer_reference_align = 4) readonly buffer VertexColorsBuffer {
+    uint colors[]; // unorm8 RGBA
+};
+
+struct Vertex {
+    vec3 position;
+    vec3 normal;
+    vec2 uv0;
+    vec2 uv1;
+};
+
+vec3 LoadPosition(VertexPositionsBuffer positionsBuffer, uint index, AABB aabb) {
+    uvec2 packedPosition = positionsBuffer.positions[index];
+    vec3 position = vec3(unpackUnorm2x16(packedPosition.x), unpackUnorm2x16(packedPosition.y).x);
+    return aabb.min + position * (aabb.max - aabb.min);
+}
+
+// Inverse of EncodeOctahedral in Scene.cpp
+vec3 DecodeOctahedral(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -t : t;
+    normal.y += normal.y >= 0.0 ? -t : t;
+    return normalize(normal);
+}
+
+Vertex LoadVertex(VertexPositionsBuffer positionsBuffer, VerticesBuffer verticesBuffer, uint index, AABB aabb) {
+    uvec3 packedVertex = verticesBuffer.vertices[index];
+
+    Vertex vertex;
+    vertex.position = LoadPosition(positionsBuffer, index, aabb);
+    vertex.normal = DecodeOctahedral(unpackSnorm2x16(packedVertex.x));
+    vertex.uv0 = unpackHalf2x16(packedVertex.y);
+    vertex.uv1 = unpackHalf2x16(packedVertex.z);
+    return vertex;
+}
+
 
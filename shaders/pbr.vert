@@ -8,18 +8,19 @@ layout (push_constant, scalar) uniform PushConsts {
     CameraBuffer cameraBufferAddress;
     DrawDataBuffer drawDataBufferAddress;
     ModelMatricesBuffer modelMatricesBufferAddress;
+    InstancesBuffer instancesBufferAddress;
+    MeshesBuffer meshesBufferAddress;
+    VertexPositionsBuffer positionsBufferAddress;
+    VerticesBuffer verticesBufferAddress;
+    VertexColorsBuffer colorsBufferAddress;
     int directionLightIndex;
     int lightCount;
     int shadowMapTextureIndex;
     int cameraIndex;
+    int hasVertexColors;
+    int padding;
 } pc;
 
-layout (location = 0) in vec3 i_Position;
-layout (location = 1) in vec3 i_Normal;
-layout (location = 2) in vec3 i_Color;
-layout (location = 3) in vec2 i_UV0;
-layout (location = 4) in vec2 i_UV1;
-
 layout (location = 0) out vec3 o_Color;
 layout (location = 1) out vec3 o_Normal;
 layout (location = 2) out vec2 o_UV0;
@@ -35,19 +36,26 @@ void main() {
     Camera camera = pc.cameraBufferAddress.cameras[pc.cameraIndex];
 
     DrawData drawData = pc.drawDataBufferAddress.drawData[gl_DrawID];
-    mat4 modelMatrix = pc.modelMatricesBufferAddress.matrices[drawData.modelMatrixIndex];
+    uint modelMatrixIndex = pc.instancesBufferAddress.modelMatrixIndices[gl_InstanceIndex];
+    mat4 modelMatrix = pc.modelMatricesBufferAddress.matrices[modelMatrixIndex];
+    AABB meshAABB = pc.meshesBufferAddress.meshes[drawData.meshIndex].aabb;
+
+    // NOTE: gl_VertexIndex is the value read from the bound index buffer
+    Vertex vertex = LoadVertex(pc.positionsBufferAddress, pc.verticesBufferAddress, uint(gl_VertexIndex), meshAABB);
+    vec3 position = vertex.position;
+    uint colorIndex = pc.hasVertexColors != 0 ? uint(gl_VertexIndex) : 0u;
 
-    gl_Position = camera.proj * camera.view * modelMatrix * vec4(i_Position, 1.0);
-    o_Color = i_Color;
-    o_UV0 = i_UV0;
-    o_UV1 = i_UV1;
+    gl_Position = camera.proj * camera.view * modelMatrix * vec4(position, 1.0);
+    o_Color = unpackUnorm4x8(pc.colorsBufferAddress.colors[colorIndex]).rgb;
+    o_UV0 = vertex.uv0;
+    o_UV1 = vertex.uv1;
 
-    o_Normal = normalize(transpose(inverse(mat3(modelMatrix))) * i_Normal);
+    o_Normal = normalize(transpose(inverse(mat3(modelMatrix))) * vertex.normal);
     //    o_Normal = mat3(transpose(inverse(primitive.model))) * i_Normal;
     //    o_Normal = mat3(primitive.model) * i_Normal;
 
-    o_FragPos = vec3(modelMatrix * vec4(i_Position, 1.0));
+    o_FragPos = vec3(modelMatrix * vec4(position, 1.0));
     o_ViewVec = camera.position.xyz - o_FragPos;
-    o_FragPosLightSpace = direcitonalLight.proj * direcitonalLight.view * modelMatrix * vec4(i_Position, 1.0);
+    o_FragPosLightSpace = direcitonalLight.proj * direcitonalLight.view * modelMatrix * vec4(position, 1.0);
     o_DrawID = gl_DrawID;
 }
@@ -10,10 +10,17 @@ layout (push_constant, scalar) uniform PushConsts {
     CameraBuffer cameraBufferAddress;
     DrawDataBuffer drawDataBufferAddress;
     ModelMatricesBuffer modelMatricesBufferAddress;
+    InstancesBuffer instancesBufferAddress;
+    MeshesBuffer meshesBufferAddress;
+    VertexPositionsBuffer positionsBufferAddress;
+    VerticesBuffer verticesBufferAddress;
+    VertexColorsBuffer colorsBufferAddress;
     int directionLightIndex;
     int lightCount;
     int shadowMapTextureIndex;
     int cameraIndex;
+    int hasVertexColors;
+    int padding;
 } pc;
 
 layout (location = 0) in vec3 i_FragColor;
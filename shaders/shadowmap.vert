@@ -6,21 +6,22 @@ layout (scalar, push_constant) uniform PushConsts {
     LightsBuffer lightBufferAddress;
     DrawDataBuffer drawDataBufferAddress;
     ModelMatricesBuffer modelMatricesBufferAddress;
+    InstancesBuffer instancesBufferAddress;
+    MeshesBuffer meshesBufferAddress;
+    VertexPositionsBuffer positionsBufferAddress;
     int directionLightIndex;
     int padding;
 } pc;
 
-layout (location = 0) in vec3 i_Position;
-layout (location = 1) in vec3 i_Normal;
-layout (location = 2) in vec3 i_Color;
-layout (location = 3) in vec2 i_UV0;
-layout (location = 4) in vec2 i_UV1;
-
 void main() {
     Light directionallight = pc.lightBufferAddress.lights[pc.directionLightIndex];
 
     DrawData drawData = pc.drawDataBufferAddress.drawData[gl_DrawID];
-    mat4 modelMatrix = pc.modelMatricesBufferAddress.matrices[drawData.modelMatrixIndex];
+    uint modelMatrixIndex = pc.instancesBufferAddress.modelMatrixIndices[gl_InstanceIndex];
+    mat4 modelMatrix = pc.modelMatricesBufferAddress.matrices[modelMatrixIndex];
+    AABB meshAABB = pc.meshesBufferAddress.meshes[drawData.meshIndex].aabb;
+    // NOTE: Only the position stream is read, so the shadow pass fetches 8 bytes per vertex
+    vec3 position = LoadPosition(pc.positionsBufferAddress, uint(gl_VertexIndex), meshAABB);
 
-    gl_Position = directionallight.proj * directionallight.view * modelMatrix * vec4(i_Position, 1.0);
+    gl_Position = directionallight.proj * directionallight.view * modelMatrix * vec4(position, 1.0);
 }
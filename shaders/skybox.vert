@@ -3,10 +3,6 @@
 #include "common.glsl"
 
 layout (location = 0) in vec3 i_Position;
-layout (location = 1) in vec3 i_Normal;
-layout (location = 2) in vec3 i_Color;
-layout (location = 3) in vec2 i_UV0;
-layout (location = 4) in vec2 i_UV1;
 
 layout (location = 0) out vec3 o_TexCoords;
 
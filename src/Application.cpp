@@ -1,17 +1,38 @@
 #include "pch.h"
 
+#include <algorithm>
+#include <numeric>
+
 #include "Application.h"
+#include "imgui.h"
+#include "Vulkan/DebugMarkers.h"
 #include "Vulkan/Utils.h"
 #include "Vulkan/VulkanPipeline.h"
 
 void Application::Run() {
-    InitWindow();
+    if (!specification.headless) {
+        InitWindow();
+    }
     InitVulkan();
-    MainLoop();
+    if (specification.benchmark) {
+        RunBenchmark();
+    } else {
+        MainLoop();
+    }
     Cleanup();
 }
 
 void Application::InitVulkan() {
+    using Clock = std::chrono::high_resolution_clock;
+    const auto startupStart = Clock::now();
+    auto stageStart = startupStart;
+    std::vector<std::pair<std::string, double>> startupStages; // ms
+    const auto endStage = [&](std::string name) {
+        const auto now = Clock::now();
+        startupStages.emplace_back(std::move(name),
+                                   std::chrono::duration<double, std::milli>(now - stageStart).count());
+        stageStart = now;
+    };
 
     VK_CHECK(volkInitialize(), "Failed to initialize Volk");
 
@@ -19,47 +40,77 @@ void Application::InitVulkan() {
 
     FindScenePaths("models");
 
-    VkSurfaceKHR surface = CreateSurface();
-    device = std::make_shared<VulkanDevice>(instance, surface);
-    swapchain = std::make_shared<VulkanSwapchain>(device, window);
+    if (specification.headless) {
+        device = std::make_shared<VulkanDevice>(instance, VK_NULL_HANDLE);
+        swapchain = std::make_shared<VulkanSwapchain>(device, VkExtent2D{WIDTH, HEIGHT});
+    } else {
+        VkSurfaceKHR surface = CreateSurface();
+        device = std::make_shared<VulkanDevice>(instance, surface);
+        swapchain = std::make_shared<VulkanSwapchain>(device, window);
+    }
+    endStage("Instance, device and swapchain");
 
     debugDraw = std::make_unique<DebugDraw>(device);
 
-    VulkanPipeline::PipelineSpecification graphicsSpec{
-            .vertShaderPath = "shaders/pbr.vert.spv",
-            .fragShaderPath = "shaders/pbr_bindless.frag.spv",
-    };
-    graphicsPipeline = std::make_shared<VulkanPipeline>(device, graphicsSpec);
-
-    VulkanPipeline::PipelineSpecification skyboxSpec{
-            .vertShaderPath = "shaders/skybox.vert.spv",
-            .fragShaderPath = "shaders/skybox.frag.spv",
-            .cullingMode = VulkanPipeline::CullingMode::FRONT,
-            .blendEnable = false,
-            .enableDepthTesting = false,
-    };
-    skyboxPipeline = std::make_shared<VulkanPipeline>(device, skyboxSpec);
-
-    VulkanPipeline::PipelineSpecification shadowMapSpec{
-            .vertShaderPath = "shaders/shadowmap.vert.spv",
-            .fragShaderPath = "shaders/shadowmap.frag.spv",
-            .cullingMode = VulkanPipeline::CullingMode::NONE,
-            .depthBiasEnable = true,
+    // NOTE: Pipeline creation only touches the device and the internally synchronized pipeline cache, so it runs on
+    // the job system while the cubemap and the scene, which use the command pool and graphics queue, load here
+    struct PipelineBuild {
+        std::string name;
+        std::shared_ptr<VulkanPipeline> *pipeline;
+        std::future<std::pair<std::shared_ptr<VulkanPipeline>, double>> future;
     };
-    shadowMapPipeline = std::make_shared<VulkanPipeline>(device, shadowMapSpec);
-
-    VulkanPipeline::PipelineSpecification debugDrawSpec{
-            .vertShaderPath = "shaders/DebugDraw.vert.spv",
-            .fragShaderPath = "shaders/DebugDraw.frag.spv",
-            .cullingMode = VulkanPipeline::CullingMode::NONE,
-            .wireframe = true,
+    std::vector<PipelineBuild> pipelineBuilds;
+    const auto buildPipeline = [&](std::string name, std::shared_ptr<VulkanPipeline> &pipeline,
+                                   VulkanPipeline::PipelineSpecification pipelineSpec) {
+        auto future = jobSystem.Submit([device = device, pipelineSpec]() mutable {
+            const auto buildStart = Clock::now();
+            auto builtPipeline = std::make_shared<VulkanPipeline>(device, pipelineSpec);
+            return std::pair{std::move(builtPipeline),
+                             std::chrono::duration<double, std::milli>(Clock::now() - buildStart).count()};
+        });
+        pipelineBuilds.push_back({.name = std::move(name), .pipeline = &pipeline, .future = std::move(future)});
     };
-    debugDrawPipeline = std::make_shared<VulkanPipeline>(device, debugDrawSpec);
 
-    VulkanPipeline::PipelineSpecification frustumCullingSpec{
-            .compShaderPath = "shaders/frustumCulling.comp.spv",
-    };
-    frustumCullingPipeline = std::make_shared<VulkanPipeline>(device, frustumCullingSpec);
+    buildPipeline("PBR pipeline", graphicsPipeline,
+                  {
+                          .vertShaderPath = "pbr.vert.spv",
+                          .fragShaderPath = "pbr_bindless.frag.spv",
+                  });
+
+    buildPipeline("Skybox pipeline", skyboxPipeline,
+                  {
+                          .vertShaderPath = "skybox.vert.spv",
+                          .fragShaderPath = "skybox.frag.spv",
+                          .cullingMode = VulkanPipeline::CullingMode::FRONT,
+                          .blendEnable = false,
+                          .enableDepthTesting = false,
+                  });
+
+    buildPipeline("Shadow map pipeline", shadowMapPipeline,
+                  {
+                          .vertShaderPath = "shadowmap.vert.spv",
+                          .fragShaderPath = "shadowmap.frag.spv",
+                          .cullingMode = VulkanPipeline::CullingMode::NONE,
+                          .depthBiasEnable = true,
+                  });
+
+    buildPipeline("Debug draw pipeline", debugDrawPipeline,
+                  {
+                          .vertShaderPath = "DebugDraw.vert.spv",
+                          .fragShaderPath = "DebugDraw.frag.spv",
+                          .cullingMode = VulkanPipeline::CullingMode::NONE,
+                          .wireframe = true,
+                  });
+
+    buildPipeline("Frustum culling pipeline", frustumCullingPipeline,
+                  {
+                          .compShaderPath = "frustumCulling.comp.spv",
+                  });
+
+    buildPipeline("Depth pyramid pipeline", depthPyramidPipeline,
+                  {
+                          .compShaderPath = "depthPyramid.comp.spv",
+                  });
 
     // https://registry.khronos.org/vulkan/specs/1.3-extensions/html/chap16.html#_cube_map_face_selection_and_transformations
     std::vector<std::filesystem::path> cubemapPaths = {
@@ -70,9 +121,24 @@ void Application::InitVulkan() {
 
     TextureSpecification cubemapTextureSpec{.name = "Skybox cubemap texture"};
     cubemapTexture = std::make_shared<TextureCube>(device, cubemapTextureSpec, cubemapPaths);
+    endStage("Cubemap");
 
-    userInterface = UI(device, instance, window, this);
-    scene = std::make_unique<Scene>(device, scenePaths[26], cubemapTexture, *debugDraw);
+    if (!specification.headless) {
+        userInterface = UI(device, instance, window, this);
+        endStage("UI");
+    }
+    std::filesystem::path initialScenePath = specification.scenePath;
+    if (initialScenePath.empty()) {
+        if (scenePaths.empty()) {
+            throw std::runtime_error("No scenes found!");
+        }
+        initialScenePath = specification.benchmark ? scenePaths.front() : scenePaths[26];
+    }
+
+    const auto sceneLoadStart = Clock::now();
+    scene = std::make_unique<Scene>(device, initialScenePath, cubemapTexture, *debugDraw, jobSystem);
+    lastSceneLoadTime = std::chrono::duration<double, std::milli>(Clock::now() - sceneLoadStart).count();
+    endStage("Scene");
 
     TextureSpecification shadowmapTextureSpec{
             .name = "Shadow Depth Texture",
@@ -88,24 +154,180 @@ void Application::InitVulkan() {
 
     GPUDataUploader.InitializeStagingBuffers(device);
     scene->UploadToGPU(GPUDataUploader);
+
+    gpuProfiler.Initialize(device, swapchain->numFramesInFlight);
+    endStage("Render resources");
+
+    // Every pipeline has to exist before the first frame is recorded
+    std::vector<std::pair<std::string, double>> pipelineTimes;
+    for (auto &build: pipelineBuilds) {
+        auto [pipeline, buildTime] = build.future.get();
+        *build.pipeline = std::move(pipeline);
+        pipelineTimes.emplace_back(std::move(build.name), buildTime);
+    }
+    endStage("Waiting for pipelines");
+
+    const double startupTime = std::chrono::duration<double, std::milli>(Clock::now() - startupStart).count();
+    std::cout << std::format("Startup took {:.2f} ms", startupTime) << std::endl;
+    for (const auto &[name, time]: startupStages) {
+        std::cout << std::format("  {}: {:.2f} ms", name, time) << std::endl;
+    }
+    std::cout << std::format("  Pipelines, built on {} worker threads:", jobSystem.GetThreadCount()) << std::endl;
+    for (const auto &[name, time]: pipelineTimes) {
+        std::cout << std::format("    {}: {:.2f} ms", name, time) << std::endl;
+    }
 }
 
 void Application::MainLoop() {
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
-        HandleKeys();
-        DrawFrame();
+    if (specification.headless) {
+        while (frameCount < specification.headlessFrameCount) {
+            TimedDrawFrame();
+        }
+    } else {
+        while (!glfwWindowShouldClose(window)) {
+            glfwPollEvents();
+            HandleKeys();
+            TimedDrawFrame();
+
+            if (recordingCameraPath) {
+                const auto &camera = scene->cameras[scene->cameraIndexControlling];
+                recordedCameraPath.keyframes.push_back(
+                        {.position = camera.GetPosition(), .focusPoint = camera.focusPoint});
+            }
+        }
     }
 
-    vkDeviceWaitIdle(device->GetDevice());
+    device->WaitIdle();
+
+    ReportFrameTimes();
+}
+
+void Application::RunBenchmark() {
+    const CameraPath cameraPath =
+            specification.cameraPathFile.empty()
+                    ? CameraPath::Orbit(glm::vec3(0.0f), 4.0f, 2.0f, specification.benchmarkFrameCount)
+                    : CameraPath::Load(specification.cameraPathFile);
+
+    const std::vector<std::filesystem::path> benchmarkScenes =
+            specification.scenePath.empty() ? scenePaths : std::vector{specification.scenePath};
+
+    Benchmark benchmark;
+    std::optional<uint64_t> lastGPUFrameNumber;
+    for (size_t sceneIndex = 0; sceneIndex < benchmarkScenes.size(); ++sceneIndex) {
+        auto &result = benchmark.BeginScene(benchmarkScenes[sceneIndex]);
+
+        // The first scene is loaded by InitVulkan, the others load while the previous one keeps rendering and are
+        // swapped in at the end of a frame. The hitch is the worst frame until the swap
+        if (sceneIndex > 0) {
+            SetScene(benchmarkScenes[sceneIndex]);
+            double switchHitch = 0.0;
+            while (IsSceneLoading()) {
+                if (!specification.headless) {
+                    glfwPollEvents();
+                }
+                switchHitch = std::max(switchHitch, TimedDrawFrame());
+            }
+            result.switchHitch = switchHitch;
+        }
+        result.loadTime = lastSceneLoadTime;
+
+        // GPU results are read back a few frames late, so skip those that still belong to the previous scene
+        const uint64_t sceneFirstFrame = frameCount;
+        for (uint32_t frame = 0; frame < specification.benchmarkFrameCount; ++frame) {
+            if (!specification.headless) {
+                glfwPollEvents();
+                if (glfwWindowShouldClose(window)) {
+                    break;
+                }
+            }
+
+            benchmarkFrameIndex = frame;
+            const auto &keyframe = cameraPath.Sample(frame);
+            scene->cameras[scene->cameraIndexControlling].SetView(keyframe.position, keyframe.focusPoint);
+
+            result.cpuFrameTimes.push_back(TimedDrawFrame());
+
+            const auto gpuResult = gpuProfiler.GetLatestResult();
+            if (gpuResult && gpuResult->frameNumber >= sceneFirstFrame &&
+                gpuResult->frameNumber != lastGPUFrameNumber) {
+                result.gpuFrameTimes.push_back(gpuResult->frameTime);
+                result.vertexInvocations.push_back(static_cast<double>(gpuResult->vertexInvocations));
+                lastGPUFrameNumber = gpuResult->frameNumber;
+            }
+        }
+
+        std::cout << std::format("Benchmarked {} ({} frames)", benchmarkScenes[sceneIndex].string(),
+                                 result.cpuFrameTimes.size())
+                  << std::endl;
+
+        if (!specification.headless && glfwWindowShouldClose(window)) {
+            break;
+        }
+    }
+
+    device->WaitIdle();
+
+    ReportFrameTimes();
+    benchmark.WriteResults(specification.benchmarkOutputPath);
+}
+
+double Application::TimedDrawFrame() {
+    const auto frameStart = std::chrono::high_resolution_clock::now();
+    DrawFrame();
+    const auto frameEnd = std::chrono::high_resolution_clock::now();
+
+    const double frameTime = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+    frameTimes.push_back(frameTime);
+    return frameTime;
+}
+
+void Application::ToggleCameraPathRecording() {
+    constexpr auto cameraPathFile = "camera_path.txt";
+
+    recordingCameraPath = !recordingCameraPath;
+    if (recordingCameraPath) {
+        recordedCameraPath.keyframes.clear();
+        std::cout << "Recording camera path..." << std::endl;
+    } else if (!recordedCameraPath.keyframes.empty()) {
+        recordedCameraPath.Save(cameraPathFile);
+        std::cout << std::format("Saved {} camera keyframes to {}", recordedCameraPath.keyframes.size(),
+                                 cameraPathFile)
+                  << std::endl;
+    }
+}
+
+void Application::PickMesh(double cursorX, double cursorY) {
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    // NOTE: The projection flips y, so window and NDC y both point down
+    const glm::vec2 ndc(2.0 * cursorX / width - 1.0, 2.0 * cursorY / height - 1.0);
+    const Camera &camera = scene->cameras[scene->cameraIndexDrawing];
+    // Outlined in yellow by RecordCommandBuffer and described in the UI
+    pickedMesh = scene->RayCast(camera.GetPosition(), camera.GetRayDirection(ndc));
 }
 
 void Application::Cleanup() {
-    userInterface.Destroy();
+    if (pendingScene.valid()) {
+        try {
+            pendingScene.get().scene->Destroy();
+        } catch (const std::exception &e) {
+            std::cerr << std::format("Failed to load scene: {}", e.what()) << std::endl;
+        }
+    }
+    DestroyRetiredScenes(true);
+
+    if (!specification.headless) {
+        userInterface.Destroy();
+    }
     swapchain->Destroy();
 
     colorImage->Destroy();
     depthImage->Destroy();
+    depthPyramidBuffer->Destroy();
 
     cubemapTexture->Destroy();
     shadowDepthTexture->Destroy();
@@ -113,18 +335,27 @@ void Application::Cleanup() {
     graphicsPipeline->Destroy();
     skyboxPipeline->Destroy();
     shadowMapPipeline->Destroy();
+    frustumCullingPipeline->Destroy();
+    depthPyramidPipeline->Destroy();
     scene->Destroy();
+    vkDestroyDescriptorPool(device->GetDevice(), bindlessDescriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device->GetDevice(), bindlessTexturesSetLayout, nullptr);
     skybox->Destroy();
 
     GPUDataUploader.Destroy();
+    gpuProfiler.Destroy();
 
-    vkDestroySurfaceKHR(instance, device->GetSurface(), nullptr);
+    if (!device->IsHeadless()) {
+        vkDestroySurfaceKHR(instance, device->GetSurface(), nullptr);
+    }
     device->Destroy();
 
     vkb::destroy_instance(instance);
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!specification.headless) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 }
 
 void Application::InitWindow() {
@@ -142,6 +373,11 @@ void Application::InitWindow() {
     glfwSetMouseButtonCallback(window, [](GLFWwindow *w, const int button, const int action, int mods) {
         auto *app = static_cast<Application *>(glfwGetWindowUserPointer(w));
 
+        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse) {
+            double x, y;
+            glfwGetCursorPos(w, &x, &y);
+            app->PickMesh(x, y);
+        }
         if (button == GLFW_MOUSE_BUTTON_RIGHT) {
             if (action == GLFW_PRESS) {
                 app->scene->cameras[app->scene->cameraIndexControlling].SetMove(true);
@@ -168,6 +404,12 @@ void Application::InitWindow() {
         if (key == GLFW_KEY_TAB && action == GLFW_RELEASE) {
             app->scene->cameraIndexControlling = (app->scene->cameraIndexControlling + 1) % app->scene->cameras.size();
         }
+        if (key == GLFW_KEY_F5 && action == GLFW_RELEASE) {
+            app->ToggleCameraPathRecording();
+        }
+        if (key == GLFW_KEY_F6 && action == GLFW_RELEASE) {
+            app->gpuProfiler.BeginCapture(traceFrameCount, "trace.json");
+        }
     });
 }
 
@@ -208,15 +450,20 @@ void Application::CreateInstance() {
                 .use_default_debug_messenger();
     }
 
-    uint32_t glfwExtensionCount = 0;
-    const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-    std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
-    for (uint32_t i = 0; i < glfwExtensionCount; i++) {
-        if (systemInfo.is_extension_available(extensions[i])) {
-            instanceBuilder.enable_extension(extensions[i]);
-        } else {
-            throw std::runtime_error("Instance extension required by GLFW not available {}!");
+    if (specification.headless) {
+        // No surface extensions, so the instance can be created without a display (e.g. lavapipe on a render node)
+        instanceBuilder.set_headless();
+    } else {
+        uint32_t glfwExtensionCount = 0;
+        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+        std::vector<const char *> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        for (uint32_t i = 0; i < glfwExtensionCount; i++) {
+            if (systemInfo.is_extension_available(extensions[i])) {
+                instanceBuilder.enable_extension(extensions[i]);
+            } else {
+                throw std::runtime_error("Instance extension required by GLFW not available {}!");
+            }
         }
     }
 
@@ -250,8 +497,7 @@ void Application::CreateBindlessTexturesArray() {
             .pPoolSizes = poolSizes.data(),
     };
 
-    VkDescriptorPool pool;
-    VK_CHECK(vkCreateDescriptorPool(device->GetDevice(), &poolInfo, nullptr, &pool),
+    VK_CHECK(vkCreateDescriptorPool(device->GetDevice(), &poolInfo, nullptr, &bindlessDescriptorPool),
              "Failed to create descriptor pool!");
 
     VkDescriptorSetLayoutBinding bindingLayoutInfo{};
@@ -276,15 +522,14 @@ void Application::CreateBindlessTexturesArray() {
     setLayoutInfo.pBindings = &bindingLayoutInfo;
     setLayoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
 
-    VkDescriptorSetLayout layout;
-    VK_CHECK(vkCreateDescriptorSetLayout(device->GetDevice(), &setLayoutInfo, nullptr, &layout),
+    VK_CHECK(vkCreateDescriptorSetLayout(device->GetDevice(), &setLayoutInfo, nullptr, &bindlessTexturesSetLayout),
              "Failed to allocate bindless textures array set layout");
 
     VkDescriptorSetAllocateInfo allocationInfo{};
     allocationInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocationInfo.descriptorPool = pool;
+    allocationInfo.descriptorPool = bindlessDescriptorPool;
     allocationInfo.descriptorSetCount = 1;
-    allocationInfo.pSetLayouts = &layout;
+    allocationInfo.pSetLayouts = &bindlessTexturesSetLayout;
 
     VkDescriptorSetVariableDescriptorCountAllocateInfo countInfo{};
     countInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
@@ -335,6 +580,7 @@ void Application::CreateBindlessTexturesArray() {
 }
 
 void Application::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    DebugMarkers::ScopedMarker marker("Application::RecordCommandBuffer");
     VkCommandBufferBeginInfo beginInfo{
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
     };
@@ -342,7 +588,140 @@ void Application::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t im
         throw std::runtime_error("Failed to begin recording command buffer!");
     }
 
+    gpuProfiler.BeginFrame(commandBuffer, currentFrame, frameCount);
+
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Uploader Flush");
     GPUDataUploader.Flush(commandBuffer);
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
+
+    // Mirrors the flags in frustumCulling.comp
+    enum CullingFlags : uint32_t {
+        CullOcclusion = 1,
+        CullEarly = 2,
+        CullLate = 4,
+        CullMeshletCones = 8,
+    };
+
+    struct FrustumCullingPushConstants {
+        VkDeviceAddress cameraAddress;
+        VkDeviceAddress commandBufferAddress;
+        VkDeviceAddress drawDataAddress;
+        VkDeviceAddress culledCommandBufferAddress;
+        VkDeviceAddress culledDrawDataAddress;
+        VkDeviceAddress drawCountsAddress;
+        VkDeviceAddress drawVisibilityAddress;
+        VkDeviceAddress depthPyramidAddress;
+        VkDeviceAddress modelMatricesAddress;
+        VkDeviceAddress instancesAddress;
+        VkDeviceAddress meshletsAddress;
+        VkDeviceAddress meshesAddress;
+        VkDeviceAddress meshLodsAddress;
+        uint32_t drawCount;
+        uint32_t shortDrawCount;
+        uint32_t flags;
+        float lodErrorThreshold;
+        float minScreenRadius;
+        float viewportHeight;
+    } cameraCullingPushConstants = {
+            // The draws are culled for the first camera
+            .cameraAddress = scene->camerasBuffer->GetAddress(),
+            .drawVisibilityAddress = scene->drawVisibilityBuffer->GetAddress(),
+            .depthPyramidAddress = depthPyramidBuffer->GetAddress(),
+            .modelMatricesAddress = scene->modelMatricesBuffer->GetAddress(),
+            .instancesAddress = scene->instancesBuffer->GetAddress(),
+            .meshletsAddress = scene->meshletsBuffer->GetAddress(),
+            .meshesAddress = scene->meshesBuffer->GetAddress(),
+            .meshLodsAddress = scene->meshLodsBuffer->GetAddress(),
+            .flags = CullMeshletCones,
+            .lodErrorThreshold = lodErrorThreshold,
+            .minScreenRadius = minScreenRadius,
+            .viewportHeight = static_cast<float>(swapchain->GetHeight())};
+    static_assert(sizeof(FrustumCullingPushConstants) <= 128);
+
+    // NOTE: The shadow map is drawn at full detail and without size culling, which both assume a perspective camera.
+    //       Meshlets facing away from the light still cast shadows, the shadow pass draws both sides
+    FrustumCullingPushConstants shadowCullingPushConstants = cameraCullingPushConstants;
+    shadowCullingPushConstants.cameraAddress = scene->shadowViewsBuffer->GetAddress();
+    shadowCullingPushConstants.flags = 0;
+    shadowCullingPushConstants.lodErrorThreshold = 0.0f;
+    shadowCullingPushConstants.minScreenRadius = 0.0f;
+    shadowCullingPushConstants.viewportHeight = static_cast<float>(shadowSize);
+
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Shadow Culling");
+    // The visible draws are counted from 0 every frame
+    vkCmdFillBuffer(commandBuffer, scene->drawCountsBuffer->GetBuffer(), 0, VK_WHOLE_SIZE, 0);
+    // Without a valid history every opaque draw is culled and drawn by the late pass
+    if (scene->drawVisibilityInvalid) {
+        vkCmdFillBuffer(commandBuffer, scene->drawVisibilityBuffer->GetBuffer(), 0, VK_WHOLE_SIZE, 0);
+        scene->drawVisibilityInvalid = false;
+    }
+    VkMemoryBarrier2 drawCountsClearBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                                            .srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                                            .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                            .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                            .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT |
+                                                             VK_ACCESS_2_SHADER_WRITE_BIT};
+    VkDependencyInfo drawCountsClearDependencyInfo{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &drawCountsClearBarrier,
+    };
+    vkCmdPipelineBarrier2(commandBuffer, &drawCountsClearDependencyInfo);
+
+    // The flags are added to the ones of the view
+    const auto cullDraws = [&](FrustumCullingPushConstants pushConstants, const Buffer &commands,
+                               const Buffer &drawData, const Buffer &culledCommands, const Buffer &culledDrawData,
+                               VkDeviceSize drawCountsOffset, size_t drawCount, size_t shortDrawCount, uint32_t flags) {
+        if (drawCount == 0) {
+            return;
+        }
+        pushConstants.flags |= flags;
+        pushConstants.commandBufferAddress = commands.GetAddress();
+        pushConstants.drawDataAddress = drawData.GetAddress();
+        pushConstants.culledCommandBufferAddress = culledCommands.GetAddress();
+        pushConstants.culledDrawDataAddress = culledDrawData.GetAddress();
+        pushConstants.drawCountsAddress = scene->drawCountsBuffer->GetAddress() + drawCountsOffset;
+        pushConstants.drawCount = static_cast<uint32_t>(drawCount);
+        pushConstants.shortDrawCount = static_cast<uint32_t>(shortDrawCount);
+        vkCmdPushConstants(commandBuffer, frustumCullingPipeline->GetLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(FrustumCullingPushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, static_cast<uint32_t>((drawCount + 255) / 256), 1, 1);
+    };
+    const auto cullOpaqueDraws = [&](VkDeviceSize drawCountsOffset, uint32_t flags) {
+        cullDraws(cameraCullingPushConstants, *scene->opaqueDrawIndirectCommandsBuffer, *scene->opaqueDrawDataBuffer,
+                  *scene->culledOpaqueDrawIndirectCommandsBuffer, *scene->culledOpaqueDrawDataBuffer, drawCountsOffset,
+                  scene->opaqueDrawIndirectCommands.size(), scene->opaqueShortDrawCount, flags);
+    };
+
+    // NOTE: This barrier is needed so that drawing only starts after the culling is performed. Besides the commands
+    //       and counts the draw data read by the shaders was written as well
+    // https://github.com/KhronosGroup/Vulkan-Docs/wiki/Synchronization-Examples#upload-data-from-the-cpu-to-a-vertex-buffer
+    VkMemoryBarrier2 cullingMemoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                                          .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                          .srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT,
+                                          .dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                                                          VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                                                          VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                                          .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT};
+
+    VkDependencyInfo cullingDependencyInfo{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &cullingMemoryBarrier,
+    };
+
+    // Casters outside the light's frustum are compacted away before the shadow pass
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, frustumCullingPipeline->GetPipeline());
+    cullDraws(shadowCullingPushConstants, *scene->opaqueDrawIndirectCommandsBuffer, *scene->opaqueDrawDataBuffer,
+              *scene->culledShadowOpaqueDrawIndirectCommandsBuffer, *scene->culledShadowOpaqueDrawDataBuffer,
+              Scene::shadowOpaqueDrawCountsOffset, scene->opaqueDrawIndirectCommands.size(),
+              scene->opaqueShortDrawCount, 0);
+    cullDraws(shadowCullingPushConstants, *scene->transparentDrawIndirectCommandsBuffer,
+              *scene->transparentDrawDataBuffer, *scene->culledShadowTransparentDrawIndirectCommandsBuffer,
+              *scene->culledShadowTransparentDrawDataBuffer, Scene::shadowTransparentDrawCountsOffset,
+              scene->transparentDrawIndirectCommands.size(), scene->transparentShortDrawCount, 0);
+    vkCmdPipelineBarrier2(commandBuffer, &cullingDependencyInfo);
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
 
     // Shadow rendering
     VkRenderingAttachmentInfo shadowDepthAttachment{
@@ -362,6 +741,7 @@ void Application::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t im
             .pDepthAttachment = &shadowDepthAttachment,
     };
 
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Shadow Pass");
     shadowDepthTexture->GetImage()->TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_UNDEFINED,
                                                      VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 
@@ -391,6 +771,7 @@ void Application::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t im
 
     shadowDepthTexture->GetImage()->TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
                                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
 
     // TODO: is this needed?
     // // Add barrier to prevent writing to commandbuffer until shadow map is done
@@ -408,36 +789,15 @@ void Application::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t im
     // };
     // vkCmdPipelineBarrier2(commandBuffer, &shadowDependencyInfo);
 
-    struct FrustumCullingPushConstants {
-        Frustum frustum;
-        VkDeviceAddress commandBufferAddress;
-        VkDeviceAddress drawDataAddress;
-        VkDeviceAddress modelMatricesAddress;
-    } frustumCullingPushConstants = {.frustum = scene->cameras[0].GetFrustum(),
-                                     .commandBufferAddress = scene->opaqueDrawIndirectCommandsBuffer->GetAddress(),
-                                     .drawDataAddress = scene->opaqueDrawDataBuffer->GetAddress(),
-                                     .modelMatricesAddress = scene->modelMatricesBuffer->GetAddress()};
-
+    // NOTE: With occlusion culling the opaque draws visible last frame are culled and drawn first. Their depth is
+    //       reduced to the depth pyramid, the late culling pass tests everything else against it and the newly
+    //       visible opaque draws are drawn with the transparent ones
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Early Culling");
+    // Without occlusion culling every visible opaque draw is drawn in the early phase
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, frustumCullingPipeline->GetPipeline());
-    vkCmdPushConstants(commandBuffer, frustumCullingPipeline->GetLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0,
-                       sizeof(FrustumCullingPushConstants), &frustumCullingPushConstants);
-    vkCmdDispatch(commandBuffer, (scene->opaqueDrawIndirectCommands.size() + 255) / 256, 1, 1);
-
-    // NOTE: This barrier is needed so that drawing only starts after the culling is performed
-    // https://github.com/KhronosGroup/Vulkan-Docs/wiki/Synchronization-Examples#upload-data-from-the-cpu-to-a-vertex-buffer
-    VkMemoryBarrier2 cullingMemoryBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
-                                          .srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
-                                          .srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT,
-                                          .dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT,
-                                          .dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT};
-
-    VkDependencyInfo cullingDependencyInfo{
-            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
-            .memoryBarrierCount = 1,
-            .pMemoryBarriers = &cullingMemoryBarrier,
-    };
-
+    cullOpaqueDraws(Scene::earlyOpaqueDrawCountsOffset, occlusionCulling ? CullEarly : 0);
     vkCmdPipelineBarrier2(commandBuffer, &cullingDependencyInfo);
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
 
     VkDescriptorImageInfo imageInfo{
             .sampler = shadowDepthTexture->GetSampler(),
@@ -510,18 +870,21 @@ void Application::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t im
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
     // Skybox
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Skybox");
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipeline->GetPipeline());
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skyboxPipeline->GetLayout(), 0, 1,
                             &bindlessTexturesSet, 0, nullptr);
 
     scene->DrawSkybox(commandBuffer, skyboxPipeline->GetLayout());
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
 
     // Scene Rendering
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Opaque (Early)");
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline->GetPipeline());
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline->GetLayout(), 0, 1,
                             &bindlessTexturesSet, 0, nullptr);
-    scene->Draw(commandBuffer, graphicsPipeline->GetLayout());
-    userInterface.Draw(commandBuffer);
+    scene->Draw(commandBuffer, graphicsPipeline->GetLayout(), Scene::DrawPhase::Early);
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
 
     vkCmdEndRendering(commandBuffer);
 
@@ -595,23 +958,92 @@ void Application::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t im
             //            .pStencilAttachment = &depthAttachment,
     };
 
+    if (occlusionCulling) {
+        gpuProfiler.BeginPass(commandBuffer, currentFrame, "Depth Pyramid");
+        BuildDepthPyramid(commandBuffer);
+        gpuProfiler.EndPass(commandBuffer, currentFrame);
+    }
+
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Late Culling");
+    // NOTE: The late pass overwrites the culled opaque draws the early draws read and reads the depth pyramid
+    VkMemoryBarrier2 lateCullingBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                                        .srcStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                                                        VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                                                        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                                                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                        .srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT,
+                                        .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                        .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT};
+    VkDependencyInfo lateCullingDependencyInfo{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &lateCullingBarrier,
+    };
+    vkCmdPipelineBarrier2(commandBuffer, &lateCullingDependencyInfo);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, frustumCullingPipeline->GetPipeline());
+    if (occlusionCulling) {
+        cullOpaqueDraws(Scene::lateOpaqueDrawCountsOffset, CullOcclusion | CullLate);
+    }
+    cullDraws(cameraCullingPushConstants, *scene->transparentDrawIndirectCommandsBuffer,
+              *scene->transparentDrawDataBuffer, *scene->culledTransparentDrawIndirectCommandsBuffer,
+              *scene->culledTransparentDrawDataBuffer, Scene::transparentDrawCountsOffset,
+              scene->transparentDrawIndirectCommands.size(), scene->transparentShortDrawCount,
+              occlusionCulling ? CullOcclusion : 0);
+    vkCmdPipelineBarrier2(commandBuffer, &cullingDependencyInfo);
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
+
+    vkCmdBeginRendering(commandBuffer, &renderInfo2);
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Opaque (Late)/Transparent");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline->GetPipeline());
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline->GetLayout(), 0, 1,
+                            &bindlessTexturesSet, 0, nullptr);
+    scene->Draw(commandBuffer, graphicsPipeline->GetLayout(), Scene::DrawPhase::Late);
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
+
+    if (!specification.headless) {
+        gpuProfiler.BeginPass(commandBuffer, currentFrame, "UI");
+        userInterface.Draw(commandBuffer);
+        gpuProfiler.EndPass(commandBuffer, currentFrame);
+    }
+
+    vkCmdEndRendering(commandBuffer);
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+
     debugDraw->DrawAxis({0.0, 0.0, 0.0}, 1.0);
+    if (pickedMesh) {
+        debugDraw->DrawAABB(pickedMesh->bounds, {1.0, 1.0, 0.0});
+    }
     // debugDraw->DrawFrustum(m_Scene.cameras[0].GetViewMatrix(), m_Scene.cameras[0].GetProjectionMatrix(),
     //                        {0.0, 0.0, 1.0});
+    gpuProfiler.BeginPass(commandBuffer, currentFrame, "Debug Draw");
     debugDraw->Draw(commandBuffer, GPUDataUploader, *debugDrawPipeline, *scene, renderInfo2);
+    gpuProfiler.EndPass(commandBuffer, currentFrame);
 
+    // NOTE: Offscreen images are left ready to be read back since there is nothing to present them to
     swapchain->GetImage(imageIndex)
             ->TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                               VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+                               swapchain->IsHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                       : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    gpuProfiler.EndFrame(commandBuffer, currentFrame);
 
     VK_CHECK(vkEndCommandBuffer(commandBuffer), "Failed to record command buffer!");
 }
 
 void Application::DrawFrame() {
+    DebugMarkers::ScopedMarker marker("Application::DrawFrame");
 
-    vkWaitForFences(device->GetDevice(), 1, &swapchain->GetWaitFences()[currentFrame], VK_TRUE, UINT64_MAX);
+    {
+        DebugMarkers::ScopedMarker waitMarker("Wait For Frame Fence");
+        vkWaitForFences(device->GetDevice(), 1, &swapchain->GetWaitFences()[currentFrame], VK_TRUE, UINT64_MAX);
+    }
     vkResetFences(device->GetDevice(), 1, &swapchain->GetWaitFences()[currentFrame]);
 
+    // The previous submission of this frame has completed, so its timestamps can be read without stalling
+    gpuProfiler.CollectResults(currentFrame);
+    DestroyRetiredScenes();
+
     const uint32_t imageIndex = swapchain->AcquireNextImage(currentFrame);
     // Recreate swapchain
     if (imageIndex == std::numeric_limits<uint32_t>::max()) {
@@ -620,13 +1052,15 @@ void Application::DrawFrame() {
         colorImage->Destroy();
         CreateColorResources();
         depthImage->Destroy();
+        depthPyramidBuffer->Destroy();
         CreateDepthResources();
         return;
     }
 
     UpdateUniformBuffer(currentFrame);
 
-    scene->GenerateDrawCommands(*debugDraw, frustumCulling);
+    scene->UpdateTransforms(jobSystem, specification.validateTransforms);
+    scene->GenerateDrawCommands(*debugDraw, frustumCulling, meshletCulling);
     scene->UploadToGPU(GPUDataUploader);
 
     vkResetCommandBuffer(swapchain->GetCommandBuffers()[currentFrame], 0);
@@ -638,18 +1072,31 @@ void Application::DrawFrame() {
 
     VkSemaphore waitSemaphores[] = {swapchain->GetImageAvailableSemaphores()[currentFrame]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &swapchain->GetCommandBuffers()[currentFrame];
 
     VkSemaphore signalSemaphores[] = {swapchain->GetRenderFinishedSemaphores()[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
 
-    VK_CHECK(vkQueueSubmit(device->GetGraphicsQueue(), 1, &submitInfo, swapchain->GetWaitFences()[currentFrame]),
-             "Failed to submit draw command buffer!");
+    // Offscreen images are never acquired or presented, so the only synchronization is the frame fence
+    if (!swapchain->IsHeadless()) {
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+    }
+
+    {
+        const auto queueLock = device->LockQueues();
+        VK_CHECK(vkQueueSubmit(device->GetGraphicsQueue(), 1, &submitInfo, swapchain->GetWaitFences()[currentFrame]),
+                 "Failed to submit draw command buffer!");
+    }
+
+    if (std::ranges::contains(specification.dumpFrames, frameCount)) {
+        vkWaitForFences(device->GetDevice(), 1, &swapchain->GetWaitFences()[currentFrame], VK_TRUE, UINT64_MAX);
+        DumpFrame(imageIndex, specification.dumpDirectory / std::format("frame_{:05}.ppm", frameCount));
+    }
+    frameCount++;
 
     bool resourceNeedResizing = swapchain->Present(imageIndex, currentFrame);
     if (resourceNeedResizing) {
@@ -658,6 +1105,7 @@ void Application::DrawFrame() {
         colorImage->Destroy();
         CreateColorResources();
         depthImage->Destroy();
+        depthPyramidBuffer->Destroy();
         CreateDepthResources();
     }
     currentFrame = (currentFrame + 1) % swapchain->numFramesInFlight;
@@ -665,15 +1113,70 @@ void Application::DrawFrame() {
     GPUDataUploader.NextFrame();
     debugDraw->EndFrame();
 
-    if (shouldChangeScene)
-        ChangeScene();
+    SwapLoadedScene();
+}
+
+void Application::DumpFrame(uint32_t imageIndex, const std::filesystem::path &path) const {
+    if (!swapchain->IsHeadless()) {
+        throw std::runtime_error("Frame dumping is only supported when running headless!");
+    }
+
+    const uint32_t width = swapchain->GetWidth();
+    const uint32_t height = swapchain->GetHeight();
+
+    auto readbackBuffer = std::make_unique<Buffer>(device, BufferSpecification{.name = "Frame Readback Buffer",
+                                                                               .size = width * height * 4,
+                                                                               .type = BufferType::READBACK});
+    swapchain->GetImage(imageIndex)->CopyToBuffer(*readbackBuffer);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Failed to open file - {}!", path.string()));
+    }
+    file << "P6\n" << width << " " << height << "\n255\n";
+
+    // Offscreen images are BGRA, PPM expects RGB
+    const auto *pixels = static_cast<const uint8_t *>(readbackBuffer->GetMappedData());
+    std::vector<uint8_t> row(width * 3);
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            const uint8_t *pixel = pixels + (y * width + x) * 4;
+            row[x * 3 + 0] = pixel[2];
+            row[x * 3 + 1] = pixel[1];
+            row[x * 3 + 2] = pixel[0];
+        }
+        file.write(reinterpret_cast<const char *>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+
+    readbackBuffer->Destroy();
+    std::cout << "Dumped frame to " << path.string() << std::endl;
+}
+
+void Application::ReportFrameTimes() const {
+    if (frameTimes.empty()) {
+        return;
+    }
+
+    const double total = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0);
+    const double average = total / static_cast<double>(frameTimes.size());
+    const auto [min, max] = std::ranges::minmax_element(frameTimes);
+
+    std::cout << std::format("Rendered {} frames in {:.3f} ms - avg {:.3f} ms | min {:.3f} ms | max {:.3f} ms | "
+                             "{:.1f} FPS",
+                             frameTimes.size(), total, average, *min, *max, 1000.0 / average)
+              << std::endl;
 }
 
 void Application::UpdateUniformBuffer(uint32_t currentImage) {
     static auto startTime = std::chrono::high_resolution_clock::now();
 
-    const auto currentTime = std::chrono::high_resolution_clock::now();
-    const double time = std::chrono::duration<double>(currentTime - startTime).count();
+    double time;
+    if (specification.benchmark) {
+        time = benchmarkFrameIndex * Benchmark::fixedTimestep;
+    } else {
+        const auto currentTime = std::chrono::high_resolution_clock::now();
+        time = std::chrono::duration<double>(currentTime - startTime).count();
+    }
 
     // NOTE(RF): Directional light moving test
     scene->lights.at(0).direction.x = std::lerp(-0.8, 0.8, std::fmod(0.05 * time, 1.0));
@@ -694,6 +1197,62 @@ void Application::CreateDepthResources() {
             .layers = 1,
     };
     depthImage = std::make_shared<VulkanImage>(device, imageSpecification);
+
+    // Every level halves the previous one, rounding up, until a single texel is left
+    uint32_t levelWidth = swapchain->GetWidth();
+    uint32_t levelHeight = swapchain->GetHeight();
+    VkDeviceSize depthPyramidTexelCount = static_cast<VkDeviceSize>(levelWidth) * levelHeight;
+    depthPyramidLevelCount = 1;
+    while (levelWidth > 1 || levelHeight > 1) {
+        levelWidth = (levelWidth + 1) / 2;
+        levelHeight = (levelHeight + 1) / 2;
+        depthPyramidTexelCount += static_cast<VkDeviceSize>(levelWidth) * levelHeight;
+        depthPyramidLevelCount++;
+    }
+    depthPyramidBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Depth Pyramid Buffer",
+                                        .size = sizeof(DepthPyramidHeader) + depthPyramidTexelCount * sizeof(float),
+                                        .type = BufferType::GPU});
+}
+
+void Application::BuildDepthPyramid(VkCommandBuffer commandBuffer) {
+    const uint32_t width = depthImage->GetWidth();
+    const uint32_t height = depthImage->GetHeight();
+
+    // NOTE: Written for every build, the shader counts the finished groups from 0
+    const DepthPyramidHeader header{.width = width, .height = height, .levelCount = depthPyramidLevelCount};
+    vkCmdUpdateBuffer(commandBuffer, depthPyramidBuffer->GetBuffer(), 0, sizeof(header), &header);
+
+    depthImage->TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    const VkBufferImageCopy levelZeroCopy{
+            .bufferOffset = sizeof(DepthPyramidHeader),
+            .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT, .layerCount = 1},
+            .imageExtent = {width, height, 1},
+    };
+    vkCmdCopyImageToBuffer(commandBuffer, depthImage->GetImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           depthPyramidBuffer->GetBuffer(), 1, &levelZeroCopy);
+    depthImage->TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                 VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+
+    VkMemoryBarrier2 copyBarrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+                                 .srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                                 .srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                                 .dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                                 .dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT};
+    VkDependencyInfo copyDependencyInfo{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .memoryBarrierCount = 1,
+            .pMemoryBarriers = &copyBarrier,
+    };
+    vkCmdPipelineBarrier2(commandBuffer, &copyDependencyInfo);
+
+    // One group per 64x64 tile of level 0, see depthPyramid.comp
+    const VkDeviceAddress depthPyramidAddress = depthPyramidBuffer->GetAddress();
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipeline->GetPipeline());
+    vkCmdPushConstants(commandBuffer, depthPyramidPipeline->GetLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(depthPyramidAddress), &depthPyramidAddress);
+    vkCmdDispatch(commandBuffer, (width + 63) / 64, (height + 63) / 64, 1);
 }
 
 void Application::CreateColorResources() {
@@ -710,20 +1269,85 @@ void Application::CreateColorResources() {
 }
 
 void Application::SetScene(const std::filesystem::path &scenePath) {
-    shouldChangeScene = true;
     nextScenePath = scenePath;
+    if (!pendingScene.valid()) {
+        StartSceneLoad();
+    }
 }
 
-void Application::ChangeScene() {
-    shouldChangeScene = false;
-    vkDeviceWaitIdle(device->GetDevice());
-    scene->Destroy();
-    scene = std::make_unique<Scene>(device, nextScenePath, cubemapTexture, *debugDraw);
+void Application::StartSceneLoad() {
+    const std::filesystem::path scenePath = *nextScenePath;
+    nextScenePath.reset();
+
+    // NOTE: Not on the job system, the scene decodes its images there and waits for them
+    pendingScene = std::async(std::launch::async, [this, scenePath] {
+        const auto sceneLoadStart = std::chrono::high_resolution_clock::now();
+        // NOTE: Every load runs on a new thread, so the command pool it uploaded with is released when it's done
+        std::unique_ptr<Scene> loadedScene;
+        try {
+            loadedScene = std::make_unique<Scene>(device, scenePath, cubemapTexture, *debugDraw, jobSystem);
+        } catch (...) {
+            device->ReleaseThreadCommandPool();
+            throw;
+        }
+        device->ReleaseThreadCommandPool();
+        return LoadedScene{.scene = std::move(loadedScene),
+                           .loadTime = std::chrono::duration<double, std::milli>(
+                                               std::chrono::high_resolution_clock::now() - sceneLoadStart)
+                                               .count()};
+    });
+}
+
+void Application::SwapLoadedScene() {
+    if (!pendingScene.valid() || pendingScene.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
 
+    // The scene finished uploading on the loading thread, so it can be drawn right away
+    LoadedScene loadedScene;
+    try {
+        loadedScene = pendingScene.get();
+    } catch (const std::exception &e) {
+        // A scene that fails to load leaves the current one on screen
+        std::cerr << std::format("Failed to load scene: {}", e.what()) << std::endl;
+        if (nextScenePath) {
+            StartSceneLoad();
+        }
+        return;
+    }
+    if (nextScenePath) {
+        // Another scene was picked in the meantime. This one was never drawn, so nothing on the GPU uses it
+        loadedScene.scene->Destroy();
+        StartSceneLoad();
+        return;
+    }
+
+    retiredScenes.push_back({.scene = std::move(scene),
+                             .bindlessDescriptorPool = bindlessDescriptorPool,
+                             .bindlessTexturesSetLayout = bindlessTexturesSetLayout,
+                             .lastFrame = frameCount - 1});
+    scene = std::move(loadedScene.scene);
+    lastSceneLoadTime = loadedScene.loadTime;
+    pickedMesh.reset();
+
+    // NOTE: A new set instead of rewriting the old one, which the frames in flight are still reading
     textureDescriptors.clear();
     CreateBindlessTexturesArray();
+}
 
-    scene->UploadToGPU(GPUDataUploader);
+void Application::DestroyRetiredScenes(bool all) {
+    for (auto it = retiredScenes.begin(); it != retiredScenes.end();) {
+        // Called after waiting for the current frame's fence, which completes frame frameCount - numFramesInFlight
+        if (!all && frameCount < it->lastFrame + swapchain->numFramesInFlight) {
+            ++it;
+            continue;
+        }
+
+        it->scene->Destroy();
+        vkDestroyDescriptorPool(device->GetDevice(), it->bindlessDescriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(device->GetDevice(), it->bindlessTexturesSetLayout, nullptr);
+        it = retiredScenes.erase(it);
+    }
 }
 
 void Application::FindScenePaths(const std::filesystem::path &basePath) {
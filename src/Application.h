@@ -1,6 +1,9 @@
 #pragma once
 
+#include "Benchmark.h"
 #include "GPUDataUploader.h"
+#include "GPUProfiler.h"
+#include "JobSystem.h"
 #include "Scene.h"
 #include "UI/UI.h"
 #include "Vulkan/VulkanDevice.h"
@@ -11,24 +14,54 @@
 
 #include <VkBootstrap.h>
 
+#include <future>
+
 #include "DebugDraw.h"
 
 class UI;
 
+struct ApplicationSpecification {
+    // Renders into an offscreen image ring instead of a window swapchain
+    bool headless{false};
+    uint32_t headlessFrameCount{1000};
+    // Headless frames that get written to dumpDirectory as PPM images
+    std::vector<uint32_t> dumpFrames;
+    std::filesystem::path dumpDirectory{"."};
+    // Scene to load on startup, empty uses the default scene
+    std::filesystem::path scenePath;
+
+    // Replays a camera path over every scene (or only scenePath when set) and writes frame time percentiles
+    bool benchmark{false};
+    uint32_t benchmarkFrameCount{600};
+    std::filesystem::path benchmarkOutputPath{"benchmark.json"};
+    // Empty uses an orbit around the origin
+    std::filesystem::path cameraPathFile;
+
+    // Compares the parallel transform update with the serial one every frame and logs when they differ
+    bool validateTransforms{false};
+};
+
 class Application {
 public:
     Application() = default;
+    explicit Application(ApplicationSpecification specification) : specification(std::move(specification)) {}
 
     void Run();
 
     void InitWindow();
     void InitVulkan();
     void MainLoop();
+    void RunBenchmark();
     void Cleanup();
 
     void FindScenePaths(const std::filesystem::path &basePath);
+    // Loads the scene in the background, the current one keeps rendering until it is swapped in
     void SetScene(const std::filesystem::path &scenePath);
-    void ChangeScene();
+    [[nodiscard]] bool IsSceneLoading() const { return pendingScene.valid(); }
+    void StartSceneLoad();
+    void SwapLoadedScene();
+    // Destroys the scenes no frame in flight uses anymore, or all of them
+    void DestroyRetiredScenes(bool all = false);
 
     [[nodiscard]] std::vector<std::filesystem::path> GetScenePaths() const { return scenePaths; };
 
@@ -42,35 +75,89 @@ public:
 
     void CreateBindlessTexturesArray();
     void CreateDepthResources();
+    // Copies the depth drawn so far into level 0 of depthPyramidBuffer and reduces it to the other levels
+    void BuildDepthPyramid(VkCommandBuffer commandBuffer);
     void CreateColorResources();
 
     void HandleKeys();
 
+    double TimedDrawFrame();
+    void DumpFrame(uint32_t imageIndex, const std::filesystem::path &path) const;
+    void ReportFrameTimes() const;
+
+    void ToggleCameraPathRecording();
+    // Casts a ray through the cursor position, in window coordinates, and highlights the closest mesh it hits
+    void PickMesh(double cursorX, double cursorY);
+
+    ApplicationSpecification specification;
+
     std::shared_ptr<VulkanDevice> device;
     vkb::Instance instance;
 
     std::shared_ptr<VulkanImage> depthImage;
+    // Start of depthPyramidBuffer, mirrors DepthPyramidBuffer in common.glsl. The levels follow it
+    struct DepthPyramidHeader {
+        uint32_t width{0};
+        uint32_t height{0};
+        uint32_t levelCount{0};
+        uint32_t finishedGroups{0};
+    };
+    // Farthest depth of the early opaque draws, the late culling pass tests the other draws against it
+    std::unique_ptr<Buffer> depthPyramidBuffer;
+    uint32_t depthPyramidLevelCount{0};
     std::shared_ptr<VulkanImage> colorImage;
 
     std::shared_ptr<VulkanSwapchain> swapchain;
     std::shared_ptr<VulkanPipeline> graphicsPipeline;
     std::shared_ptr<VulkanPipeline> skyboxPipeline;
 
+    VkDescriptorPool bindlessDescriptorPool{VK_NULL_HANDLE};
+    VkDescriptorSetLayout bindlessTexturesSetLayout{VK_NULL_HANDLE};
     VkDescriptorSet bindlessTexturesSet;
     std::vector<VkDescriptorImageInfo> textureDescriptors;
 
     uint32_t currentFrame = 0;
 
     std::vector<std::filesystem::path> scenePaths;
-    std::filesystem::path nextScenePath;
-    bool shouldChangeScene = false;
     std::unique_ptr<Scene> scene;
+
+    struct LoadedScene {
+        std::unique_ptr<Scene> scene;
+        double loadTime{0.0}; // ms
+    };
+    // Built on its own thread and swapped in at the end of the frame it completed in
+    std::future<LoadedScene> pendingScene;
+    // Requested while another scene was still loading
+    std::optional<std::filesystem::path> nextScenePath;
+
+    // The frames in flight may still read a swapped out scene and its bindless textures set
+    struct RetiredScene {
+        std::unique_ptr<Scene> scene;
+        VkDescriptorPool bindlessDescriptorPool{VK_NULL_HANDLE};
+        VkDescriptorSetLayout bindlessTexturesSetLayout{VK_NULL_HANDLE};
+        uint32_t lastFrame{0}; // frameCount of the last frame that used it
+    };
+    std::vector<RetiredScene> retiredScenes;
     std::unique_ptr<Scene> skybox;
     UI userInterface;
 
     std::shared_ptr<TextureCube> cubemapTexture;
 
-    GLFWwindow *window;
+    GLFWwindow *window{nullptr};
+
+    uint32_t frameCount{0};
+    std::vector<double> frameTimes; // ms
+    double lastSceneLoadTime{0.0}; // ms
+
+    std::optional<Scene::RayHit> pickedMesh;
+
+    JobSystem jobSystem;
+    GPUProfiler gpuProfiler;
+    static constexpr uint32_t traceFrameCount{120};
+
+    uint32_t benchmarkFrameIndex{0};
+    bool recordingCameraPath{false};
+    CameraPath recordedCameraPath;
 
     const uint32_t WIDTH = 1280;
     const uint32_t HEIGHT = 800;
@@ -82,12 +169,21 @@ public:
     constexpr static float shadowDepthSlope{1.0f};
 
     static constexpr bool frustumCulling{false};
+    // Draws the opaque draws visible last frame first and culls the others against their depth
+    bool occlusionCulling{true};
+    // Draws opaque meshes per meshlet so the culling pass can reject single meshlets
+    bool meshletCulling{true};
+    // Largest on screen error of a level of detail in pixels, 0 always draws the full meshes
+    float lodErrorThreshold{1.0f};
+    // Draws with smaller bounds on screen are culled, in pixels
+    static constexpr float minScreenRadius{0.5f};
 
     std::shared_ptr<Texture2D> shadowDepthTexture;
     std::shared_ptr<VulkanPipeline> shadowMapPipeline;
 
     std::shared_ptr<VulkanPipeline> debugDrawPipeline;
     std::shared_ptr<VulkanPipeline> frustumCullingPipeline;
+    std::shared_ptr<VulkanPipeline> depthPyramidPipeline;
 
     GPUDataUploader GPUDataUploader;
     std::unique_ptr<DebugDraw> debugDraw;
@@ -0,0 +1,325 @@
+#include "pch.h"
+
+#include "BVH.h"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+namespace {
+    glm::vec3 GetCenter(const AABBArrays &bounds, uint32_t box) {
+        return {bounds.centerX[box], bounds.centerY[box], bounds.centerZ[box]};
+    }
+
+    glm::vec3 GetExtent(const AABBArrays &bounds, uint32_t box) {
+        return {bounds.extentX[box], bounds.extentY[box], bounds.extentZ[box]};
+    }
+
+    // Half the surface area, the factor cancels out in the cost comparisons
+    float GetHalfArea(const glm::vec3 &min, const glm::vec3 &max) {
+        const glm::vec3 size = max - min;
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+
+    // Clears the bits of the planes the box is fully inside of, returns whether it is fully outside any of them.
+    // Same test as Camera::IsAABBFullyOutsideFrustum
+    bool IsOutsideFrustum(const Frustum &frustum, const glm::vec3 &center, const glm::vec3 &extent,
+                          uint32_t &planeMask) {
+        for (uint32_t p = 0; p < frustum.planes.size(); p++) {
+            if ((planeMask & (1u << p)) == 0) {
+                continue;
+            }
+            const glm::vec4 &plane = frustum.planes[p];
+            const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            const float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+            if (distance < -radius) {
+                return true;
+            }
+            if (distance >= radius) {
+                planeMask &= ~(1u << p);
+            }
+        }
+        return false;
+    }
+
+    // Slab test, returns where the ray enters the box or nothing when it misses it within maxDistance
+    std::optional<float> IntersectRay(const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance,
+                                      const glm::vec3 &min, const glm::vec3 &max) {
+        const glm::vec3 t0 = (min - origin) * inverseDirection;
+        const glm::vec3 t1 = (max - origin) * inverseDirection;
+        const glm::vec3 tNear = glm::min(t0, t1);
+        const glm::vec3 tFar = glm::max(t0, t1);
+        const float enter = std::max({tNear.x, tNear.y, tNear.z, 0.0f});
+        const float exit = std::min({tFar.x, tFar.y, tFar.z, maxDistance});
+        if (enter > exit) {
+            return std::nullopt;
+        }
+        return enter;
+    }
+} // namespace
+
+void BVH::Build(const AABBArrays &bounds) {
+    const auto boxCount = static_cast<uint32_t>(bounds.Size());
+    nodes.clear();
+    boxIndices.resize(boxCount);
+    std::iota(boxIndices.begin(), boxIndices.end(), 0);
+    if (boxCount == 0) {
+        return;
+    }
+
+    nodes.reserve(2 * static_cast<size_t>(boxCount) - 1);
+    nodes.push_back({.firstBox = 0, .boxCount = boxCount});
+    UpdateNodeBounds(nodes[0], bounds);
+
+    // NOTE: An explicit stack, a badly distributed scene can make the tree very deep
+    std::vector<uint32_t> pendingNodes{0};
+    while (!pendingNodes.empty()) {
+        const uint32_t nodeIndex = pendingNodes.back();
+        pendingNodes.pop_back();
+        if (Split(nodeIndex, bounds)) {
+            pendingNodes.push_back(nodes[nodeIndex].leftChild);
+            pendingNodes.push_back(nodes[nodeIndex].leftChild + 1);
+        }
+    }
+    GatherLeafBounds(bounds);
+}
+
+void BVH::Refit(const AABBArrays &bounds) {
+    if (bounds.Size() != boxIndices.size()) {
+        throw std::runtime_error("BVH refit with a different box count!");
+    }
+    GatherLeafBounds(bounds);
+
+    // Children are always created after their parent
+    for (size_t i = nodes.size(); i-- > 0;) {
+        Node &node = nodes[i];
+        if (node.IsLeaf()) {
+            UpdateNodeBounds(node, bounds);
+        } else {
+            const Node &left = nodes[node.leftChild];
+            const Node &right = nodes[node.leftChild + 1];
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+}
+
+void BVH::CullFrustum(const Frustum &frustum, std::vector<uint64_t> &visibility) const {
+    visibility.assign((boxIndices.size() + 63) / 64, 0);
+    if (nodes.empty()) {
+        return;
+    }
+
+    const auto setVisible = [&visibility](uint32_t box) { visibility[box / 64] |= uint64_t{1} << (box % 64); };
+
+    // Planes the node is known to be fully inside of are dropped for its whole subtree
+    constexpr uint32_t allPlanes = (1u << std::tuple_size_v<decltype(Frustum::planes)>) - 1;
+    std::vector<std::pair<uint32_t, uint32_t>> pendingNodes{{0, allPlanes}};
+    while (!pendingNodes.empty()) {
+        auto [nodeIndex, planeMask] = pendingNodes.back();
+        pendingNodes.pop_back();
+        const Node &node = nodes[nodeIndex];
+        if (IsOutsideFrustum(frustum, (node.min + node.max) * 0.5f, (node.max - node.min) * 0.5f, planeMask)) {
+            continue;
+        }
+
+        if (planeMask == 0) {
+            for (uint32_t i = node.firstBox; i < node.firstBox + node.boxCount; i++) {
+                setVisible(boxIndices[i]);
+            }
+        } else if (node.IsLeaf()) {
+            // The boxes of a leaf are contiguous in leafBounds, so they are tested as one batch
+            for (uint64_t leafVisibility = frustum.CullAABBs(leafBounds, node.firstBox, node.boxCount);
+                 leafVisibility != 0; leafVisibility &= leafVisibility - 1) {
+                setVisible(boxIndices[node.firstBox + std::countr_zero(leafVisibility)]);
+            }
+        } else {
+            pendingNodes.emplace_back(node.leftChild, planeMask);
+            pendingNodes.emplace_back(node.leftChild + 1, planeMask);
+        }
+    }
+}
+
+std::optional<BVH::Hit> BVH::RayCast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                                     const AABBArrays &bounds) const {
+    if (nodes.empty()) {
+        return std::nullopt;
+    }
+
+    // NOTE: Zero components give infinities, which the slab test handles
+    const glm::vec3 inverseDirection = 1.0f / direction;
+    std::optional<Hit> closestHit;
+    float closestDistance = maxDistance;
+
+    std::vector<uint32_t> pendingNodes{0};
+    while (!pendingNodes.empty()) {
+        const Node &node = nodes[pendingNodes.back()];
+        pendingNodes.pop_back();
+        if (!IntersectRay(origin, inverseDirection, closestDistance, node.min, node.max)) {
+            continue;
+        }
+
+        if (node.IsLeaf()) {
+            for (uint32_t i = node.firstBox; i < node.firstBox + node.boxCount; i++) {
+                const uint32_t box = boxIndices[i];
+                const glm::vec3 center = GetCenter(bounds, box);
+                const glm::vec3 extent = GetExtent(bounds, box);
+                const std::optional<float> distance =
+                        IntersectRay(origin, inverseDirection, closestDistance, center - extent, center + extent);
+                if (distance && (!closestHit || *distance < closestDistance)) {
+                    closestHit = Hit{.box = box, .distance = *distance};
+                    closestDistance = *distance;
+                }
+            }
+            continue;
+        }
+
+        // The nearer child goes on top, so its hits shorten the ray before the other child is visited
+        const Node &left = nodes[node.leftChild];
+        const Node &right = nodes[node.leftChild + 1];
+        const std::optional<float> leftDistance =
+                IntersectRay(origin, inverseDirection, closestDistance, left.min, left.max);
+        const std::optional<float> rightDistance =
+                IntersectRay(origin, inverseDirection, closestDistance, right.min, right.max);
+        const bool leftFirst = leftDistance && (!rightDistance || *leftDistance <= *rightDistance);
+        if (leftFirst) {
+            if (rightDistance) {
+                pendingNodes.push_back(node.leftChild + 1);
+            }
+            pendingNodes.push_back(node.leftChild);
+        } else {
+            if (leftDistance) {
+                pendingNodes.push_back(node.leftChild);
+            }
+            if (rightDistance) {
+                pendingNodes.push_back(node.leftChild + 1);
+            }
+        }
+    }
+    return closestHit;
+}
+
+bool BVH::Split(uint32_t nodeIndex, const AABBArrays &bounds) {
+    const Node node = nodes[nodeIndex];
+    if (node.boxCount <= 1) {
+        return false;
+    }
+
+    glm::vec3 centroidMin(std::numeric_limits<float>::max());
+    glm::vec3 centroidMax(std::numeric_limits<float>::lowest());
+    for (uint32_t i = node.firstBox; i < node.firstBox + node.boxCount; i++) {
+        const glm::vec3 center = GetCenter(bounds, boxIndices[i]);
+        centroidMin = glm::min(centroidMin, center);
+        centroidMax = glm::max(centroidMax, center);
+    }
+
+    struct Bin {
+        glm::vec3 min{std::numeric_limits<float>::max()};
+        glm::vec3 max{std::numeric_limits<float>::lowest()};
+        uint32_t count{0};
+    };
+    const auto getBin = [&](uint32_t box, int axis) {
+        const float scale = static_cast<float>(binCount) / (centroidMax[axis] - centroidMin[axis]);
+        const auto bin = static_cast<uint32_t>((GetCenter(bounds, box)[axis] - centroidMin[axis]) * scale);
+        return std::min(bin, binCount - 1);
+    };
+
+    // Cost of splitting after each bin along each axis, relative to the node's area like the leaf cost
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+        if (centroidMax[axis] <= centroidMin[axis]) {
+            continue;
+        }
+
+        std::array<Bin, binCount> bins{};
+        for (uint32_t i = node.firstBox; i < node.firstBox + node.boxCount; i++) {
+            const uint32_t box = boxIndices[i];
+            Bin &bin = bins[getBin(box, axis)];
+            const glm::vec3 center = GetCenter(bounds, box);
+            const glm::vec3 extent = GetExtent(bounds, box);
+            bin.min = glm::min(bin.min, center - extent);
+            bin.max = glm::max(bin.max, center + extent);
+            bin.count++;
+        }
+
+        // Sweep from the right first, then combine with the left side while sweeping from the left
+        std::array<float, binCount> rightAreas{};
+        std::array<uint32_t, binCount> rightCounts{};
+        Bin right;
+        for (uint32_t b = binCount - 1; b > 0; b--) {
+            right.min = glm::min(right.min, bins[b].min);
+            right.max = glm::max(right.max, bins[b].max);
+            right.count += bins[b].count;
+            rightAreas[b] = right.count > 0 ? GetHalfArea(right.min, right.max) : 0.0f;
+            rightCounts[b] = right.count;
+        }
+        Bin left;
+        for (uint32_t b = 0; b + 1 < binCount; b++) {
+            left.min = glm::min(left.min, bins[b].min);
+            left.max = glm::max(left.max, bins[b].max);
+            left.count += bins[b].count;
+            if (left.count == 0 || rightCounts[b + 1] == 0) {
+                continue;
+            }
+            const float cost = static_cast<float>(left.count) * GetHalfArea(left.min, left.max) +
+                               static_cast<float>(rightCounts[b + 1]) * rightAreas[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    uint32_t leftCount;
+    if (bestAxis == -1) {
+        // All centers coincide, nothing separates the boxes, so large nodes are just halved
+        if (node.boxCount <= maxLeafSize) {
+            return false;
+        }
+        leftCount = node.boxCount / 2;
+    } else {
+        const float leafCost = static_cast<float>(node.boxCount) * GetHalfArea(node.min, node.max);
+        if (bestCost >= leafCost && node.boxCount <= maxLeafSize) {
+            return false;
+        }
+        const auto first = boxIndices.begin() + node.firstBox;
+        const auto middle = std::partition(first, first + node.boxCount,
+                                           [&](uint32_t box) { return getBin(box, bestAxis) <= bestSplit; });
+        leftCount = static_cast<uint32_t>(middle - first);
+    }
+
+    const auto leftChild = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({.firstBox = node.firstBox, .boxCount = leftCount});
+    nodes.push_back({.firstBox = node.firstBox + leftCount, .boxCount = node.boxCount - leftCount});
+    UpdateNodeBounds(nodes[leftChild], bounds);
+    UpdateNodeBounds(nodes[leftChild + 1], bounds);
+    nodes[nodeIndex].leftChild = leftChild;
+    return true;
+}
+
+void BVH::UpdateNodeBounds(Node &node, const AABBArrays &bounds) const {
+    node.min = glm::vec3(std::numeric_limits<float>::max());
+    node.max = glm::vec3(std::numeric_limits<float>::lowest());
+    for (uint32_t i = node.firstBox; i < node.firstBox + node.boxCount; i++) {
+        const glm::vec3 center = GetCenter(bounds, boxIndices[i]);
+        const glm::vec3 extent = GetExtent(bounds, boxIndices[i]);
+        node.min = glm::min(node.min, center - extent);
+        node.max = glm::max(node.max, center + extent);
+    }
+}
+
+void BVH::GatherLeafBounds(const AABBArrays &bounds) {
+    leafBounds.Resize(boxIndices.size());
+    for (size_t i = 0; i < boxIndices.size(); i++) {
+        const uint32_t box = boxIndices[i];
+        leafBounds.centerX[i] = bounds.centerX[box];
+        leafBounds.centerY[i] = bounds.centerY[box];
+        leafBounds.centerZ[i] = bounds.centerZ[box];
+        leafBounds.extentX[i] = bounds.extentX[box];
+        leafBounds.extentY[i] = bounds.extentY[box];
+        leafBounds.extentZ[i] = bounds.extentZ[box];
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <optional>
+
+#include "Camera.h"
+
+// Bounding volume hierarchy over world space boxes, built top down with the binned surface area heuristic.
+// Moving boxes are handled by refitting the node bounds, the tree itself is only rebuilt on demand
+class BVH {
+public:
+    struct Hit {
+        uint32_t box;
+        float distance; // Along the ray direction, 0 when the ray starts inside the box
+    };
+
+    void Build(const AABBArrays &bounds);
+    // Recomputes the bounds of every node from its boxes, children before their parents
+    void Refit(const AABBArrays &bounds);
+
+    // Sets bit i of visibility unless box i is fully outside the frustum. Subtrees outside a plane are rejected
+    // without looking at their boxes, subtrees fully inside all planes accept their boxes without testing them and
+    // the boxes of the remaining leaves are tested with Frustum::CullAABBs
+    void CullFrustum(const Frustum &frustum, std::vector<uint64_t> &visibility) const;
+
+    // Closest box the ray enters within maxDistance
+    [[nodiscard]] std::optional<Hit> RayCast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                                             const AABBArrays &bounds) const;
+
+    [[nodiscard]] bool IsEmpty() const { return nodes.empty(); }
+    [[nodiscard]] size_t GetBoxCount() const { return boxIndices.size(); }
+
+private:
+    static constexpr uint32_t binCount = 16;
+    static constexpr uint32_t maxLeafSize = 8;
+    static_assert(maxLeafSize <= 64, "A leaf is culled into a single 64 bit visibility mask");
+
+    // Every node covers a contiguous range of boxIndices, a leaf has no children
+    struct Node {
+        glm::vec3 min{};
+        glm::vec3 max{};
+        uint32_t firstBox{0};
+        uint32_t boxCount{0};
+        uint32_t leftChild{0}; // The right child follows it, 0 for leaves since the root is nobody's child
+
+        [[nodiscard]] bool IsLeaf() const { return leftChild == 0; }
+    };
+
+    // Splits the node at the cheapest bin boundary, returns false when it stays a leaf
+    bool Split(uint32_t nodeIndex, const AABBArrays &bounds);
+    void UpdateNodeBounds(Node &node, const AABBArrays &bounds) const;
+    void GatherLeafBounds(const AABBArrays &bounds);
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> boxIndices;
+    AABBArrays leafBounds; // The boxes in boxIndices order
+};
@@ -0,0 +1,132 @@
+#include "pch.h"
+
+#include "Benchmark.h"
+
+CameraPath CameraPath::Load(const std::filesystem::path &path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Failed to open file - {}!", path.string()));
+    }
+
+    CameraPath cameraPath;
+    Keyframe keyframe{};
+    while (file >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.focusPoint.x >>
+           keyframe.focusPoint.y >> keyframe.focusPoint.z) {
+        cameraPath.keyframes.push_back(keyframe);
+    }
+
+    if (cameraPath.keyframes.empty()) {
+        throw std::runtime_error(std::format("Camera path {} has no keyframes!", path.string()));
+    }
+    return cameraPath;
+}
+
+CameraPath CameraPath::Orbit(const glm::vec3 &center, float radius, float height, uint32_t frameCount) {
+    CameraPath cameraPath;
+    cameraPath.keyframes.reserve(frameCount);
+    for (uint32_t i = 0; i < frameCount; ++i) {
+        const float angle = 2.0f * glm::pi<float>() * static_cast<float>(i) / static_cast<float>(frameCount);
+        cameraPath.keyframes.push_back({
+                .position = center + glm::vec3(radius * std::cos(angle), height, radius * std::sin(angle)),
+                .focusPoint = center,
+        });
+    }
+    return cameraPath;
+}
+
+void CameraPath::Save(const std::filesystem::path &path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Failed to open file - {}!", path.string()));
+    }
+
+    for (const auto &keyframe: keyframes) {
+        file << std::format("{} {} {} {} {} {}\n", keyframe.position.x, keyframe.position.y, keyframe.position.z,
+                            keyframe.focusPoint.x, keyframe.focusPoint.y, keyframe.focusPoint.z);
+    }
+}
+
+Benchmark::SceneResult &Benchmark::BeginScene(const std::filesystem::path &scenePath) {
+    results.push_back({.scenePath = scenePath});
+    return results.back();
+}
+
+Benchmark::Percentiles Benchmark::ComputePercentiles(std::vector<double> samples) {
+    if (samples.empty()) {
+        return {};
+    }
+
+    std::ranges::sort(samples);
+    // Nearest-rank percentile
+    const auto percentile = [&samples](double p) {
+        const auto rank = static_cast<size_t>(std::ceil(p * static_cast<double>(samples.size())));
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+
+    double total = 0.0;
+    for (const double sample: samples) {
+        total += sample;
+    }
+
+    return {
+            .p50 = percentile(0.50),
+            .p95 = percentile(0.95),
+            .p99 = percentile(0.99),
+            .average = total / static_cast<double>(samples.size()),
+    };
+}
+
+static std::string ToJSON(const Benchmark::Percentiles &percentiles) {
+    return std::format(R"({{"p50": {:.4f}, "p95": {:.4f}, "p99": {:.4f}, "avg": {:.4f}}})", percentiles.p50,
+                       percentiles.p95, percentiles.p99, percentiles.average);
+}
+
+static std::string EscapeJSON(const std::string &string) {
+    std::string escaped;
+    for (const char c: string) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+void Benchmark::WriteResults(const std::filesystem::path &path) const {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Failed to open file - {}!", path.string()));
+    }
+
+    std::vector<double> loadTimes;
+    std::vector<double> switchHitches;
+
+    file << "{\n  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &result = results[i];
+        loadTimes.push_back(result.loadTime);
+        if (result.switchHitch) {
+            switchHitches.push_back(*result.switchHitch);
+        }
+
+        file << "    {\n";
+        file << std::format("      \"scene\": \"{}\",\n", EscapeJSON(result.scenePath.generic_string()));
+        file << std::format("      \"frames\": {},\n", result.cpuFrameTimes.size());
+        file << std::format("      \"sceneLoadTimeMs\": {:.4f},\n", result.loadTime);
+        file << std::format("      \"sceneSwitchHitchMs\": {},\n",
+                            result.switchHitch ? std::format("{:.4f}", *result.switchHitch) : "null");
+        file << std::format("      \"cpuFrameTimeMs\": {},\n", ToJSON(ComputePercentiles(result.cpuFrameTimes)));
+        file << std::format("      \"gpuFrameTimeMs\": {},\n", ToJSON(ComputePercentiles(result.gpuFrameTimes)));
+        file << std::format("      \"vertexShaderInvocations\": {}\n",
+                            ToJSON(ComputePercentiles(result.vertexInvocations)));
+        file << (i + 1 < results.size() ? "    },\n" : "    }\n");
+    }
+    file << "  ],\n";
+
+    file << "  \"summary\": {\n";
+    file << std::format("    \"sceneLoadTimeMs\": {},\n", ToJSON(ComputePercentiles(loadTimes)));
+    file << std::format("    \"sceneSwitchHitchMs\": {}\n", ToJSON(ComputePercentiles(switchHitches)));
+    file << "  }\n}\n";
+
+    std::cout << "Benchmark results written to " << path.string() << std::endl;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Camera keyframes, one per frame, recorded from user input or generated
+struct CameraPath {
+    struct Keyframe {
+        glm::vec3 position;
+        glm::vec3 focusPoint;
+    };
+
+    [[nodiscard]] static CameraPath Load(const std::filesystem::path &path);
+    [[nodiscard]] static CameraPath Orbit(const glm::vec3 &center, float radius, float height, uint32_t frameCount);
+    void Save(const std::filesystem::path &path) const;
+
+    [[nodiscard]] const Keyframe &Sample(uint32_t frameIndex) const { return keyframes[frameIndex % keyframes.size()]; }
+
+    std::vector<Keyframe> keyframes;
+};
+
+class Benchmark {
+public:
+    // Replaces wall-clock time for animations so that runs are repeatable
+    static constexpr double fixedTimestep = 1.0 / 60.0;
+
+    struct Percentiles {
+        double p50{0.0};
+        double p95{0.0};
+        double p99{0.0};
+        double average{0.0};
+    };
+
+    struct SceneResult {
+        std::filesystem::path scenePath;
+        double loadTime{0.0}; // ms
+        std::optional<double> switchHitch; // ms, worst frame while this scene loaded and was swapped in
+        std::vector<double> cpuFrameTimes; // ms
+        std::vector<double> gpuFrameTimes; // ms
+        std::vector<double> vertexInvocations; // per GPU frame, all passes
+    };
+
+    SceneResult &BeginScene(const std::filesystem::path &scenePath);
+    void WriteResults(const std::filesystem::path &path) const;
+
+    [[nodiscard]] static Percentiles ComputePercentiles(std::vector<double> samples);
+
+    std::vector<SceneResult> results;
+};
@@ -0,0 +1,65 @@
+#include "pch.h"
+
+#include "CPUProfiler.h"
+
+#include <algorithm>
+
+void CPUProfiler::Record(const char *name, uint64_t start, uint64_t end) {
+    auto &buffer = GetThreadBuffer();
+    const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+    Slot &slot = buffer.slots[head % ringBufferSize];
+    slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.sequence.store(2 * head + 2, std::memory_order_release);
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+std::vector<CPUProfiler::Event> CPUProfiler::CollectEvents(uint64_t from, uint64_t to) {
+    std::vector<Event> collected;
+
+    std::lock_guard lock(buffersMutex);
+    for (const auto &buffer: buffers) {
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        const uint64_t count = std::min<uint64_t>(head, ringBufferSize);
+        for (uint64_t i = head - count; i < head; ++i) {
+            // Events the thread overwrote or is writing while this runs are dropped instead of read torn
+            const Slot &slot = buffer->slots[i % ringBufferSize];
+            const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            if (sequence != 2 * i + 2) {
+                continue;
+            }
+            const Event event = {
+                    .name = slot.name.load(std::memory_order_relaxed),
+                    .start = slot.start.load(std::memory_order_relaxed),
+                    .end = slot.end.load(std::memory_order_relaxed),
+                    .threadId = buffer->threadId,
+            };
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != sequence) {
+                continue;
+            }
+
+            if (event.start >= from && event.start <= to) {
+                collected.push_back(event);
+            }
+        }
+    }
+
+    std::ranges::sort(collected, {}, &Event::start);
+    return collected;
+}
+
+CPUProfiler::ThreadBuffer &CPUProfiler::GetThreadBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> threadBuffer = [] {
+        auto buffer = std::make_shared<ThreadBuffer>();
+
+        std::lock_guard lock(buffersMutex);
+        buffer->threadId = static_cast<uint32_t>(buffers.size()) + 1;
+        buffers.push_back(buffer);
+        return buffer;
+    }();
+    return *threadBuffer;
+}
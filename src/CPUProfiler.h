@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+class CPUProfiler {
+public:
+    struct Event {
+        const char *name{nullptr};
+        uint64_t start{0}; // ns, steady clock
+        uint64_t end{0}; // ns, steady clock
+        uint32_t threadId{0};
+    };
+
+    // Checked by every scope, everything else is skipped while profiling is disabled
+    [[nodiscard]] static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void SetEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+
+    [[nodiscard]] static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+    }
+
+    // NOTE: Only the pointer is stored, so name has to outlive the capture (string literals)
+    static void Record(const char *name, uint64_t start, uint64_t end);
+
+    // Gathers the events of every thread that started within [from, to], sorted by start time
+    [[nodiscard]] static std::vector<Event> CollectEvents(uint64_t from, uint64_t to);
+
+    // Events per thread, the oldest ones get overwritten
+    static constexpr uint32_t ringBufferSize = 16384;
+
+private:
+    // NOTE: Slots are read while their thread may be overwriting them. The sequence is odd during a write and
+    //       2 * (index + 1) once the event with that index is complete, readers skip slots it changes under them
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> start{0};
+        std::atomic<uint64_t> end{0};
+    };
+
+    struct ThreadBuffer {
+        std::array<Slot, ringBufferSize> slots;
+        std::atomic<uint64_t> head{0};
+        uint32_t threadId{0};
+    };
+
+    static ThreadBuffer &GetThreadBuffer();
+
+    static inline std::atomic<bool> enabled{false};
+
+    // Thread buffers are kept alive after their thread exits so their events can still be collected
+    static inline std::mutex buffersMutex;
+    static inline std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
@@ -3,6 +3,80 @@
 #include "Camera.h"
 #include "Scene.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CAMERA_AVX2
+#elif defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#define CAMERA_SSE
+#endif
+
+namespace {
+    // Same plane test as Camera::IsAABBFullyOutsideFrustum, for a box given as center and half extent
+    bool IsInsideFrustum(const glm::vec3 &center, const glm::vec3 &extent, const Frustum &frustum) {
+        for (const auto &plane: frustum.planes) {
+            const float radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+#if defined(CAMERA_AVX2) || defined(CAMERA_SSE)
+    // NOTE: The kernel below is written once against these overloads, the vector type picks the instruction set
+    inline __m128 Load(const float *values, __m128) { return _mm_loadu_ps(values); }
+    inline __m128 Splat(float value, __m128) { return _mm_set1_ps(value); }
+    inline __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+    inline __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+    inline __m128 Or(__m128 a, __m128 b) { return _mm_or_ps(a, b); }
+    inline __m128 Less(__m128 a, __m128 b) { return _mm_cmplt_ps(a, b); }
+    inline __m128 Zero(__m128) { return _mm_setzero_ps(); }
+    inline uint32_t MoveMask(__m128 v) { return static_cast<uint32_t>(_mm_movemask_ps(v)); }
+#endif
+
+#ifdef CAMERA_AVX2
+    inline __m256 Load(const float *values, __m256) { return _mm256_loadu_ps(values); }
+    inline __m256 Splat(float value, __m256) { return _mm256_set1_ps(value); }
+    inline __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+    inline __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+    inline __m256 Or(__m256 a, __m256 b) { return _mm256_or_ps(a, b); }
+    inline __m256 Less(__m256 a, __m256 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    inline __m256 Zero(__m256) { return _mm256_setzero_ps(); }
+    inline uint32_t MoveMask(__m256 v) { return static_cast<uint32_t>(_mm256_movemask_ps(v)); }
+    using SimdFloat = __m256;
+#elif defined(CAMERA_SSE)
+    using SimdFloat = __m128;
+#endif
+
+#if defined(CAMERA_AVX2) || defined(CAMERA_SSE)
+    constexpr size_t simdWidth = sizeof(SimdFloat) / sizeof(float);
+
+    // Returns the visibility of the simdWidth boxes starting at index, one bit per box
+    template<typename V>
+    uint32_t TestAABBBlock(const AABBArrays &bounds, size_t index, const Frustum &frustum) {
+        const V centerX = Load(&bounds.centerX[index], V{});
+        const V centerY = Load(&bounds.centerY[index], V{});
+        const V centerZ = Load(&bounds.centerZ[index], V{});
+        const V extentX = Load(&bounds.extentX[index], V{});
+        const V extentY = Load(&bounds.extentY[index], V{});
+        const V extentZ = Load(&bounds.extentZ[index], V{});
+
+        V outside = Zero(V{});
+        for (const auto &plane: frustum.planes) {
+            const V distance = Add(Add(Mul(Splat(plane.x, V{}), centerX), Mul(Splat(plane.y, V{}), centerY)),
+                                   Add(Mul(Splat(plane.z, V{}), centerZ), Splat(plane.w, V{})));
+            const V radius = Add(Add(Mul(Splat(std::abs(plane.x), V{}), extentX),
+                                     Mul(Splat(std::abs(plane.y), V{}), extentY)),
+                                 Mul(Splat(std::abs(plane.z), V{}), extentZ));
+            // NOTE: distance < -radius, written as distance + radius < 0
+            outside = Or(outside, Less(Add(distance, radius), Zero(V{})));
+        }
+        return ~MoveMask(outside) & ((1u << simdWidth) - 1);
+    }
+#endif
+} // namespace
+
 Camera::Camera(const glm::vec3 &position, const glm::vec3 &worldUp, const glm::vec3 &focusPoint,
                const double aspectRatio, const double yFov) :
     focusPoint(focusPoint), position(position), up(worldUp), worldUp(worldUp), aspectRatio(aspectRatio),
@@ -20,8 +94,9 @@ void Camera::UpdateVectors() {
 }
 
 // https://github.com/PacktPublishing/3D-Graphics-Rendering-Cookbook-Second-Edition/blob/main/shared/UtilsMath.h
-void Camera::UpdateFrustum() {
-    const auto viewProj = glm::transpose(GetProjectionMatrix() * GetViewMatrix());
+Frustum Frustum::FromMatrix(const glm::mat4 &viewProjection) {
+    Frustum frustum;
+    const auto viewProj = glm::transpose(viewProjection);
     frustum.planes[0] = glm::vec4(viewProj[3] + viewProj[0]); // left
     frustum.planes[1] = glm::vec4(viewProj[3] - viewProj[0]); // right
     frustum.planes[2] = glm::vec4(viewProj[3] + viewProj[1]); // bottom
@@ -34,6 +109,34 @@ void Camera::UpdateFrustum() {
         const float length = glm::length(glm::vec3(plane));
         plane /= length;
     }
+    return frustum;
+}
+
+uint64_t Frustum::CullAABBs(const AABBArrays &bounds, size_t first, size_t count) const {
+    if (count > 64) {
+        throw std::runtime_error("Too many boxes for one visibility mask!");
+    }
+
+    uint64_t visibility = 0;
+    size_t i = 0;
+#if defined(CAMERA_AVX2) || defined(CAMERA_SSE)
+    for (; i + simdWidth <= count; i += simdWidth) {
+        visibility |= static_cast<uint64_t>(TestAABBBlock<SimdFloat>(bounds, first + i, *this)) << i;
+    }
+#endif
+    for (; i < count; i++) {
+        const size_t index = first + i;
+        const glm::vec3 center(bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index]);
+        const glm::vec3 extent(bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index]);
+        if (IsInsideFrustum(center, extent, *this)) {
+            visibility |= uint64_t{1} << i;
+        }
+    }
+    return visibility;
+}
+
+void Camera::UpdateFrustum() {
+    frustum = Frustum::FromMatrix(GetProjectionMatrix() * GetViewMatrix());
 }
 
 bool Camera::IsAABBFullyOutsideFrustum(const AABB &aabb) const {
@@ -62,6 +165,12 @@ glm::mat4 Camera::GetProjectionMatrix() const {
     return proj;
 }
 
+void Camera::SetView(const glm::vec3 &position, const glm::vec3 &focusPoint) {
+    this->position = position;
+    this->focusPoint = focusPoint;
+    UpdateVectors();
+}
+
 void Camera::SetMove(bool move) {
     moveCamera = move;
     if (!moveCamera) {
@@ -154,10 +263,40 @@ void Camera::HandleMouseScroll(double scrollAmount) {
     UpdateVectors();
 }
 
+glm::vec3 Camera::GetRayDirection(const glm::vec2 &ndc) const {
+    // NOTE: The point on the far plane, the near plane would work as well since the ray starts at the camera
+    const glm::vec4 farPoint = glm::inverse(GetProjectionMatrix() * GetViewMatrix()) * glm::vec4(ndc, 1.0f, 1.0f);
+    return glm::normalize(glm::vec3(farPoint) / farPoint.w - position);
+}
+
 Camera::GPUData Camera::GetGPUData() const {
     return {
             .view = GetViewMatrix(),
             .proj = GetProjectionMatrix(),
             .position = position,
+            .frustumPlanes = frustum.planes,
     };
 }
+
+void AABBArrays::Resize(size_t count) {
+    for (std::vector<float> *values: {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ}) {
+        values->resize(count);
+    }
+}
+
+void AABBArrays::Set(size_t index, const AABB &aabb) {
+    const glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+    const glm::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    extentX[index] = extent.x;
+    extentY[index] = extent.y;
+    extentZ[index] = extent.z;
+}
+
+AABB AABBArrays::Get(size_t index) const {
+    const glm::vec3 center(centerX[index], centerY[index], centerZ[index]);
+    const glm::vec3 extent(extentX[index], extentY[index], extentZ[index]);
+    return {.min = center - extent, .max = center + extent};
+}
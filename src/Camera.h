@@ -1,10 +1,29 @@
 #pragma once
 
+struct AABB;
+struct AABBArrays;
+
 struct Frustum {
     std::array<glm::vec4, 6> planes; // left, right, top, bottom, near, far
+
+    // Normalized planes of the clip volume of a view projection matrix
+    [[nodiscard]] static Frustum FromMatrix(const glm::mat4 &viewProjection);
+
+    // Bit i is set unless box first + i is fully outside, for up to 64 boxes. Boxes are tested 8 at a time with AVX2
+    // or 4 at a time with SSE
+    [[nodiscard]] uint64_t CullAABBs(const AABBArrays &bounds, size_t first, size_t count) const;
 };
 
-struct AABB;
+// Bounding boxes as centers and half extents in structure of arrays layout, so they can be processed 8 at a time
+struct AABBArrays {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    [[nodiscard]] size_t Size() const { return centerX.size(); }
+    void Resize(size_t count);
+    void Set(size_t index, const AABB &aabb);
+    [[nodiscard]] AABB Get(size_t index) const;
+};
 
 class Camera {
 public:
@@ -18,9 +37,12 @@ public:
     [[nodiscard]] glm::mat4 GetViewMatrix() const;
     [[nodiscard]] glm::mat4 GetProjectionMatrix() const;
     [[nodiscard]] glm::vec3 GetPosition() const { return position; }
+    // Direction of the ray from the camera through a point given in normalized device coordinates
+    [[nodiscard]] glm::vec3 GetRayDirection(const glm::vec2 &ndc) const;
     [[nodiscard]] Frustum GetFrustum() const { return frustum; }
 
     void SetAspectRatio(double aspectRatio) { this->aspectRatio = aspectRatio; }
+    void SetView(const glm::vec3 &position, const glm::vec3 &focusPoint);
 
     void SetMove(bool move);
     void HandleMouseMovement(double xPos, double yPos);
@@ -31,6 +53,7 @@ public:
         glm::mat4 view;
         glm::mat4 proj;
         glm::vec3 position;
+        std::array<glm::vec4, 6> frustumPlanes; // Read by the culling pass
     };
 
     [[nodiscard]] GPUData GetGPUData() const;
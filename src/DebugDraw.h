@@ -1,5 +1,7 @@
 #pragma once
 
+#include <glm/gtc/type_aligned.hpp>
+
 #include "Scene.h"
 #include "Vulkan/Buffer.h"
 #include "Vulkan/VulkanPipeline.h"
@@ -27,9 +29,10 @@ public:
     void EndFrame();
 
 private:
+    // NOTE: Packed to match the R32G32B32_SFLOAT inputs of DebugDraw.vert
     struct Vertex {
-        glm::vec3 position;
-        glm::vec3 color;
+        glm::packed_vec3 position;
+        glm::packed_vec3 color;
     };
     std::vector<Vertex> vertices;
 
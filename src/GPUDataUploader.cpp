@@ -1,6 +1,7 @@
 #include "pch.h"
 
 #include "GPUDataUploader.h"
+#include "Vulkan/DebugMarkers.h"
 
 void GPUDataUploader::InitializeStagingBuffers(std::shared_ptr<VulkanDevice> device) {
     this->device = device;
@@ -17,7 +18,7 @@ void GPUDataUploader::InitializeStagingBuffers(std::shared_ptr<VulkanDevice> dev
 }
 
 // TODO: Duplicate vertex buffer on GPU????
-void GPUDataUploader::AddCopy(void *src, VkBuffer dstBuffer, VkDeviceSize size) {
+void GPUDataUploader::AddCopy(const void *src, VkBuffer dstBuffer, VkDeviceSize size) {
     assert(stagingBuffers[currentFrame].currentOffset + size <= stagingBuffers[currentFrame].buffer->GetSize());
 
     // TODO: Check bounds
@@ -33,6 +34,7 @@ void GPUDataUploader::AddCopy(void *src, VkBuffer dstBuffer, VkDeviceSize size)
 }
 
 void GPUDataUploader::Flush(VkCommandBuffer commandBuffer) {
+    DebugMarkers::ScopedMarker marker("GPUDataUploader::Flush");
     if (queuedBufferCopies.empty()) {
         return;
     }
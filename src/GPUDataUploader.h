@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <span>
 #include <vector>
 
 #include "Vulkan/Buffer.h"
@@ -26,13 +27,18 @@ public:
 
     void NextFrame();
 
-    void AddCopy(void* src, VkBuffer dstBuffer, VkDeviceSize size);
+    void AddCopy(const void* src, VkBuffer dstBuffer, VkDeviceSize size);
 
     template <typename T>
-    void AddCopy(std::vector<T>& vector, VkBuffer dstBuffer) {
+    void AddCopy(const std::vector<T>& vector, VkBuffer dstBuffer) {
         AddCopy(vector.data(), dstBuffer, vector.size() * sizeof(T));
     }
 
+    template <typename T>
+    void AddCopy(std::span<const T> values, VkBuffer dstBuffer) {
+        AddCopy(values.data(), dstBuffer, values.size_bytes());
+    }
+
     void Flush(VkCommandBuffer commandBuffer);
 
     // Queued buffer copies for the current frame
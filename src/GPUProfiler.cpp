@@ -0,0 +1,279 @@
+#include "pch.h"
+
+#include "GPUProfiler.h"
+#include "CPUProfiler.h"
+#include "Vulkan/Utils.h"
+
+void GPUProfiler::Initialize(std::shared_ptr<VulkanDevice> device, uint32_t framesInFlight) {
+    this->device = std::move(device);
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(this->device->GetPhysicalDevice(), &properties);
+    supported = properties.limits.timestampComputeAndGraphics;
+    timestampPeriod = properties.limits.timestampPeriod;
+    if (!supported) {
+        std::cerr << "Timestamp queries are not supported, GPU timings will not be available" << std::endl;
+        return;
+    }
+    statisticsSupported = this->device->IsPipelineStatisticsSupported();
+    if (!statisticsSupported) {
+        std::cerr << "Pipeline statistics queries are not supported, vertex invocations will not be available"
+                  << std::endl;
+    }
+
+    frames.resize(framesInFlight);
+    for (auto &frame: frames) {
+        const VkQueryPoolCreateInfo queryPoolInfo{
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                .queryCount = maxQueriesPerFrame,
+        };
+        VK_CHECK(vkCreateQueryPool(this->device->GetDevice(), &queryPoolInfo, nullptr, &frame.queryPool),
+                 "Failed to create timestamp query pool!");
+
+        if (!statisticsSupported) {
+            continue;
+        }
+        const VkQueryPoolCreateInfo statisticsQueryPoolInfo{
+                .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+                .queryCount = maxPassesPerFrame,
+                .pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT,
+        };
+        VK_CHECK(vkCreateQueryPool(this->device->GetDevice(), &statisticsQueryPoolInfo, nullptr,
+                                   &frame.statisticsQueryPool),
+                 "Failed to create pipeline statistics query pool!");
+    }
+
+    const VkQueryPoolCreateInfo calibrationQueryPoolInfo{
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = 1,
+    };
+    VK_CHECK(vkCreateQueryPool(this->device->GetDevice(), &calibrationQueryPoolInfo, nullptr, &calibrationQueryPool),
+             "Failed to create calibration query pool!");
+}
+
+void GPUProfiler::Destroy() {
+    for (const auto &frame: frames) {
+        vkDestroyQueryPool(device->GetDevice(), frame.queryPool, nullptr);
+        vkDestroyQueryPool(device->GetDevice(), frame.statisticsQueryPool, nullptr);
+    }
+    frames.clear();
+    vkDestroyQueryPool(device->GetDevice(), calibrationQueryPool, nullptr);
+}
+
+void GPUProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint64_t frameNumber) {
+    if (!supported || frameIndex >= frames.size()) {
+        return;
+    }
+
+    auto &frame = frames[frameIndex];
+    frame.frameNumber = frameNumber;
+    frame.passes.clear();
+    frame.queryCount = 2; // 0 and 1 are the frame begin/end
+    frame.pending = true;
+
+    vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, maxQueriesPerFrame);
+    if (statisticsSupported) {
+        vkCmdResetQueryPool(commandBuffer, frame.statisticsQueryPool, 0, maxPassesPerFrame);
+    }
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, frame.queryPool, 0);
+}
+
+void GPUProfiler::EndFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (!supported || frameIndex >= frames.size()) {
+        return;
+    }
+
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, frames[frameIndex].queryPool, 1);
+}
+
+void GPUProfiler::BeginPass(VkCommandBuffer commandBuffer, uint32_t frameIndex, std::string_view name) {
+    if (!supported || frameIndex >= frames.size()) {
+        return;
+    }
+
+    auto &frame = frames[frameIndex];
+    if (frame.queryCount + 2 > maxQueriesPerFrame) {
+        return;
+    }
+
+    frame.passes.push_back({.name = std::string(name), .beginQuery = frame.queryCount});
+    // NOTE: ALL_COMMANDS waits for the previous commands, so passes don't overlap in the results
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.queryPool, frame.queryCount++);
+    if (statisticsSupported) {
+        vkCmdBeginQuery(commandBuffer, frame.statisticsQueryPool, static_cast<uint32_t>(frame.passes.size() - 1), 0);
+    }
+}
+
+void GPUProfiler::EndPass(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    if (!supported || frameIndex >= frames.size()) {
+        return;
+    }
+
+    auto &frame = frames[frameIndex];
+    if (frame.passes.empty() || frame.passes.back().endQuery != 0) {
+        return;
+    }
+
+    frame.passes.back().endQuery = frame.queryCount;
+    if (statisticsSupported) {
+        vkCmdEndQuery(commandBuffer, frame.statisticsQueryPool, static_cast<uint32_t>(frame.passes.size() - 1));
+    }
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, frame.queryPool, frame.queryCount++);
+}
+
+void GPUProfiler::CollectResults(uint32_t frameIndex) {
+    if (!supported || frameIndex >= frames.size() || !frames[frameIndex].pending) {
+        return;
+    }
+
+    auto &frame = frames[frameIndex];
+    std::array<uint64_t, maxQueriesPerFrame> timestamps{};
+    const VkResult result =
+            vkGetQueryPoolResults(device->GetDevice(), frame.queryPool, 0, frame.queryCount,
+                                  frame.queryCount * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+                                  VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+
+    std::array<uint64_t, maxPassesPerFrame> vertexInvocations{};
+    const auto passCount = static_cast<uint32_t>(frame.passes.size());
+    if (statisticsSupported && passCount > 0 &&
+        vkGetQueryPoolResults(device->GetDevice(), frame.statisticsQueryPool, 0, passCount,
+                              passCount * sizeof(uint64_t), vertexInvocations.data(), sizeof(uint64_t),
+                              VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) {
+        return;
+    }
+    frame.pending = false;
+
+    const auto toMilliseconds = [this](uint64_t ticks) { return static_cast<double>(ticks) * timestampPeriod / 1e6; };
+
+    FrameResult frameResult{
+            .frameNumber = frame.frameNumber,
+            .startTimestamp = static_cast<uint64_t>(static_cast<double>(timestamps[0]) * timestampPeriod),
+            .frameTime = toMilliseconds(timestamps[1] - timestamps[0]),
+    };
+    for (uint32_t i = 0; i < passCount; i++) {
+        const auto &pass = frame.passes[i];
+        if (pass.endQuery == 0) {
+            continue;
+        }
+        frameResult.passes.push_back({
+                .name = pass.name,
+                .start = toMilliseconds(timestamps[pass.beginQuery] - timestamps[0]),
+                .time = toMilliseconds(timestamps[pass.endQuery] - timestamps[pass.beginQuery]),
+                .vertexInvocations = vertexInvocations[i],
+        });
+        frameResult.vertexInvocations += vertexInvocations[i];
+    }
+
+    if (framesToCapture > 0) {
+        capturedFrames.push_back(frameResult);
+        if (--framesToCapture == 0) {
+            CPUProfiler::SetEnabled(false);
+            WriteCapture();
+        }
+    }
+
+    latestResult = std::move(frameResult);
+}
+
+void GPUProfiler::BeginCapture(uint32_t frameCount, std::filesystem::path path) {
+    if (!supported || IsCapturing()) {
+        return;
+    }
+
+    Calibrate();
+
+    capturedFrames.clear();
+    framesToCapture = frameCount;
+    capturePath = std::move(path);
+
+    captureStart = CPUProfiler::Now();
+    CPUProfiler::SetEnabled(true);
+}
+
+void GPUProfiler::Calibrate() {
+    // Otherwise the timestamp would be queued behind the frames in flight
+    device->WaitIdle();
+
+    VkCommandBuffer commandBuffer = device->BeginSingleTimeCommands();
+    vkCmdResetQueryPool(commandBuffer, calibrationQueryPool, 0, 1);
+    vkCmdWriteTimestamp2(commandBuffer, VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT, calibrationQueryPool, 0);
+
+    // NOTE: The timestamp is written somewhere between the submit and the end of the wait, so the midpoint is used.
+    // The error is bounded by the submission latency, which is well below the length of a pass
+    const uint64_t submitTime = CPUProfiler::Now();
+    device->EndSingleTimeCommands(commandBuffer);
+    const uint64_t completeTime = CPUProfiler::Now();
+
+    uint64_t timestamp{0};
+    VK_CHECK(vkGetQueryPoolResults(device->GetDevice(), calibrationQueryPool, 0, 1, sizeof(uint64_t), &timestamp,
+                                   sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT),
+             "Failed to read calibration timestamp!");
+
+    const uint64_t cpuTime = submitTime + (completeTime - submitTime) / 2;
+    const auto gpuTime = static_cast<uint64_t>(static_cast<double>(timestamp) * timestampPeriod);
+    gpuToCpuOffset = static_cast<int64_t>(cpuTime) - static_cast<int64_t>(gpuTime);
+}
+
+void GPUProfiler::WriteCapture() const {
+    std::ofstream file(capturePath);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file - " << capturePath.string() << std::endl;
+        return;
+    }
+
+    const auto toCpuTime = [this](uint64_t gpuTimestamp) {
+        return static_cast<int64_t>(gpuTimestamp) + gpuToCpuOffset;
+    };
+    const std::vector<CPUProfiler::Event> cpuEvents = CPUProfiler::CollectEvents(captureStart, CPUProfiler::Now());
+
+    // NOTE: The first captured GPU frames were submitted before the capture started
+    int64_t origin = static_cast<int64_t>(captureStart);
+    if (!capturedFrames.empty()) {
+        origin = std::min(origin, toCpuTime(capturedFrames.front().startTimestamp));
+    }
+    const auto toMicroseconds = [origin](int64_t time) { return static_cast<double>(time - origin) / 1e3; };
+
+    // Chrome trace event format, pid 1 is the CPU with a tid per thread, pid 2 the GPU
+    std::vector<std::string> events;
+    std::set<uint32_t> threadIds;
+    for (const auto &event: cpuEvents) {
+        threadIds.insert(event.threadId);
+        events.push_back(std::format(R"({{"name": "{}", "ph": "X", "pid": 1, "tid": {}, "ts": {:.3f}, )"
+                                     R"("dur": {:.3f}}})",
+                                     event.name, event.threadId, toMicroseconds(static_cast<int64_t>(event.start)),
+                                     static_cast<double>(event.end - event.start) / 1e3));
+    }
+    for (const uint32_t threadId: threadIds) {
+        events.push_back(std::format(R"({{"name": "thread_name", "ph": "M", "pid": 1, "tid": {}, )"
+                                     R"("args": {{"name": "Thread {}"}}}})",
+                                     threadId, threadId));
+    }
+
+    for (const auto &frame: capturedFrames) {
+        const double frameStart = toMicroseconds(toCpuTime(frame.startTimestamp));
+        events.push_back(std::format(R"({{"name": "Frame {}", "ph": "X", "pid": 2, "tid": 1, "ts": {:.3f}, )"
+                                     R"("dur": {:.3f}}})",
+                                     frame.frameNumber, frameStart, frame.frameTime * 1e3));
+        for (const auto &pass: frame.passes) {
+            events.push_back(std::format(R"({{"name": "{}", "ph": "X", "pid": 2, "tid": 2, "ts": {:.3f}, )"
+                                         R"("dur": {:.3f}}})",
+                                         pass.name, frameStart + pass.start * 1e3, pass.time * 1e3));
+        }
+    }
+
+    file << "{\"traceEvents\": [\n";
+    file << R"({"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "CPU"}},)" << "\n";
+    file << R"({"name": "process_name", "ph": "M", "pid": 2, "args": {"name": "GPU"}})";
+    for (const auto &event: events) {
+        file << ",\n" << event;
+    }
+    file << "\n]}\n";
+
+    std::cout << "Trace written to " << capturePath.string() << std::endl;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Vulkan/VulkanDevice.h"
+
+class GPUProfiler {
+public:
+    struct PassResult {
+        std::string name;
+        double start{0.0}; // ms, relative to the start of the frame
+        double time{0.0}; // ms
+        uint64_t vertexInvocations{0}; // vertex shader invocations, from a pipeline statistics query
+    };
+
+    struct FrameResult {
+        uint64_t frameNumber{0};
+        uint64_t startTimestamp{0}; // ns, device timeline
+        double frameTime{0.0}; // ms
+        uint64_t vertexInvocations{0}; // sum of the passes
+        std::vector<PassResult> passes;
+    };
+
+    GPUProfiler() = default;
+
+    void Initialize(std::shared_ptr<VulkanDevice> device, uint32_t framesInFlight);
+    void Destroy();
+
+    void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint64_t frameNumber);
+    void EndFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    // Passes can't be nested
+    void BeginPass(VkCommandBuffer commandBuffer, uint32_t frameIndex, std::string_view name);
+    void EndPass(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+    // Reads back the timestamps of the last submission that used frameIndex.
+    // Must only be called after the fence of that frame was waited on, so it never stalls.
+    void CollectResults(uint32_t frameIndex);
+
+    // Records the next frameCount collected frames and writes them as a Chrome trace (chrome://tracing, Perfetto).
+    // CPU profiling is enabled for the duration of the capture, and its scopes are written on the same timeline.
+    void BeginCapture(uint32_t frameCount, std::filesystem::path path);
+    [[nodiscard]] bool IsCapturing() const { return framesToCapture > 0; }
+
+    [[nodiscard]] std::optional<FrameResult> GetLatestResult() const { return latestResult; }
+    [[nodiscard]] bool IsSupported() const { return supported; }
+
+private:
+    struct PassQueries {
+        std::string name;
+        uint32_t beginQuery{0};
+        uint32_t endQuery{0};
+    };
+
+    struct FrameQueries {
+        VkQueryPool queryPool{VK_NULL_HANDLE};
+        VkQueryPool statisticsQueryPool{VK_NULL_HANDLE}; // one query per pass, when statisticsSupported
+        uint64_t frameNumber{0};
+        uint32_t queryCount{0};
+        std::vector<PassQueries> passes;
+        bool pending{false};
+    };
+
+    // Estimates the offset from the device timeline to the CPUProfiler clock
+    void Calibrate();
+    void WriteCapture() const;
+
+    // Frame begin/end plus a begin/end pair per pass
+    static constexpr uint32_t maxQueriesPerFrame = 64;
+    static constexpr uint32_t maxPassesPerFrame = (maxQueriesPerFrame - 2) / 2;
+
+    // One query pool per frame in flight
+    std::vector<FrameQueries> frames;
+    std::optional<FrameResult> latestResult;
+
+    VkQueryPool calibrationQueryPool{VK_NULL_HANDLE};
+
+    uint32_t framesToCapture{0};
+    std::vector<FrameResult> capturedFrames;
+    std::filesystem::path capturePath;
+    uint64_t captureStart{0}; // ns, CPUProfiler clock
+    int64_t gpuToCpuOffset{0}; // ns
+
+    double timestampPeriod{1.0}; // ns per tick
+    bool supported{false};
+    bool statisticsSupported{false}; // vertexInvocations stays 0 without pipeline statistics queries
+
+    std::shared_ptr<VulkanDevice> device;
+};
@@ -0,0 +1,166 @@
+#include "pch.h"
+
+#include "JobSystem.h"
+
+namespace {
+    // Lets ParallelFor called from inside a job push to the worker's own queue
+    struct WorkerIdentity {
+        const void *jobSystem{nullptr};
+        uint32_t queueIndex{0};
+    };
+    thread_local WorkerIdentity currentWorker;
+} // namespace
+
+JobSystem::JobSystem(uint32_t threadCount) {
+    queues.reserve(threadCount + 1);
+    for (uint32_t i = 0; i < threadCount + 1; ++i) {
+        queues.push_back(std::make_unique<JobQueue>());
+    }
+
+    workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(sleepMutex);
+        stopping = true;
+    }
+    wakeCondition.notify_all();
+
+    // Queued tasks are still executed before the workers exit. ParallelFor only returns once its jobs ran
+    for (auto &worker: workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grainSize,
+                            const std::function<void(size_t begin, size_t end)> &function) {
+    if (count == 0) {
+        return;
+    }
+    grainSize = std::max<size_t>(grainSize, 1);
+    const size_t jobCount = (count + grainSize - 1) / grainSize;
+    if (jobCount == 1) {
+        function(0, count);
+        return;
+    }
+
+    Batch batch{.function = function, .remainingJobs = jobCount};
+    const uint32_t queueIndex = GetCurrentQueueIndex();
+    {
+        // NOTE: Pushed in reverse, so the owner takes the ranges front to back and thieves take them from the end
+        JobQueue &queue = *queues[queueIndex];
+        std::lock_guard lock(queue.mutex);
+        for (size_t job = jobCount; job-- > 0;) {
+            queue.jobs.push_back({.batch = &batch, .begin = job * grainSize,
+                                  .end = std::min(count, (job + 1) * grainSize)});
+        }
+    }
+    {
+        std::lock_guard lock(sleepMutex);
+        queuedJobs += static_cast<int64_t>(jobCount);
+    }
+    wakeCondition.notify_all();
+
+    // The caller works on its own ranges, or on any other job, until its batch is done
+    while (batch.remainingJobs.load(std::memory_order_acquire) > 0) {
+        Job job;
+        if (TakeJob(queueIndex, job)) {
+            RunJob(job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    if (batch.error) {
+        std::rethrow_exception(batch.error);
+    }
+}
+
+void JobSystem::WorkerLoop(uint32_t queueIndex) {
+    currentWorker = {.jobSystem = this, .queueIndex = queueIndex};
+    while (true) {
+        Job job;
+        if (TakeJob(queueIndex, job)) {
+            RunJob(job);
+            continue;
+        }
+        // NOTE: Only once no range is left, so a ParallelFor never waits behind queued tasks
+        std::function<void()> task;
+        if (TakeTask(task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock lock(sleepMutex);
+        wakeCondition.wait(lock, [this] { return stopping || queuedJobs.load() > 0; });
+        if (stopping && queuedJobs.load() <= 0) {
+            return;
+        }
+    }
+}
+
+bool JobSystem::TakeJob(uint32_t queueIndex, Job &job) {
+    const auto queueCount = static_cast<uint32_t>(queues.size());
+    for (uint32_t i = 0; i < queueCount; ++i) {
+        JobQueue &queue = *queues[(queueIndex + i) % queueCount];
+        std::lock_guard lock(queue.mutex);
+        if (queue.jobs.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        } else {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+        queuedJobs.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::RunJob(const Job &job) {
+    Batch &batch = *job.batch;
+    try {
+        batch.function(job.begin, job.end);
+    } catch (...) {
+        std::lock_guard lock(batch.errorMutex);
+        if (!batch.error) {
+            batch.error = std::current_exception();
+        }
+    }
+    // NOTE: Last access to the batch, the caller may return as soon as it sees 0
+    batch.remainingJobs.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::PushTask(std::function<void()> task) {
+    {
+        std::lock_guard lock(taskMutex);
+        tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard lock(sleepMutex);
+        queuedJobs += 1;
+    }
+    wakeCondition.notify_one();
+}
+
+bool JobSystem::TakeTask(std::function<void()> &task) {
+    std::lock_guard lock(taskMutex);
+    if (tasks.empty()) {
+        return false;
+    }
+    task = std::move(tasks.front());
+    tasks.pop_front();
+    queuedJobs.fetch_sub(1);
+    return true;
+}
+
+uint32_t JobSystem::GetCurrentQueueIndex() const {
+    return currentWorker.jobSystem == this ? currentWorker.queueIndex : static_cast<uint32_t>(queues.size() - 1);
+}
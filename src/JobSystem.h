@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+// Fork-join scheduler for per-frame work. Every thread owns a job deque, it takes its newest job first while idle
+// workers steal the oldest job of another thread, so a split range spreads across the cores without a shared queue.
+// The same workers also run background tasks, like pipeline builds and image decoding, in FIFO order
+class JobSystem {
+public:
+    // Defaults to one worker per hardware thread, minus the main thread which joins in while it waits, and at least one
+    explicit JobSystem(uint32_t threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &other) = delete;
+    JobSystem &operator=(const JobSystem &other) = delete;
+
+    // Calls function for consecutive ranges of at most grainSize covering [0, count) and returns once all of them
+    // ran. Ranges run concurrently, the calling thread helps. The first exception thrown by a range is rethrown here
+    void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)> &function);
+
+    // Runs task on a worker that has no ParallelFor range to take. Exceptions thrown by the task are rethrown by the
+    // returned future's get()
+    template<typename F>
+    auto Submit(F &&task) -> std::future<std::invoke_result_t<F>> {
+        using Result = std::invoke_result_t<F>;
+        // NOTE: std::function needs a copyable callable, packaged_task isn't
+        auto packagedTask = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> future = packagedTask->get_future();
+        PushTask([packagedTask] { (*packagedTask)(); });
+        return future;
+    }
+
+    [[nodiscard]] uint32_t GetThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+private:
+    // Ranges of one ParallelFor call, lives on the caller's stack until all of them ran
+    struct Batch {
+        const std::function<void(size_t, size_t)> &function;
+        std::atomic<size_t> remainingJobs;
+        std::mutex errorMutex{};
+        std::exception_ptr error{};
+    };
+
+    struct Job {
+        Batch *batch{nullptr};
+        size_t begin{0};
+        size_t end{0};
+    };
+
+    struct JobQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void WorkerLoop(uint32_t queueIndex);
+    // Own queue first, then the other queues, starting after the own one so thieves spread out
+    bool TakeJob(uint32_t queueIndex, Job &job);
+    static void RunJob(const Job &job);
+    void PushTask(std::function<void()> task);
+    bool TakeTask(std::function<void()> &task);
+    [[nodiscard]] uint32_t GetCurrentQueueIndex() const;
+
+    // One queue per worker, the last one is shared by all threads outside the job system
+    std::vector<std::unique_ptr<JobQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex taskMutex;
+    std::deque<std::function<void()>> tasks;
+
+    // Jobs and tasks pushed but not taken yet, workers sleep while it is 0
+    // NOTE: Signed, a job can be taken before its push is counted
+    std::atomic<int64_t> queuedJobs{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeCondition;
+    bool stopping{false};
+};
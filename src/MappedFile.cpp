@@ -0,0 +1,109 @@
+#include "pch.h"
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+#ifdef _WIN32
+    file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        throw std::runtime_error(std::format("Failed to open file - {}!", path.string()));
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    // NOTE: Empty files can't be mapped
+    if (size == 0) {
+        return;
+    }
+
+    mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+        data = static_cast<const std::byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    file = open(path.c_str(), O_RDONLY);
+    if (file == -1) {
+        throw std::runtime_error(std::format("Failed to open file - {}!", path.string()));
+    }
+
+    size = static_cast<size_t>(lseek(file, 0, SEEK_END));
+    if (size == 0) {
+        return;
+    }
+
+    void *view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (view != MAP_FAILED) {
+        data = static_cast<const std::byte *>(view);
+    }
+#endif
+
+    if (!data) {
+        Unmap();
+        throw std::runtime_error(std::format("Failed to map file - {}!", path.string()));
+    }
+}
+
+MappedFile::~MappedFile() { Unmap(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept :
+    data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)),
+#ifdef _WIN32
+    file(std::exchange(other.file, nullptr)), mapping(std::exchange(other.mapping, nullptr)) {
+#else
+    file(std::exchange(other.file, -1)) {
+#endif
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        Unmap();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+#ifdef _WIN32
+        file = std::exchange(other.file, nullptr);
+        mapping = std::exchange(other.mapping, nullptr);
+#else
+        file = std::exchange(other.file, -1);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::Unmap() {
+#ifdef _WIN32
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+    mapping = nullptr;
+    file = nullptr;
+#else
+    if (data) {
+        munmap(const_cast<std::byte *>(data), size);
+    }
+    if (file != -1) {
+        close(file);
+    }
+    file = -1;
+#endif
+    data = nullptr;
+    size = 0;
+}
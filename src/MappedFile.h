@@ -0,0 +1,31 @@
+#pragma once
+
+#include <span>
+
+// Read-only memory mapping of a whole file, pages are only read from disk once they are touched
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &other) = delete;
+    MappedFile &operator=(const MappedFile &other) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    [[nodiscard]] std::span<const std::byte> GetData() const { return {data, size}; }
+
+private:
+    void Unmap();
+
+    const std::byte *data{nullptr};
+    size_t size{0};
+
+#ifdef _WIN32
+    void *file{nullptr};
+    void *mapping{nullptr};
+#else
+    int file{-1};
+#endif
+};
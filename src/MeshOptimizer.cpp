@@ -0,0 +1,444 @@
+#include "pch.h"
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <numeric>
+#include <queue>
+
+namespace {
+    constexpr uint32_t noVertex = std::numeric_limits<uint32_t>::max();
+
+    // Simulates a FIFO cache of cacheSize entries, timestamps of vertices that left the cache are too old
+    class VertexCache {
+    public:
+        explicit VertexCache(uint32_t vertexCount) : timestamps(vertexCount, 0) {}
+
+        void Flush() { timestamp += MeshOptimizer::cacheSize + 1; }
+
+        [[nodiscard]] bool Contains(uint32_t vertex) const {
+            return timestamp - timestamps[vertex] <= MeshOptimizer::cacheSize;
+        }
+
+        // Returns whether the vertex had to be transformed
+        bool Access(uint32_t vertex) {
+            if (Contains(vertex)) {
+                return false;
+            }
+            timestamps[vertex] = timestamp++;
+            return true;
+        }
+
+        [[nodiscard]] uint32_t GetAge(uint32_t vertex) const { return timestamp - timestamps[vertex]; }
+
+    private:
+        std::vector<uint32_t> timestamps;
+        uint32_t timestamp{MeshOptimizer::cacheSize + 1}; // Every vertex starts out of the cache
+    };
+
+    // Sum of squared distances to planes, weighted by the area of the triangles the planes came from
+    struct Quadric {
+        double a00{0.0}, a01{0.0}, a02{0.0}, a11{0.0}, a12{0.0}, a22{0.0};
+        double b0{0.0}, b1{0.0}, b2{0.0};
+        double c{0.0};
+        double weight{0.0};
+
+        // The plane is dot(normal, p) + distance = 0 with a unit normal
+        static Quadric FromPlane(const glm::vec3 &normal, float distance, float weight) {
+            const double x = normal.x, y = normal.y, z = normal.z, d = distance;
+            return {.a00 = weight * x * x, .a01 = weight * x * y, .a02 = weight * x * z,
+                    .a11 = weight * y * y, .a12 = weight * y * z, .a22 = weight * z * z,
+                    .b0 = weight * x * d,  .b1 = weight * y * d,  .b2 = weight * z * d,
+                    .c = weight * d * d,   .weight = weight};
+        }
+
+        Quadric operator+(const Quadric &other) const {
+            return {.a00 = a00 + other.a00, .a01 = a01 + other.a01, .a02 = a02 + other.a02,
+                    .a11 = a11 + other.a11, .a12 = a12 + other.a12, .a22 = a22 + other.a22,
+                    .b0 = b0 + other.b0,    .b1 = b1 + other.b1,    .b2 = b2 + other.b2,
+                    .c = c + other.c,       .weight = weight + other.weight};
+        }
+
+        // Mean squared distance of the point to the planes
+        [[nodiscard]] float Evaluate(const glm::vec3 &point) const {
+            const double x = point.x, y = point.y, z = point.z;
+            const double error = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + a11 * y * y +
+                                 2.0 * a12 * y * z + a22 * z * z + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return weight > 0.0 ? static_cast<float>(std::abs(error) / weight) : 0.0f;
+        }
+    };
+
+    struct Collapse {
+        float cost{0.0f};
+        uint32_t from{0};
+        uint32_t to{0};
+        uint32_t fromVersion{0};
+        uint32_t toVersion{0};
+
+        bool operator>(const Collapse &other) const { return cost > other.cost; }
+    };
+} // namespace
+
+std::vector<uint32_t> MeshOptimizer::OptimizeVertexCache(std::span<uint32_t> indices, uint32_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return {};
+    }
+
+    // Triangles that use each vertex, adjacency[adjacencyOffsets[v]] to adjacency[adjacencyOffsets[v + 1]]
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        liveTriangles[indices[i]]++;
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    std::inclusive_scan(liveTriangles.begin(), liveTriangles.end(), adjacencyOffsets.begin() + 1);
+    std::vector<uint32_t> adjacency(adjacencyOffsets.back());
+    std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        adjacency[adjacencyFill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    VertexCache cache(vertexCount);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    std::vector<uint32_t> clusters{0};
+    uint32_t cursor = 0;
+
+    // Recently used vertices first, then the next one in index order
+    const auto skipDeadEnd = [&] {
+        while (!deadEnds.empty()) {
+            const uint32_t vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[vertex] > 0) {
+                return vertex;
+            }
+        }
+        for (; cursor < vertexCount; cursor++) {
+            if (liveTriangles[cursor] > 0) {
+                return cursor;
+            }
+        }
+        return noVertex;
+    };
+
+    uint32_t fanningVertex = skipDeadEnd();
+    while (fanningVertex != noVertex) {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; a++) {
+            const uint32_t triangle = adjacency[a];
+            if (emitted[triangle]) {
+                continue;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                const uint32_t vertex = indices[triangle * 3 + k];
+                output.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                cache.Access(vertex);
+            }
+            emitted[triangle] = true;
+        }
+
+        // Prefer the oldest candidate that is still cached after fanning around it, so it's used before it's evicted
+        uint32_t nextVertex = noVertex;
+        int64_t bestPriority = -1;
+        for (const uint32_t vertex: candidates) {
+            if (liveTriangles[vertex] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (cache.GetAge(vertex) + 2 * liveTriangles[vertex] <= cacheSize) {
+                priority = cache.GetAge(vertex);
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                nextVertex = vertex;
+            }
+        }
+
+        if (nextVertex == noVertex) {
+            nextVertex = skipDeadEnd();
+            if (nextVertex != noVertex) {
+                clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+            }
+        }
+        fanningVertex = nextVertex;
+    }
+
+    std::ranges::copy(output, indices.begin());
+    return clusters;
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::span<uint32_t> indices, std::span<const glm::vec3> positions,
+                                     std::span<const uint32_t> clusters, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0 || clusters.empty()) {
+        return;
+    }
+
+    VertexCache cache(static_cast<uint32_t>(positions.size()));
+    const auto transformTriangle = [&](size_t triangle) {
+        uint32_t misses = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            misses += cache.Access(indices[triangle * 3 + k]);
+        }
+        return misses;
+    };
+
+    // NOTE: Splitting is cheap for the cache as long as the part before the split already reached the cluster's
+    //       average cache misses, each part then starts with a cold cache
+    std::vector<uint32_t> splitClusters;
+    for (size_t c = 0; c < clusters.size(); c++) {
+        const size_t start = clusters[c];
+        const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        cache.Flush();
+        uint32_t clusterMisses = 0;
+        for (size_t triangle = start; triangle < end; triangle++) {
+            clusterMisses += transformTriangle(triangle);
+        }
+        const float clusterThreshold = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+        splitClusters.push_back(static_cast<uint32_t>(start));
+        cache.Flush();
+        uint32_t runningMisses = 0;
+        uint32_t runningTriangles = 0;
+        for (size_t triangle = start; triangle < end; triangle++) {
+            runningMisses += transformTriangle(triangle);
+            runningTriangles++;
+            if (triangle + 1 < end &&
+                static_cast<float>(runningMisses) <= clusterThreshold * static_cast<float>(runningTriangles)) {
+                splitClusters.push_back(static_cast<uint32_t>(triangle + 1));
+                cache.Flush();
+                runningMisses = 0;
+                runningTriangles = 0;
+            }
+        }
+    }
+
+    glm::vec3 meshCentroid(0.0f);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        meshCentroid += positions[indices[i]];
+    }
+    meshCentroid /= static_cast<float>(triangleCount * 3);
+
+    // Clusters far out along their own facing are likely in front of the rest of the mesh
+    std::vector<float> sortKeys(splitClusters.size());
+    for (size_t c = 0; c < splitClusters.size(); c++) {
+        const size_t start = splitClusters[c];
+        const size_t end = c + 1 < splitClusters.size() ? splitClusters[c + 1] : triangleCount;
+
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t triangle = start; triangle < end; triangle++) {
+            const glm::vec3 &p0 = positions[indices[triangle * 3 + 0]];
+            const glm::vec3 &p1 = positions[indices[triangle * 3 + 1]];
+            const glm::vec3 &p2 = positions[indices[triangle * 3 + 2]];
+            const glm::vec3 triangleNormal = glm::cross(p1 - p0, p2 - p0);
+            const float triangleArea = glm::length(triangleNormal);
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += triangleNormal;
+            area += triangleArea;
+        }
+        const float normalLength = glm::length(normal);
+        if (area == 0.0f || normalLength == 0.0f) {
+            sortKeys[c] = 0.0f;
+            continue;
+        }
+        sortKeys[c] = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+    }
+
+    std::vector<uint32_t> order(splitClusters.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    for (const uint32_t c: order) {
+        const size_t start = splitClusters[c];
+        const size_t end = c + 1 < splitClusters.size() ? splitClusters[c + 1] : triangleCount;
+        output.insert(output.end(), indices.begin() + start * 3, indices.begin() + end * 3);
+    }
+    std::ranges::copy(output, indices.begin());
+}
+
+std::vector<uint32_t> MeshOptimizer::OptimizeVertexFetch(std::span<uint32_t> indices, uint32_t vertexCount) {
+    std::vector<uint32_t> remap(vertexCount, noVertex);
+    uint32_t nextVertex = 0;
+    for (uint32_t &index: indices) {
+        if (remap[index] == noVertex) {
+            remap[index] = nextVertex++;
+        }
+        index = remap[index];
+    }
+    for (uint32_t &vertex: remap) {
+        if (vertex == noVertex) {
+            vertex = nextVertex++;
+        }
+    }
+    return remap;
+}
+
+std::vector<uint32_t> MeshOptimizer::Simplify(std::span<const uint32_t> indices, std::span<const glm::vec3> positions,
+                                              size_t targetIndexCount, float maxError, float &error) {
+    error = 0.0f;
+    std::vector<uint32_t> result(indices.begin(), indices.begin() + static_cast<ptrdiff_t>(indices.size() / 3 * 3));
+    const size_t triangleCount = result.size() / 3;
+    const size_t vertexCount = positions.size();
+    if (result.size() <= targetIndexCount) {
+        return result;
+    }
+
+    // NOTE: Edges of a single triangle are borders. Seams are borders too since their vertices are split, locking
+    //       them keeps the UVs and normals of both sides intact
+    std::unordered_map<uint64_t, uint32_t> edgeTriangles;
+    const auto edgeKey = [](uint32_t a, uint32_t b) {
+        return static_cast<uint64_t>(std::min(a, b)) << 32 | std::max(a, b);
+    };
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            edgeTriangles[edgeKey(result[triangle * 3 + k], result[triangle * 3 + (k + 1) % 3])]++;
+        }
+    }
+    std::vector<bool> locked(vertexCount, false);
+    for (const auto &[key, count]: edgeTriangles) {
+        if (count != 2) {
+            locked[key >> 32] = true;
+            locked[static_cast<uint32_t>(key)] = true;
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        const glm::vec3 &p0 = positions[result[triangle * 3 + 0]];
+        const glm::vec3 normal = glm::cross(positions[result[triangle * 3 + 1]] - p0,
+                                            positions[result[triangle * 3 + 2]] - p0);
+        const float length = glm::length(normal);
+        for (uint32_t k = 0; k < 3; k++) {
+            const uint32_t vertex = result[triangle * 3 + k];
+            if (length > 0.0f) {
+                const glm::vec3 unitNormal = normal / length;
+                quadrics[vertex] = quadrics[vertex] + Quadric::FromPlane(unitNormal, -glm::dot(unitNormal, p0),
+                                                                         length * 0.5f);
+            }
+            vertexTriangles[vertex].push_back(static_cast<uint32_t>(triangle));
+        }
+    }
+
+    std::vector<bool> removed(triangleCount, false);
+    std::vector<bool> collapsed(vertexCount, false);
+    // Bumped whenever a vertex's quadric changes, queued collapses with an older version are stale
+    std::vector<uint32_t> versions(vertexCount, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> queue;
+
+    const auto pushCollapse = [&](uint32_t from, uint32_t to) {
+        if (locked[from]) {
+            return;
+        }
+        queue.push({.cost = (quadrics[from] + quadrics[to]).Evaluate(positions[to]),
+                    .from = from,
+                    .to = to,
+                    .fromVersion = versions[from],
+                    .toVersion = versions[to]});
+    };
+    // Both directions of every edge of the vertex
+    const auto pushEdges = [&](uint32_t vertex) {
+        for (const uint32_t triangle: vertexTriangles[vertex]) {
+            if (removed[triangle]) {
+                continue;
+            }
+            for (uint32_t k = 0; k < 3; k++) {
+                const uint32_t other = result[triangle * 3 + k];
+                if (other != vertex) {
+                    pushCollapse(vertex, other);
+                    pushCollapse(other, vertex);
+                }
+            }
+        }
+    };
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+        for (const uint32_t triangle: vertexTriangles[vertex]) {
+            for (uint32_t k = 0; k < 3; k++) {
+                if (result[triangle * 3 + k] != vertex) {
+                    pushCollapse(vertex, result[triangle * 3 + k]);
+                }
+            }
+        }
+    }
+
+    size_t remainingTriangles = triangleCount;
+    while (!queue.empty() && remainingTriangles * 3 > targetIndexCount) {
+        const Collapse collapse = queue.top();
+        queue.pop();
+        if (collapsed[collapse.from] || collapsed[collapse.to] || versions[collapse.from] != collapse.fromVersion ||
+            versions[collapse.to] != collapse.toVersion) {
+            continue;
+        }
+        // The queue is sorted, so every other collapse is at least as bad
+        if (std::sqrt(collapse.cost) > maxError) {
+            break;
+        }
+
+        // The edge has to still exist, and moving the vertex must not flip any of the triangles that remain
+        bool hasEdge = false;
+        bool flips = false;
+        for (const uint32_t triangle: vertexTriangles[collapse.from]) {
+            if (removed[triangle]) {
+                continue;
+            }
+            const std::span<const uint32_t> corners(&result[triangle * 3], 3);
+            if (std::ranges::find(corners, collapse.to) != corners.end()) {
+                hasEdge = true;
+                continue;
+            }
+            std::array<glm::vec3, 3> moved{positions[corners[0]], positions[corners[1]], positions[corners[2]]};
+            const glm::vec3 before = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            for (uint32_t k = 0; k < 3; k++) {
+                if (corners[k] == collapse.from) {
+                    moved[k] = positions[collapse.to];
+                }
+            }
+            const glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            flips |= glm::dot(before, after) <= 0.0f && glm::length(before) > 0.0f;
+        }
+        if (!hasEdge || flips) {
+            continue;
+        }
+
+        for (const uint32_t triangle: vertexTriangles[collapse.from]) {
+            if (removed[triangle]) {
+                continue;
+            }
+            const std::span<uint32_t> corners(&result[triangle * 3], 3);
+            if (std::ranges::find(corners, collapse.to) != corners.end()) {
+                removed[triangle] = true;
+                remainingTriangles--;
+                continue;
+            }
+            std::ranges::replace(corners, collapse.from, collapse.to);
+            vertexTriangles[collapse.to].push_back(triangle);
+        }
+        quadrics[collapse.to] = quadrics[collapse.to] + quadrics[collapse.from];
+        collapsed[collapse.from] = true;
+        versions[collapse.to]++;
+        error = std::max(error, std::sqrt(collapse.cost));
+        pushEdges(collapse.to);
+    }
+
+    std::vector<uint32_t> simplified;
+    simplified.reserve(remainingTriangles * 3);
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        if (!removed[triangle]) {
+            simplified.insert(simplified.end(), result.begin() + static_cast<ptrdiff_t>(triangle * 3),
+                              result.begin() + static_cast<ptrdiff_t>(triangle * 3 + 3));
+        }
+    }
+    return simplified;
+}
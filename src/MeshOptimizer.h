@@ -0,0 +1,39 @@
+#pragma once
+
+#include <span>
+
+// Load time reordering of indexed triangle lists. Indices are relative to the first vertex of the mesh
+class MeshOptimizer {
+public:
+    // Post-transform vertex cache size the triangle order is tuned for
+    static constexpr uint32_t cacheSize = 16;
+
+    // Reorders the triangles for post-transform vertex cache locality (Tipsify, Sander et al. 2007).
+    // Returns the first triangle of every cluster, a cluster starts where the fanning hit a dead end
+    [[nodiscard]] static std::vector<uint32_t> OptimizeVertexCache(std::span<uint32_t> indices, uint32_t vertexCount);
+
+    // Splits the clusters further as long as their cache misses stay within threshold times the cluster's own, then
+    // sorts them so outward facing clusters are drawn first, which occludes the inner ones
+    static void OptimizeOverdraw(std::span<uint32_t> indices, std::span<const glm::vec3> positions,
+                                 std::span<const uint32_t> clusters, float threshold);
+
+    // Renumbers the vertices in order of first use, unused vertices go last.
+    // Returns the new index of every vertex, to be applied to the vertex data with RemapVertices
+    [[nodiscard]] static std::vector<uint32_t> OptimizeVertexFetch(std::span<uint32_t> indices, uint32_t vertexCount);
+
+    // Collapses edges in order of their quadric error (Garland and Heckbert 1997) until at most targetIndexCount
+    // indices are left or the next collapse would move the surface further than maxError. Vertices are only collapsed
+    // onto their neighbors, so the result still indexes the same vertex data. Border and seam vertices stay in place.
+    // Returns the simplified indices, error receives the largest error of the collapses, in position units
+    [[nodiscard]] static std::vector<uint32_t> Simplify(std::span<const uint32_t> indices,
+                                                        std::span<const glm::vec3> positions, size_t targetIndexCount,
+                                                        float maxError, float &error);
+
+    template<typename T>
+    static void RemapVertices(std::span<T> vertices, std::span<const uint32_t> remap) {
+        const std::vector<T> original(vertices.begin(), vertices.end());
+        for (size_t i = 0; i < original.size(); i++) {
+            vertices[remap[i]] = original[i];
+        }
+    }
+};
@@ -1,15 +1,358 @@
 #include "Scene.h"
 #include "pch.h"
 
+#include <algorithm>
+#include <future>
 #include <ranges>
 #include <utility>
 
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_aligned.hpp>
+
+#if defined(_M_X64) || defined(__SSSE3__)
+#include <immintrin.h>
+#define SCENE_SSSE3
+#endif
+
 #include "GPUDataUploader.h"
+#include "JobSystem.h"
+#include "MeshOptimizer.h"
+#include "SceneCache.h"
+#include "Vulkan/DebugMarkers.h"
 #include "Vulkan/Buffer.h"
+#include "Vulkan/Utils.h"
+
+
+namespace {
+    // Keeps the encoded bytes instead of letting tinygltf decode every image serially while parsing
+    bool DeferImageDecode(tinygltf::Image *image, const int imageIndex, std::string *error, std::string *warning,
+                          int requestedWidth, int requestedHeight, const unsigned char *bytes, int size,
+                          void *userData) {
+        auto &encodedImages = *static_cast<std::vector<std::vector<unsigned char>> *>(userData);
+        if (encodedImages.size() <= static_cast<size_t>(imageIndex)) {
+            encodedImages.resize(imageIndex + 1);
+        }
+        encodedImages[imageIndex].assign(bytes, bytes + size);
+        return true;
+    }
+
+    // Most devices don't support RGB formats in Vulkan, so RGB images get an opaque alpha channel
+    void ExpandRGBToRGBA(const unsigned char *rgb, unsigned char *rgba, size_t pixelCount) {
+        size_t i = 0;
+#ifdef SCENE_SSSE3
+        // 4 pixels per iteration. The 16 byte load reads 4 bytes past the 4th pixel, so stop 2 pixels early
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+        for (; i + 6 <= pixelCount; i += 4) {
+            const __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb + i * 3));
+            const __m128i expanded = _mm_or_si128(_mm_shuffle_epi8(source, shuffle), alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(rgba + i * 4), expanded);
+        }
+#endif
+        for (; i < pixelCount; ++i) {
+            rgba[i * 4 + 0] = rgb[i * 3 + 0];
+            rgba[i * 4 + 1] = rgb[i * 3 + 1];
+            rgba[i * 4 + 2] = rgb[i * 3 + 2];
+            rgba[i * 4 + 3] = 255;
+        }
+    }
+
+    struct DecodedImage {
+        uint32_t width{0};
+        uint32_t height{0};
+        std::vector<unsigned char> pixels; // RGBA8
+    };
+
+    DecodedImage DecodeImage(std::span<const unsigned char> encoded, const std::string &name) {
+        const auto size = static_cast<int>(encoded.size());
+        int width, height, channels;
+        if (!stbi_info_from_memory(encoded.data(), size, &width, &height, &channels)) {
+            throw std::runtime_error(std::format("Failed to load texture {} - {}!", name, stbi_failure_reason()));
+        }
 
+        DecodedImage decoded{.width = static_cast<uint32_t>(width), .height = static_cast<uint32_t>(height)};
+        decoded.pixels.resize(static_cast<size_t>(width) * height * 4);
+
+        // NOTE: RGB is expanded here, everything else is converted by stb_image
+        const int requestedChannels = channels == 3 ? 3 : 4;
+        stbi_uc *pixels = stbi_load_from_memory(encoded.data(), size, &width, &height, &channels, requestedChannels);
+        if (!pixels) {
+            throw std::runtime_error(std::format("Failed to load texture {} - {}!", name, stbi_failure_reason()));
+        }
+        if (requestedChannels == 3) {
+            ExpandRGBToRGBA(pixels, decoded.pixels.data(), static_cast<size_t>(width) * height);
+        } else {
+            std::memcpy(decoded.pixels.data(), pixels, decoded.pixels.size());
+        }
+        stbi_image_free(pixels);
+
+        return decoded;
+    }
+
+    constexpr uint32_t whiteVertexColor = 0xFFFFFFFF;
+
+    // Maps the unit sphere onto an octahedron unfolded into [-1, 1]^2
+    glm::vec2 EncodeOctahedral(glm::vec3 normal) {
+        const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        if (length == 0.0f) {
+            return glm::vec2(0.0f);
+        }
+        normal /= length;
+        const glm::vec2 encoded(normal.x, normal.y);
+        if (normal.z >= 0.0f) {
+            return encoded;
+        }
+        const glm::vec2 signs(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+        return (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * signs;
+    }
+
+    constexpr uint32_t maxMeshletVertices = 64;
+    constexpr uint32_t maxMeshletTriangles = 124;
+
+    // Bounding sphere and normal cone of the triangles in [firstIndex, firstIndex + indexCount)
+    Scene::Meshlet CreateMeshlet(std::span<const uint32_t> indices, uint32_t firstIndex, uint32_t indexCount,
+                                 const auto &getPosition) {
+        Scene::Meshlet meshlet{.firstIndex = firstIndex, .indexCount = indexCount};
+        const std::span<const uint32_t> meshletIndices = indices.subspan(firstIndex, indexCount);
+
+        glm::vec3 min(std::numeric_limits<float>::max());
+        glm::vec3 max(std::numeric_limits<float>::lowest());
+        for (const uint32_t index: meshletIndices) {
+            min = glm::min(min, getPosition(index));
+            max = glm::max(max, getPosition(index));
+        }
+        const glm::vec3 center = (min + max) * 0.5f;
+        float radius = 0.0f;
+        for (const uint32_t index: meshletIndices) {
+            radius = std::max(radius, glm::distance(center, getPosition(index)));
+        }
+        meshlet.boundingSphere = glm::vec4(center, radius);
+
+        std::array<glm::vec3, maxMeshletTriangles> normals;
+        uint32_t normalCount = 0;
+        glm::vec3 normalSum(0.0f);
+        for (size_t i = 0; i + 2 < meshletIndices.size(); i += 3) {
+            const glm::vec3 a = getPosition(meshletIndices[i]);
+            const glm::vec3 normal =
+                    glm::cross(getPosition(meshletIndices[i + 1]) - a, getPosition(meshletIndices[i + 2]) - a);
+            const float length = glm::length(normal);
+            // NOTE: Degenerate triangles have no facing
+            if (length > 0.0f) {
+                normals[normalCount] = normal / length;
+                normalSum += normals[normalCount++];
+            }
+        }
+        if (normalCount == 0 || glm::length(normalSum) == 0.0f) {
+            return meshlet;
+        }
+
+        const glm::vec3 axis = glm::normalize(normalSum);
+        float minDot = 1.0f;
+        for (uint32_t i = 0; i < normalCount; i++) {
+            minDot = std::min(minDot, glm::dot(axis, normals[i]));
+        }
+        // The cone only culls when every triangle faces less than 90 degrees away from the axis
+        if (minDot > 0.0f) {
+            meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+        }
+        return meshlet;
+    }
+
+    // Greedily groups consecutive triangles, so the triangle order and with it the index buffer stay untouched
+    void BuildMeshlets(std::span<const uint32_t> indices, uint32_t firstIndex, uint32_t indexCount,
+                       const auto &getPosition, std::vector<Scene::Meshlet> &meshlets) {
+        std::array<uint32_t, maxMeshletVertices> meshletVertices;
+        uint32_t vertexCount = 0;
+        uint32_t meshletFirstIndex = firstIndex;
+
+        const uint32_t endIndex = firstIndex + indexCount / 3 * 3;
+        for (uint32_t i = firstIndex; i < endIndex; i += 3) {
+            const auto end = meshletVertices.begin() + vertexCount;
+            const uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            const uint32_t newVertices = (std::find(meshletVertices.begin(), end, a) == end) +
+                                         (b != a && std::find(meshletVertices.begin(), end, b) == end) +
+                                         (c != a && c != b && std::find(meshletVertices.begin(), end, c) == end);
+
+            if (vertexCount + newVertices > maxMeshletVertices || i - meshletFirstIndex == maxMeshletTriangles * 3) {
+                meshlets.push_back(CreateMeshlet(indices, meshletFirstIndex, i - meshletFirstIndex, getPosition));
+                meshletFirstIndex = i;
+                vertexCount = 0;
+            }
+
+            for (const uint32_t index: {a, b, c}) {
+                if (std::find(meshletVertices.begin(), meshletVertices.begin() + vertexCount, index) ==
+                    meshletVertices.begin() + vertexCount) {
+                    meshletVertices[vertexCount++] = index;
+                }
+            }
+        }
+        if (endIndex > meshletFirstIndex) {
+            meshlets.push_back(CreateMeshlet(indices, meshletFirstIndex, endIndex - meshletFirstIndex, getPosition));
+        }
+    }
+
+    // Relative cache misses a cluster split for overdraw may cost
+    constexpr float overdrawThreshold = 1.05f;
+
+    // Reorders the triangles of a primitive for the vertex cache and overdraw, then its vertices for fetch locality.
+    // The indices are relative to vertexStart, the vertices of the primitive are the last ones in the streams
+    void OptimizePrimitive(std::span<uint32_t> indices, uint32_t vertexStart, std::vector<glm::vec3> &positions,
+                           std::vector<Scene::VertexPosition> &positionStream, std::vector<Scene::Vertex> &vertexStream,
+                           std::vector<uint32_t> &colorStream) {
+        const auto vertexCount = static_cast<uint32_t>(positions.size());
+        const bool inRange = std::ranges::all_of(indices, [&](uint32_t index) { return index < vertexCount; });
+        if (vertexCount == 0 || !inRange) {
+            return;
+        }
+
+        const std::vector<uint32_t> clusters = MeshOptimizer::OptimizeVertexCache(indices, vertexCount);
+        MeshOptimizer::OptimizeOverdraw(indices, positions, clusters, overdrawThreshold);
+        const std::vector<uint32_t> remap = MeshOptimizer::OptimizeVertexFetch(indices, vertexCount);
+
+        MeshOptimizer::RemapVertices(std::span(positions), remap);
+        MeshOptimizer::RemapVertices(std::span(positionStream).subspan(vertexStart), remap);
+        MeshOptimizer::RemapVertices(std::span(vertexStream).subspan(vertexStart), remap);
+        if (!colorStream.empty()) {
+            MeshOptimizer::RemapVertices(std::span(colorStream).subspan(vertexStart), remap);
+        }
+    }
+
+    // Level 0 is the full mesh, every further level targets half the triangles of the previous one
+    constexpr uint32_t maxMeshLods = 5;
+    // Per level error bound, relative to the diagonal of the mesh's bounding box
+    constexpr std::array<float, maxMeshLods - 1> lodErrorBounds{0.002f, 0.005f, 0.01f, 0.02f};
+    // A level that keeps more of the previous level's indices isn't worth storing, and the chain ends there
+    constexpr float minLodReduction = 0.8f;
+
+    // Appends the simplified levels of the primitive's indices to the index buffer, level 0 refers to the
+    // primitive's own indices. The indices are relative to the primitive's first vertex
+    void GenerateLods(std::vector<uint32_t> &indexBuffer, uint32_t firstIndex, uint32_t indexCount,
+                      std::span<const glm::vec3> positions, float meshSize, std::vector<Scene::MeshLod> &meshLods) {
+        meshLods.push_back({.firstIndex = firstIndex, .indexCount = indexCount, .error = 0.0f});
+
+        std::vector<uint32_t> previous(indexBuffer.begin() + firstIndex, indexBuffer.begin() + firstIndex + indexCount);
+
+        float error = 0.0f;
+        for (const float errorBound: lodErrorBounds) {
+            float levelError = 0.0f;
+            std::vector<uint32_t> simplified = MeshOptimizer::Simplify(previous, positions, previous.size() / 2,
+                                                                       errorBound * meshSize, levelError);
+            if (simplified.empty() || simplified.size() > previous.size() * minLodReduction) {
+                break;
+            }
+            // NOTE: The clusters are only needed for the overdraw optimization, which the levels skip
+            (void) MeshOptimizer::OptimizeVertexCache(simplified, static_cast<uint32_t>(positions.size()));
+
+            // NOTE: The errors of consecutive levels add up, each one is measured against the previous level
+            error += levelError;
+            meshLods.push_back({.firstIndex = static_cast<uint32_t>(indexBuffer.size()),
+                                .indexCount = static_cast<uint32_t>(simplified.size()),
+                                .error = error});
+            indexBuffer.insert(indexBuffer.end(), simplified.begin(), simplified.end());
+            previous = std::move(simplified);
+        }
+    }
+
+    // Appends the indices to the index pool and returns the first one's position in it
+    template<typename T>
+    uint32_t AppendIndices(std::span<const uint32_t> indices, std::vector<T> &pool) {
+        const auto firstIndex = static_cast<uint32_t>(pool.size());
+        for (const uint32_t index: indices) {
+            pool.push_back(static_cast<T>(index));
+        }
+        return firstIndex;
+    }
+
+    // Anything but an embedded buffer or a data URI
+    bool IsExternalURI(const std::string &uri) { return !uri.empty() && !uri.starts_with("data:"); }
+
+    // Element of a float or normalized integer accessor, the components it doesn't have keep their fallback value
+    glm::vec4 ReadAccessorElement(const tinygltf::Model &input, const tinygltf::Accessor &accessor, size_t element,
+                                  glm::vec4 fallback) {
+        const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
+        const int stride = accessor.ByteStride(view);
+        if (stride <= 0) {
+            return fallback;
+        }
+        const unsigned char *data =
+                &input.buffers[view.buffer].data[view.byteOffset + accessor.byteOffset + element * stride];
+        const int componentCount = std::min(tinygltf::GetNumComponentsInType(accessor.type), 4);
+        for (int c = 0; c < componentCount; c++) {
+            switch (accessor.componentType) {
+                case TINYGLTF_COMPONENT_TYPE_FLOAT:
+                    std::memcpy(&fallback[c], data + c * sizeof(float), sizeof(float));
+                    break;
+                case TINYGLTF_COMPONENT_TYPE_BYTE:
+                    fallback[c] = std::max(static_cast<float>(reinterpret_cast<const int8_t *>(data)[c]) / 127.0f,
+                                           -1.0f);
+                    break;
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                    fallback[c] = static_cast<float>(data[c]) / 255.0f;
+                    break;
+                case TINYGLTF_COMPONENT_TYPE_SHORT: {
+                    int16_t value;
+                    std::memcpy(&value, data + c * sizeof(int16_t), sizeof(int16_t));
+                    fallback[c] = std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+                    break;
+                }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+                    uint16_t value;
+                    std::memcpy(&value, data + c * sizeof(uint16_t), sizeof(uint16_t));
+                    fallback[c] = static_cast<float>(value) / 65535.0f;
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+        return fallback;
+    }
+
+    // Local transforms of the instances of an EXT_mesh_gpu_instancing node, empty when the extension is malformed
+    std::vector<glm::mat4> ReadInstanceMatrices(const tinygltf::Model &input, const tinygltf::Value &extension) {
+        if (!extension.Has("attributes")) {
+            return {};
+        }
+        const tinygltf::Value &attributes = extension.Get("attributes");
+        std::array<const tinygltf::Accessor *, 3> accessors{}; // Translation, rotation, scale
+        const std::array<const char *, 3> names{"TRANSLATION", "ROTATION", "SCALE"};
+        size_t instanceCount = 0;
+        for (size_t i = 0; i < names.size(); i++) {
+            if (!attributes.Has(names[i])) {
+                continue;
+            }
+            const int accessorIndex = attributes.Get(names[i]).GetNumberAsInt();
+            if (accessorIndex < 0 || accessorIndex >= static_cast<int>(input.accessors.size()) ||
+                input.accessors[accessorIndex].bufferView < 0) {
+                return {};
+            }
+            accessors[i] = &input.accessors[accessorIndex];
+            // NOTE: The spec requires every attribute to have the same count
+            if (instanceCount != 0 && accessors[i]->count != instanceCount) {
+                return {};
+            }
+            instanceCount = accessors[i]->count;
+        }
+
+        std::vector<glm::mat4> instanceMatrices(instanceCount);
+        for (size_t i = 0; i < instanceCount; i++) {
+            const glm::vec4 translation =
+                    accessors[0] ? ReadAccessorElement(input, *accessors[0], i, glm::vec4(0.0f)) : glm::vec4(0.0f);
+            const glm::vec4 rotation = accessors[1] ? ReadAccessorElement(input, *accessors[1], i, glm::vec4(0.0f))
+                                                    : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            const glm::vec4 scale =
+                    accessors[2] ? ReadAccessorElement(input, *accessors[2], i, glm::vec4(1.0f)) : glm::vec4(1.0f);
+            instanceMatrices[i] = glm::translate(glm::mat4(1.0f), glm::vec3(translation)) *
+                                  glm::mat4(glm::normalize(glm::quat(rotation.w, rotation.x, rotation.y, rotation.z))) *
+                                  glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+        }
+        return instanceMatrices;
+    }
+
+} // namespace
 
 Scene::Scene(std::shared_ptr<VulkanDevice> device, const std::filesystem::path &scenePath,
-             std::shared_ptr<TextureCube> skyboxTexture, DebugDraw &debugDraw) :
+             std::shared_ptr<TextureCube> skyboxTexture, DebugDraw &debugDraw, JobSystem &jobSystem) :
     skyboxTexture(std::move(skyboxTexture)), device(std::move(device)) {
 
     cameras.resize(2);
@@ -20,10 +363,32 @@ Scene::Scene(std::shared_ptr<VulkanDevice> device, const std::filesystem::path &
     cameras[1] = Camera(glm::vec3(3.0f, 3.0f, 3.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f),
                         (double) 1280 / (double) 720);
 
+    resourcePath = scenePath.parent_path();
+
+    SceneCache cache(scenePath);
+    if (cache.Load()) {
+        LoadFromCache(cache, jobSystem);
+    } else {
+        LoadFromGLTF(scenePath, cache, jobSystem);
+    }
+    CreateCullingBounds();
+
+    CreateSkyboxVertexBuffer();
+    CreateLights();
+
+    GenerateDrawCommands(debugDraw);
+    CreateBuffers();
+}
+
+void Scene::LoadFromGLTF(const std::filesystem::path &scenePath, const SceneCache &cache, JobSystem &jobSystem) {
+    DebugMarkers::ScopedMarker marker("Scene::LoadFromGLTF");
     tinygltf::TinyGLTF gltfContext;
     tinygltf::Model glTFInput;
     std::string error, warning;
 
+    std::vector<std::vector<unsigned char>> encodedImages;
+    gltfContext.SetImageLoader(DeferImageDecode, &encodedImages);
+
     bool fileLoaded = false;
     if (scenePath.extension() == ".glb") {
         fileLoaded = gltfContext.LoadBinaryFromFile(&glTFInput, &error, &warning, scenePath.string());
@@ -36,30 +401,150 @@ Scene::Scene(std::shared_ptr<VulkanDevice> device, const std::filesystem::path &
                                  error);
     }
 
-    resourcePath = scenePath.parent_path();
-
     std::vector<uint32_t> indexBuffer;
+    std::vector<uint16_t> shortIndexBuffer;
+    std::vector<VertexPosition> positionStream;
     std::vector<Vertex> vertexBuffer;
+    std::vector<uint32_t> colorStream;
 
-    LoadImages(glTFInput);
     LoadTextureSamplers(glTFInput);
     LoadTextures(glTFInput);
     LoadMaterials(glTFInput);
     const tinygltf::Scene &scene = glTFInput.scenes[0];
+    std::unordered_map<int, NodeMeshes> loadedMeshes;
     for (int i: scene.nodes) {
         const tinygltf::Node node = glTFInput.nodes[i];
-        LoadNode(glTFInput, node, nullptr, vertexBuffer, indexBuffer);
+        LoadNode(glTFInput, node, SceneHierarchy::noParent, positionStream, vertexBuffer, colorStream, indexBuffer,
+                 shortIndexBuffer, loadedMeshes);
     }
 
-    CreateVertexBuffer(vertexBuffer);
-    CreateIndexBuffer(indexBuffer);
-    CreateLights();
+    encodedImages.resize(glTFInput.images.size());
+    std::vector<ImageSource> imageSources(glTFInput.images.size());
+    for (size_t i = 0; i < glTFInput.images.size(); i++) {
+        const tinygltf::Image &glTFImage = glTFInput.images[i];
+        imageSources[i] = {.name = glTFImage.uri.empty() ? glTFImage.name : glTFImage.uri,
+                           .generateMipMaps = !glTFImage.uri.empty(),
+                           .encoded = std::move(encodedImages[i])};
+    }
 
-    GenerateDrawCommands(debugDraw);
-    CreateBuffers();
+    // Bake everything that was just built, the encoded images are still around at this point
+    try {
+        SaveCache(cache, glTFInput, imageSources, positionStream, vertexBuffer, colorStream, indexBuffer,
+                  shortIndexBuffer);
+    } catch (const std::exception &e) {
+        // NOTE: Without the cache the next load just parses the glTF file again
+        std::cerr << "Failed to save scene cache - " << e.what() << std::endl;
+    }
+
+    LoadImages(imageSources, jobSystem);
+    ApplyTextureSamplers();
+
+    CreateVertexBuffers(positionStream, vertexBuffer);
+    CreateColorBuffer(colorStream);
+    CreateIndexBuffers(indexBuffer, shortIndexBuffer);
+}
+
+void Scene::SaveCache(const SceneCache &cache, const tinygltf::Model &input,
+                      const std::vector<ImageSource> &imageSources, std::span<const VertexPosition> positions,
+                      std::span<const Vertex> vertices, std::span<const uint32_t> colors,
+                      std::span<const uint32_t> indices, std::span<const uint16_t> shortIndices) const {
+    SceneCache::Contents contents{
+            .positions = positions,
+            .vertices = vertices,
+            .colors = colors,
+            .indices = indices,
+            .shortIndices = shortIndices,
+            .meshes = meshes,
+            .meshlets = meshlets,
+            .meshLods = meshLods,
+            .materials = materials,
+            .localModelMatrices = hierarchy.GetLocalTransforms(),
+            .samplers = textureSamplers,
+            .textures = textures,
+    };
+
+    std::vector<SceneCache::Node> cachedNodes;
+    cachedNodes.reserve(hierarchy.GetNodeCount());
+    for (uint32_t node = 0; node < hierarchy.GetNodeCount(); node++) {
+        cachedNodes.push_back({.parent = hierarchy.GetParent(node),
+                               .modelMatrixIndex = node,
+                               .firstMeshIndex = nodeMeshes[node].firstMesh,
+                               .meshCount = nodeMeshes[node].meshCount});
+    }
+    contents.nodes = cachedNodes;
+
+    std::vector<std::string> decodedURIs(input.images.size());
+    for (size_t i = 0; i < input.images.size(); i++) {
+        // NOTE: Images referenced by a file are read from it again, only embedded images are stored
+        std::span<const unsigned char> encoded = imageSources[i].encoded;
+        if (IsExternalURI(input.images[i].uri)) {
+            tinygltf::URIDecode(input.images[i].uri, &decodedURIs[i], nullptr);
+            contents.dependencies.push_back(decodedURIs[i]);
+            encoded = {};
+        }
+        contents.images.push_back({.name = imageSources[i].name,
+                                   .path = decodedURIs[i],
+                                   .encoded = encoded,
+                                   .generateMipMaps = imageSources[i].generateMipMaps});
+    }
+    for (const tinygltf::Buffer &buffer: input.buffers) {
+        if (IsExternalURI(buffer.uri)) {
+            std::string path;
+            tinygltf::URIDecode(buffer.uri, &path, nullptr);
+            contents.dependencies.push_back(path);
+        }
+    }
+
+    cache.Save(contents);
 }
 
-void Scene::CreateVertexBuffer(std::vector<Vertex> &vertices) {
+void Scene::LoadFromCache(const SceneCache &cache, JobSystem &jobSystem) {
+    DebugMarkers::ScopedMarker marker("Scene::LoadFromCache");
+    const SceneCache::Contents &contents = cache.GetContents();
+
+    textureSamplers.assign(contents.samplers.begin(), contents.samplers.end());
+    textures.assign(contents.textures.begin(), contents.textures.end());
+    materials.assign(contents.materials.begin(), contents.materials.end());
+    meshes.assign(contents.meshes.begin(), contents.meshes.end());
+    meshlets.assign(contents.meshlets.begin(), contents.meshlets.end());
+    meshLods.assign(contents.meshLods.begin(), contents.meshLods.end());
+    // Parents are stored before their children, so the hierarchy is rebuilt in the same order
+    for (const SceneCache::Node &cachedNode: contents.nodes) {
+        hierarchy.AddNode(cachedNode.parent, contents.localModelMatrices[cachedNode.modelMatrixIndex]);
+        nodeMeshes.push_back({.firstMesh = cachedNode.firstMeshIndex, .meshCount = cachedNode.meshCount});
+    }
+
+    std::vector<ImageSource> imageSources(contents.images.size());
+    for (size_t i = 0; i < contents.images.size(); i++) {
+        const SceneCache::Image &image = contents.images[i];
+        imageSources[i] = {.name = std::string(image.name),
+                           .generateMipMaps = image.generateMipMaps,
+                           .encoded = {image.encoded.begin(), image.encoded.end()},
+                           .path = image.path.empty() ? std::filesystem::path() : resourcePath / image.path};
+    }
+    LoadImages(imageSources, jobSystem);
+    ApplyTextureSamplers();
+
+    // NOTE: Copied straight from the mapped file into staging memory
+    CreateVertexBuffers(contents.positions, contents.vertices);
+    CreateColorBuffer(contents.colors);
+    CreateIndexBuffers(contents.indices, contents.shortIndices);
+}
+
+void Scene::CreateVertexBuffers(std::span<const VertexPosition> positions, std::span<const Vertex> vertices) {
+    const VkDeviceSize positionsSize = positions.size_bytes();
+
+    const auto positionsStagingBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Positions Buffer Staging Buffer",
+                                        .size = positionsSize,
+                                        .type = BufferType::STAGING});
+    positionsStagingBuffer->From(positions.data(), positionsSize);
+
+    positionsBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Positions Buffer", .size = positionsSize, .type = BufferType::VERTEX});
+    positionsBuffer->FromBuffer(positionsStagingBuffer.get());
+    positionsStagingBuffer->Destroy();
+
     const VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
     const auto stagingBuffer = std::make_unique<Buffer>(
@@ -71,55 +556,75 @@ void Scene::CreateVertexBuffer(std::vector<Vertex> &vertices) {
             device, BufferSpecification{.name = "Vertex Buffer", .size = bufferSize, .type = BufferType::VERTEX});
     vertexBuffer->FromBuffer(stagingBuffer.get());
     stagingBuffer->Destroy();
+}
+
+void Scene::CreateColorBuffer(std::span<const uint32_t> colors) {
+    hasVertexColors = !colors.empty();
+    if (!hasVertexColors) {
+        colors = std::span(&whiteVertexColor, 1);
+    }
+    const VkDeviceSize bufferSize = colors.size_bytes();
+
+    const auto stagingBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{
+                            .name = "Color Buffer Staging Buffer", .size = bufferSize, .type = BufferType::STAGING});
+    stagingBuffer->From(colors.data(), bufferSize);
+
+    colorBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Color Buffer", .size = bufferSize, .type = BufferType::VERTEX});
+    colorBuffer->FromBuffer(stagingBuffer.get());
+    stagingBuffer->Destroy();
+}
 
-    std::vector<Vertex> skyboxVertices = {
+void Scene::CreateSkyboxVertexBuffer() {
+    std::vector<glm::packed_vec3> skyboxVertices = {
             // Front face
-            {{-1.0f, -1.0f, 1.0f}},
-            {{1.0f, -1.0f, 1.0f}},
-            {{1.0f, 1.0f, 1.0f}},
-            {{1.0f, 1.0f, 1.0f}},
-            {{-1.0f, 1.0f, 1.0f}},
-            {{-1.0f, -1.0f, 1.0f}},
+            {-1.0f, -1.0f, 1.0f},
+            {1.0f, -1.0f, 1.0f},
+            {1.0f, 1.0f, 1.0f},
+            {1.0f, 1.0f, 1.0f},
+            {-1.0f, 1.0f, 1.0f},
+            {-1.0f, -1.0f, 1.0f},
 
             // Back face
-            {{-1.0f, -1.0f, -1.0f}},
-            {{1.0f, 1.0f, -1.0f}},
-            {{1.0f, -1.0f, -1.0f}},
-            {{1.0f, 1.0f, -1.0f}},
-            {{-1.0f, -1.0f, -1.0f}},
-            {{-1.0f, 1.0f, -1.0f}},
+            {-1.0f, -1.0f, -1.0f},
+            {1.0f, 1.0f, -1.0f},
+            {1.0f, -1.0f, -1.0f},
+            {1.0f, 1.0f, -1.0f},
+            {-1.0f, -1.0f, -1.0f},
+            {-1.0f, 1.0f, -1.0f},
 
             // Left face
-            {{-1.0f, -1.0f, -1.0f}},
-            {{-1.0f, -1.0f, 1.0f}},
-            {{-1.0f, 1.0f, 1.0f}},
-            {{-1.0f, 1.0f, 1.0f}},
-            {{-1.0f, 1.0f, -1.0f}},
-            {{-1.0f, -1.0f, -1.0f}},
+            {-1.0f, -1.0f, -1.0f},
+            {-1.0f, -1.0f, 1.0f},
+            {-1.0f, 1.0f, 1.0f},
+            {-1.0f, 1.0f, 1.0f},
+            {-1.0f, 1.0f, -1.0f},
+            {-1.0f, -1.0f, -1.0f},
 
             // Right face
-            {{1.0f, -1.0f, 1.0f}},
-            {{1.0f, -1.0f, -1.0f}},
-            {{1.0f, 1.0f, -1.0f}},
-            {{1.0f, 1.0f, -1.0f}},
-            {{1.0f, 1.0f, 1.0f}},
-            {{1.0f, -1.0f, 1.0f}},
+            {1.0f, -1.0f, 1.0f},
+            {1.0f, -1.0f, -1.0f},
+            {1.0f, 1.0f, -1.0f},
+            {1.0f, 1.0f, -1.0f},
+            {1.0f, 1.0f, 1.0f},
+            {1.0f, -1.0f, 1.0f},
 
             // Top face
-            {{-1.0f, 1.0f, 1.0f}},
-            {{1.0f, 1.0f, 1.0f}},
-            {{1.0f, 1.0f, -1.0f}},
-            {{1.0f, 1.0f, -1.0f}},
-            {{-1.0f, 1.0f, -1.0f}},
-            {{-1.0f, 1.0f, 1.0f}},
+            {-1.0f, 1.0f, 1.0f},
+            {1.0f, 1.0f, 1.0f},
+            {1.0f, 1.0f, -1.0f},
+            {1.0f, 1.0f, -1.0f},
+            {-1.0f, 1.0f, -1.0f},
+            {-1.0f, 1.0f, 1.0f},
 
             // Bottom face
-            {{-1.0f, -1.0f, -1.0f}},
-            {{1.0f, -1.0f, -1.0f}},
-            {{1.0f, -1.0f, 1.0f}},
-            {{1.0f, -1.0f, 1.0f}},
-            {{-1.0f, -1.0f, 1.0f}},
-            {{-1.0f, -1.0f, -1.0f}},
+            {-1.0f, -1.0f, -1.0f},
+            {1.0f, -1.0f, -1.0f},
+            {1.0f, -1.0f, 1.0f},
+            {1.0f, -1.0f, 1.0f},
+            {-1.0f, -1.0f, 1.0f},
+            {-1.0f, -1.0f, -1.0f},
     };
 
     const VkDeviceSize skyboxBufferSize = sizeof(skyboxVertices[0]) * skyboxVertices.size();
@@ -136,75 +641,65 @@ void Scene::CreateVertexBuffer(std::vector<Vertex> &vertices) {
     skyboxStagingBuffer->Destroy();
 }
 
-void Scene::CreateIndexBuffer(std::vector<uint32_t> &indices) {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-
-    const auto stagingBuffer = std::make_unique<Buffer>(
-            device, BufferSpecification{
-                            .name = "Index Buffer Staging Buffer", .size = bufferSize, .type = BufferType::STAGING});
-    stagingBuffer->From(indices.data(), bufferSize);
-
-    indexBuffer = std::make_unique<Buffer>(
-            device, BufferSpecification{.name = "Index Buffer", .size = bufferSize, .type = BufferType::INDEX});
-    indexBuffer->FromBuffer(stagingBuffer.get());
-    stagingBuffer->Destroy();
+void Scene::CreateIndexBuffers(std::span<const uint32_t> indices, std::span<const uint16_t> shortIndices) {
+    indexBuffer = CreateStaticBuffer("Index Buffer", indices, BufferType::INDEX);
+    shortIndexBuffer = CreateStaticBuffer("Short Index Buffer", shortIndices, BufferType::INDEX);
 }
 
-void Scene::LoadImages(tinygltf::Model &input) {
-    images.resize(input.images.size() + 1);
-    for (size_t i = 0; i < input.images.size(); i++) {
-        tinygltf::Image &glTFImage = input.images[i];
-
-        // Load from disk
-        if (!glTFImage.uri.empty()) {
-            TextureSpecification spec{.name = glTFImage.uri,
-                                      .width = static_cast<uint32_t>(glTFImage.width),
-                                      .height = static_cast<uint32_t>(glTFImage.height),
-                                      .generateMipMaps = true};
-            images[i] = std::make_shared<Texture2D>(device, spec, resourcePath / glTFImage.uri);
-        } else { // https://github.com/SaschaWillems/Vulkan/blob/master/examples/gltfloading/gltfloading.cpp
-            unsigned char *buffer;
-            VkDeviceSize bufferSize;
-            bool deleteBuffer = false;
-            // We convert RGB-only images to RGBA, as most devices don't support RGB-formats in Vulkan
-            if (glTFImage.component == 3) {
-                bufferSize = glTFImage.width * glTFImage.height * 4;
-                buffer = new unsigned char[bufferSize];
-                unsigned char *rgba = buffer;
-                unsigned char *rgb = &glTFImage.image[0];
-                for (size_t j = 0; j < glTFImage.width * glTFImage.height; ++j) {
-                    memcpy(rgba, rgb, sizeof(unsigned char) * 3);
-                    rgba += 4;
-                    rgb += 3;
-                }
-                deleteBuffer = true;
-            } else {
-                buffer = &glTFImage.image[0];
-                bufferSize = glTFImage.image.size();
+void Scene::LoadImages(std::vector<ImageSource> &imageSources, JobSystem &jobSystem) {
+    DebugMarkers::ScopedMarker marker("Scene::LoadImages");
+
+    std::vector<std::future<DecodedImage>> decodedImages;
+    decodedImages.reserve(imageSources.size());
+    for (ImageSource &source: imageSources) {
+        // NOTE: The task owns the encoded bytes, so nothing dangles if another image fails to decode
+        decodedImages.push_back(jobSystem.Submit([encoded = std::move(source.encoded), path = source.path,
+                                                   name = source.name] {
+            DebugMarkers::ScopedMarker decodeMarker("Scene::DecodeImage");
+            if (encoded.empty()) {
+                const std::vector<char> file = ReadFile(path);
+                return DecodeImage({reinterpret_cast<const unsigned char *>(file.data()), file.size()}, name);
             }
-            TextureSpecification spec{.name = "Image loaded from buffer",
-                                      .width = (uint32_t) glTFImage.width,
-                                      .height = (uint32_t) glTFImage.height};
-            images[i] = std::make_shared<Texture2D>(device, spec, buffer);
-            if (deleteBuffer) {
-                delete[] buffer;
-            }
-        }
+            return DecodeImage(encoded, name);
+        }));
+    }
+
+    // Images are uploaded in order as soon as they are decoded, while the workers keep decoding the rest
+    UploadContext uploadContext(device);
+    images.resize(imageSources.size() + 1);
+    for (size_t i = 0; i < imageSources.size(); i++) {
+        const DecodedImage decoded = decodedImages[i].get();
+
+        // NOTE: Only images loaded from disk had mip maps before, which is kept for now
+        TextureSpecification spec{.name = imageSources[i].generateMipMaps ? imageSources[i].name
+                                                                          : "Image loaded from buffer",
+                                  .width = decoded.width,
+                                  .height = decoded.height,
+                                  .generateMipMaps = imageSources[i].generateMipMaps};
+        images[i] = std::make_shared<Texture2D>(device, spec, decoded.pixels.data(), uploadContext);
     }
 
     // Default image/texture
     std::array<unsigned char, 1 * 1 * 4> pixels = {128, 128, 128, 255};
     TextureSpecification spec{.name = "Default Texture", .width = 1, .height = 1};
-    images[images.size() - 1] = std::make_shared<Texture2D>(device, spec, pixels.data());
+    images[images.size() - 1] = std::make_shared<Texture2D>(device, spec, pixels.data(), uploadContext);
+
+    uploadContext.Wait();
+    uploadContext.Destroy();
 }
 
 void Scene::LoadTextures(tinygltf::Model &input) {
     textures.resize(input.textures.size());
     for (size_t i = 0; i < input.textures.size(); i++) {
         textures[i].imageIndex = input.textures[i].source;
-        if (input.textures[i].sampler != -1) {
-            TextureSampler sampler = textureSamplers[input.textures[i].sampler];
-            images[textures[i].imageIndex]->SetSampler(sampler);
+        textures[i].samplerIndex = input.textures[i].sampler;
+    }
+}
+
+void Scene::ApplyTextureSamplers() {
+    for (const Texture &texture: textures) {
+        if (texture.samplerIndex != -1) {
+            images[texture.imageIndex]->SetSampler(textureSamplers[texture.samplerIndex]);
         }
     }
 
@@ -318,10 +813,11 @@ void Scene::LoadMaterials(tinygltf::Model &input) {
     }
 }
 
-void Scene::LoadNode(const tinygltf::Model &input, const tinygltf::Node &inputNode, Scene::Node *parent,
-                     std::vector<Vertex> &vertexBuffer, std::vector<uint32_t> &indexBuffer) {
-    auto node = new Node{};
-    node->parent = parent;
+void Scene::LoadNode(const tinygltf::Model &input, const tinygltf::Node &inputNode, int32_t parent,
+                     std::vector<VertexPosition> &positionStream, std::vector<Vertex> &vertexBuffer,
+                     std::vector<uint32_t> &colorStream, std::vector<uint32_t> &indexBuffer,
+                     std::vector<uint16_t> &shortIndexBuffer, std::unordered_map<int, NodeMeshes> &loadedMeshes) {
+    DebugMarkers::ScopedMarker marker("Scene::LoadNode");
 
     // Get the local node matrix
     // It's either made up from translation, rotation, scale or a 4x4 matrix
@@ -340,166 +836,284 @@ void Scene::LoadNode(const tinygltf::Model &input, const tinygltf::Node &inputNo
         modelMatrix = glm::make_mat4x4(inputNode.matrix.data());
     }
 
-    localModelMatrices.push_back(modelMatrix);
-    node->modelMatrixIndex = localModelMatrices.size() - 1;
+    // NOTE: The node is added before its children, which keeps the hierarchy in topological order
+    const uint32_t node = hierarchy.AddNode(parent, modelMatrix);
+    nodeMeshes.emplace_back();
 
     if (!inputNode.children.empty()) {
         for (int i: inputNode.children) {
-            LoadNode(input, input.nodes[i], node, vertexBuffer, indexBuffer);
+            LoadNode(input, input.nodes[i], static_cast<int32_t>(node), positionStream, vertexBuffer, colorStream,
+                     indexBuffer, shortIndexBuffer, loadedMeshes);
         }
     }
 
     // If the node contains mesh data, we load vertices and indices from the buffers
     // In glTF this is done via accessors and buffer views
     if (inputNode.mesh > -1) {
-        const tinygltf::Mesh mesh = input.meshes[inputNode.mesh];
-
-        // Iterate through all primitives of this node's mesh
-        for (const auto &glTFPrimitive: mesh.primitives) {
-            auto firstIndex = static_cast<uint32_t>(indexBuffer.size());
-            auto vertexStart = static_cast<uint32_t>(vertexBuffer.size());
-            uint32_t indexCount = 0;
-
-            AABB aabb = {};
-
-            // Vertices
-            {
-                const float *positionBuffer = nullptr;
-                const float *normalsBuffer = nullptr;
-                const float *texCoordsBuffer0 = nullptr;
-                const float *texCoordsBuffer1 = nullptr;
-                const float *colorBuffer = nullptr;
-                size_t vertexCount = 0;
-
-                // Get buffer data for vertex positions
-                if (glTFPrimitive.attributes.contains("POSITION")) {
-                    const tinygltf::Accessor &accessor =
-                            input.accessors[glTFPrimitive.attributes.find("POSITION")->second];
-                    const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
-                    positionBuffer = reinterpret_cast<const float *>(
-                            &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-                    vertexCount = accessor.count;
-
-                    aabb.min = glm::vec3{accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]};
-                    aabb.max = glm::vec3{accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]};
-                }
-                // Get buffer data for vertex normals
-                if (glTFPrimitive.attributes.contains("NORMAL")) {
-                    const tinygltf::Accessor &accessor =
-                            input.accessors[glTFPrimitive.attributes.find("NORMAL")->second];
-                    const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
-                    normalsBuffer = reinterpret_cast<const float *>(
-                            &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-                }
-                // Get buffer data for vertex texture coordinates
-                // glTF supports multiple sets, we only load the first one
-                if (glTFPrimitive.attributes.contains("TEXCOORD_0")) {
-                    const tinygltf::Accessor &accessor =
-                            input.accessors[glTFPrimitive.attributes.find("TEXCOORD_0")->second];
-                    const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
-                    texCoordsBuffer0 = reinterpret_cast<const float *>(
-                            &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-                }
+        // NOTE: Nodes that reference the same glTF mesh share its geometry and end up as instances of one draw
+        auto loaded = loadedMeshes.find(inputNode.mesh);
+        if (loaded == loadedMeshes.end()) {
+            const NodeMeshes mesh = LoadMesh(input, input.meshes[inputNode.mesh], positionStream, vertexBuffer,
+                                             colorStream, indexBuffer, shortIndexBuffer);
+            loaded = loadedMeshes.emplace(inputNode.mesh, mesh).first;
+        }
+        nodeMeshes[node] = loaded->second;
+    }
 
-                if (glTFPrimitive.attributes.contains("TEXCOORD_1")) {
-                    const tinygltf::Accessor &accessor =
-                            input.accessors[glTFPrimitive.attributes.find("TEXCOORD_1")->second];
-                    const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
-                    texCoordsBuffer1 = reinterpret_cast<const float *>(
-                            &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-                }
+    // Every instance becomes a child node with the instance transform, the node itself draws nothing
+    const auto instancing = inputNode.extensions.find("EXT_mesh_gpu_instancing");
+    if (nodeMeshes[node].meshCount > 0 && instancing != inputNode.extensions.end()) {
+        const std::vector<glm::mat4> instanceMatrices = ReadInstanceMatrices(input, instancing->second);
+        const NodeMeshes instanceMeshes = nodeMeshes[node];
+        for (const glm::mat4 &instanceMatrix: instanceMatrices) {
+            hierarchy.AddNode(static_cast<int32_t>(node), instanceMatrix);
+            nodeMeshes.push_back(instanceMeshes);
+        }
+        if (!instanceMatrices.empty()) {
+            nodeMeshes[node] = {};
+        }
+    }
+}
 
-                // Vertex colors
-                if (glTFPrimitive.attributes.contains("COLOR_0")) {
-                    const tinygltf::Accessor &accessor =
-                            input.accessors[glTFPrimitive.attributes.find("COLOR_0")->second];
-                    const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
-                    colorBuffer = reinterpret_cast<const float *>(
-                            &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
-                }
+Scene::NodeMeshes Scene::LoadMesh(const tinygltf::Model &input, const tinygltf::Mesh &inputMesh,
+                                  std::vector<VertexPosition> &positionStream, std::vector<Vertex> &vertexBuffer,
+                                  std::vector<uint32_t> &colorStream, std::vector<uint32_t> &indexBuffer,
+                                  std::vector<uint16_t> &shortIndexBuffer) {
+    DebugMarkers::ScopedMarker marker("Scene::LoadMesh");
+    // NOTE: The primitives are appended back to back, so the meshes of a glTF mesh are always one range
+    NodeMeshes meshRange{.firstMesh = static_cast<uint32_t>(meshes.size())};
+
+    // Iterate through all primitives of the mesh
+    for (const auto &glTFPrimitive: inputMesh.primitives) {
+        auto vertexStart = static_cast<uint32_t>(vertexBuffer.size());
+        uint32_t indexCount = 0;
+        // Relative to vertexStart, the levels of detail are appended behind the primitive's own indices
+        std::vector<uint32_t> indices;
+
+        AABB aabb = {};
+        // Unquantized positions of the primitive, for the index optimization and the meshlet bounds
+        std::vector<glm::vec3> positions;
+
+        // Vertices
+        {
+            const float *positionBuffer = nullptr;
+            const float *normalsBuffer = nullptr;
+            const float *texCoordsBuffer0 = nullptr;
+            const float *texCoordsBuffer1 = nullptr;
+            const float *colorBuffer = nullptr;
+            int colorComponents = 4;
+            size_t vertexCount = 0;
+
+            // Get buffer data for vertex positions
+            if (glTFPrimitive.attributes.contains("POSITION")) {
+                const tinygltf::Accessor &accessor =
+                        input.accessors[glTFPrimitive.attributes.find("POSITION")->second];
+                const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
+                positionBuffer = reinterpret_cast<const float *>(
+                        &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
+                vertexCount = accessor.count;
+            }
+            // Get buffer data for vertex normals
+            if (glTFPrimitive.attributes.contains("NORMAL")) {
+                const tinygltf::Accessor &accessor =
+                        input.accessors[glTFPrimitive.attributes.find("NORMAL")->second];
+                const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
+                normalsBuffer = reinterpret_cast<const float *>(
+                        &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
+            }
+            // Get buffer data for vertex texture coordinates
+            // glTF supports multiple sets, we only load the first one
+            if (glTFPrimitive.attributes.contains("TEXCOORD_0")) {
+                const tinygltf::Accessor &accessor =
+                        input.accessors[glTFPrimitive.attributes.find("TEXCOORD_0")->second];
+                const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
+                texCoordsBuffer0 = reinterpret_cast<const float *>(
+                        &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
+            }
 
-                // Append data to model's vertex buffer
-                for (size_t v = 0; v < vertexCount; v++) {
-                    Vertex vert{};
-                    vert.pos = glm::vec4(glm::make_vec3(&positionBuffer[v * 3]), 1.0f);
-                    vert.normal = glm::normalize(
-                            glm::vec3(normalsBuffer ? glm::make_vec3(&normalsBuffer[v * 3]) : glm::vec3(0.0f)));
-                    vert.color = colorBuffer ? glm::make_vec4(&colorBuffer[v * 4]) : glm::vec4(1.0f);
-                    vert.texCoord0 = texCoordsBuffer0 ? glm::make_vec2(&texCoordsBuffer0[v * 2]) : glm::vec3(0.0f);
-                    vert.texCoord1 = texCoordsBuffer1 ? glm::make_vec2(&texCoordsBuffer1[v * 2]) : glm::vec3(0.0f);
-                    vertexBuffer.push_back(vert);
+            if (glTFPrimitive.attributes.contains("TEXCOORD_1")) {
+                const tinygltf::Accessor &accessor =
+                        input.accessors[glTFPrimitive.attributes.find("TEXCOORD_1")->second];
+                const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
+                texCoordsBuffer1 = reinterpret_cast<const float *>(
+                        &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
+            }
+
+            // Vertex colors
+            if (glTFPrimitive.attributes.contains("COLOR_0")) {
+                const tinygltf::Accessor &accessor =
+                        input.accessors[glTFPrimitive.attributes.find("COLOR_0")->second];
+                const tinygltf::BufferView &view = input.bufferViews[accessor.bufferView];
+                colorBuffer = reinterpret_cast<const float *>(
+                        &(input.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]));
+                colorComponents = accessor.type == TINYGLTF_TYPE_VEC3 ? 3 : 4;
+            }
+
+            // NOTE: Positions are quantized against the exact bounds of the primitive, which also replace the
+            //       accessor's min/max since those are optional for some exporters
+            aabb.min = glm::vec3(std::numeric_limits<float>::max());
+            aabb.max = glm::vec3(std::numeric_limits<float>::lowest());
+            positions.reserve(vertexCount);
+            for (size_t v = 0; v < vertexCount; v++) {
+                const glm::vec3 position = glm::make_vec3(&positionBuffer[v * 3]);
+                aabb.min = glm::min(aabb.min, position);
+                aabb.max = glm::max(aabb.max, position);
+                positions.push_back(position);
+            }
+            if (vertexCount == 0) {
+                aabb = {};
+            }
+            const glm::vec3 extent = aabb.max - aabb.min;
+            const glm::vec3 positionScale =
+                    glm::vec3(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                              extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+            // The color stream only exists once a primitive has colors, earlier vertices are white
+            if (colorBuffer && colorStream.empty()) {
+                colorStream.resize(vertexStart, whiteVertexColor);
+            }
+
+            // Append data to model's vertex buffer
+            for (size_t v = 0; v < vertexCount; v++) {
+                const glm::u16vec4 quantized =
+                        glm::packUnorm<uint16_t>(glm::vec4((positions[v] - aabb.min) * positionScale, 0.0f));
+
+                VertexPosition vertexPosition{};
+                std::copy_n(glm::value_ptr(quantized), 4, vertexPosition.position);
+                positionStream.push_back(vertexPosition);
+
+                Vertex vert{};
+                vert.normal = glm::packSnorm2x16(
+                        EncodeOctahedral(normalsBuffer ? glm::make_vec3(&normalsBuffer[v * 3]) : glm::vec3(0.0f)));
+                vert.texCoord0 = glm::packHalf2x16(texCoordsBuffer0 ? glm::make_vec2(&texCoordsBuffer0[v * 2])
+                                                                    : glm::vec2(0.0f));
+                vert.texCoord1 = glm::packHalf2x16(texCoordsBuffer1 ? glm::make_vec2(&texCoordsBuffer1[v * 2])
+                                                                    : glm::vec2(0.0f));
+                vertexBuffer.push_back(vert);
+
+                if (colorBuffer) {
+                    const float *color = &colorBuffer[v * colorComponents];
+                    colorStream.push_back(glm::packUnorm4x8(
+                            glm::vec4(color[0], color[1], color[2], colorComponents == 4 ? color[3] : 1.0f)));
+                } else if (!colorStream.empty()) {
+                    colorStream.push_back(whiteVertexColor);
                 }
             }
+        }
 
-            // Indices
-            {
-                const tinygltf::Accessor &accessor = input.accessors[glTFPrimitive.indices];
-                const tinygltf::BufferView &bufferView = input.bufferViews[accessor.bufferView];
-                const tinygltf::Buffer &buffer = input.buffers[bufferView.buffer];
-
-                indexCount += static_cast<uint32_t>(accessor.count);
-
-                // glTF supports different component types of indices
-                switch (accessor.componentType) {
-                    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-                        const auto *buf = reinterpret_cast<const uint32_t *>(
-                                &buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-                        for (size_t index = 0; index < accessor.count; index++) {
-                            indexBuffer.push_back(buf[index] + vertexStart);
-                        }
-                        break;
+        // Indices
+        {
+            const tinygltf::Accessor &accessor = input.accessors[glTFPrimitive.indices];
+            const tinygltf::BufferView &bufferView = input.bufferViews[accessor.bufferView];
+            const tinygltf::Buffer &buffer = input.buffers[bufferView.buffer];
+
+            indexCount += static_cast<uint32_t>(accessor.count);
+
+            // glTF supports different component types of indices
+            switch (accessor.componentType) {
+                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
+                    const auto *buf = reinterpret_cast<const uint32_t *>(
+                            &buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+                    for (size_t index = 0; index < accessor.count; index++) {
+                        indices.push_back(buf[index]);
                     }
-                    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-                        const auto *buf = reinterpret_cast<const uint16_t *>(
-                                &buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-                        for (size_t index = 0; index < accessor.count; index++) {
-                            indexBuffer.push_back(buf[index] + vertexStart);
-                        }
-                        break;
+                    break;
+                }
+                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
+                    const auto *buf = reinterpret_cast<const uint16_t *>(
+                            &buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+                    for (size_t index = 0; index < accessor.count; index++) {
+                        indices.push_back(buf[index]);
                     }
-                    case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-                        const auto *buf = reinterpret_cast<const uint8_t *>(
-                                &buffer.data[accessor.byteOffset + bufferView.byteOffset]);
-                        for (size_t index = 0; index < accessor.count; index++) {
-                            indexBuffer.push_back(buf[index] + vertexStart);
-                        }
-                        break;
+                    break;
+                }
+                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
+                    const auto *buf = reinterpret_cast<const uint8_t *>(
+                            &buffer.data[accessor.byteOffset + bufferView.byteOffset]);
+                    for (size_t index = 0; index < accessor.count; index++) {
+                        indices.push_back(buf[index]);
                     }
-                    default:
-                        std::cerr << "Index component type " << accessor.componentType << " not supported!"
-                                  << std::endl;
-                        return;
+                    break;
                 }
+                default:
+                    std::cerr << "Index component type " << accessor.componentType << " not supported!"
+                              << std::endl;
+                    return meshRange;
             }
-            Mesh mesh{};
-            mesh.firstIndex = firstIndex;
-            mesh.indexCount = indexCount;
-            mesh.materialIndex = glTFPrimitive.material;
-            mesh.boundingBox = aabb;
+        }
+        const bool isTriangleList = glTFPrimitive.mode == -1 || glTFPrimitive.mode == TINYGLTF_MODE_TRIANGLES;
+        if (isTriangleList) {
+            OptimizePrimitive(indices, vertexStart, positions, positionStream, vertexBuffer, colorStream);
+        }
 
-            meshes.push_back(mesh);
-            node->meshIndices.push_back(meshes.size() - 1);
+        Mesh mesh{};
+        mesh.indexCount = indexCount;
+        mesh.materialIndex = glTFPrimitive.material;
+        mesh.vertexOffset = vertexStart;
+        mesh.vertexCount = static_cast<uint32_t>(positions.size());
+        mesh.boundingBox = aabb;
+
+        // NOTE: Meshlets are built from the unquantized positions, so their bounds stay conservative
+        if (isTriangleList && !positions.empty()) {
+            mesh.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+            const auto getPosition = [&](uint32_t index) { return positions[index]; };
+            BuildMeshlets(indices, 0, indexCount, getPosition, meshlets);
+            mesh.meshletCount = static_cast<uint32_t>(meshlets.size()) - mesh.firstMeshlet;
+
+            mesh.firstLod = static_cast<uint32_t>(meshLods.size());
+            GenerateLods(indices, 0, indexCount, positions, glm::length(aabb.max - aabb.min), meshLods);
+            mesh.lodCount = static_cast<uint32_t>(meshLods.size()) - mesh.firstLod;
         }
-    }
 
-    if (parent) {
-        parent->children.push_back(node);
-    } else {
-        nodes.push_back(node);
+        // The ranges so far are relative to the primitive's indices, move them to where the pool stores them
+        mesh.firstIndex = mesh.UsesShortIndices() ? AppendIndices(indices, shortIndexBuffer)
+                                                  : AppendIndices(indices, indexBuffer);
+        for (uint32_t m = mesh.firstMeshlet; m < mesh.firstMeshlet + mesh.meshletCount; m++) {
+            meshlets[m].firstIndex += mesh.firstIndex;
+        }
+        for (uint32_t l = mesh.firstLod; l < mesh.firstLod + mesh.lodCount; l++) {
+            meshLods[l].firstIndex += mesh.firstIndex;
+        }
+
+        meshes.push_back(mesh);
+        meshRange.meshCount++;
     }
+    return meshRange;
 }
 
 void Scene::Destroy() {
     indexBuffer->Destroy();
+    shortIndexBuffer->Destroy();
+    positionsBuffer->Destroy();
     vertexBuffer->Destroy();
+    colorBuffer->Destroy();
+
+    skyboxVertexBuffer->Destroy();
 
     materialsBuffer->Destroy();
     lightsBuffer->Destroy();
     camerasBuffer->Destroy();
-
-    for (const auto &node: nodes) {
-        delete node;
-    }
+    shadowViewsBuffer->Destroy();
+    modelMatricesBuffer->Destroy();
+    instancesBuffer->Destroy();
+
+    opaqueDrawIndirectCommandsBuffer->Destroy();
+    transparentDrawIndirectCommandsBuffer->Destroy();
+    opaqueDrawDataBuffer->Destroy();
+    transparentDrawDataBuffer->Destroy();
+    culledOpaqueDrawIndirectCommandsBuffer->Destroy();
+    culledTransparentDrawIndirectCommandsBuffer->Destroy();
+    culledOpaqueDrawDataBuffer->Destroy();
+    culledTransparentDrawDataBuffer->Destroy();
+    culledShadowOpaqueDrawIndirectCommandsBuffer->Destroy();
+    culledShadowTransparentDrawIndirectCommandsBuffer->Destroy();
+    culledShadowOpaqueDrawDataBuffer->Destroy();
+    culledShadowTransparentDrawDataBuffer->Destroy();
+    drawCountsBuffer->Destroy();
+    drawVisibilityBuffer->Destroy();
+    meshesBuffer->Destroy();
+    meshletsBuffer->Destroy();
+    meshLodsBuffer->Destroy();
 
     //    m_DefaultImage.texture.Destroy();
     for (auto &image: images) {
@@ -507,62 +1121,114 @@ void Scene::Destroy() {
     }
 }
 
-void Scene::Draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
-    VkDeviceSize offsets[] = {0};
-    VkBuffer vertexBuffers[] = {vertexBuffer->GetBuffer()};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
-
+void Scene::Draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, DrawPhase phase) const {
+    // NOTE: Vertices are pulled through their addresses in pbr.vert, only the index buffers are bound
     struct PBRPushConstants {
         VkDeviceAddress materialsBufferAddress;
         VkDeviceAddress lightsBufferAddress;
         VkDeviceAddress cameraBufferAddress;
         VkDeviceAddress drawDataBufferAddress;
         VkDeviceAddress modelMatricesBufferAddress;
+        VkDeviceAddress instancesBufferAddress;
+        VkDeviceAddress meshesBufferAddress;
+        VkDeviceAddress positionsBufferAddress;
+        VkDeviceAddress verticesBufferAddress;
+        VkDeviceAddress colorsBufferAddress;
         int32_t directionLightIndex;
         uint32_t lightCount;
         int32_t shadowMapTextureIndex;
         int32_t cameraIndex;
-    } pushConstants{materialsBuffer->GetAddress(),        lightsBuffer->GetAddress(),
-                    camerasBuffer->GetAddress(),          opaqueDrawDataBuffer->GetAddress(),
-                    modelMatricesBuffer->GetAddress(),    0,
-                    static_cast<uint32_t>(lights.size()), 800,
-                    (int32_t)cameraIndexDrawing};
-    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                       sizeof(PBRPushConstants), &pushConstants);
-    vkCmdDrawIndexedIndirect(commandBuffer, opaqueDrawIndirectCommandsBuffer->GetBuffer(), 0,
-                             opaqueDrawIndirectCommands.size(), sizeof(VkDrawIndexedIndirectCommand));
+        uint32_t hasVertexColors; // Otherwise every vertex reads the single white color
+    } pushConstants{materialsBuffer->GetAddress(),
+                    lightsBuffer->GetAddress(),
+                    camerasBuffer->GetAddress(),
+                    opaqueDrawDataBuffer->GetAddress(),
+                    modelMatricesBuffer->GetAddress(),
+                    instancesBuffer->GetAddress(),
+                    meshesBuffer->GetAddress(),
+                    positionsBuffer->GetAddress(),
+                    vertexBuffer->GetAddress(),
+                    colorBuffer->GetAddress(),
+                    0,
+                    static_cast<uint32_t>(lights.size()),
+                    800,
+                    (int32_t) cameraIndexDrawing,
+                    hasVertexColors};
+
+    const auto pushDrawData = [&](VkDeviceAddress drawDataAddress) {
+        pushConstants.drawDataBufferAddress = drawDataAddress;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                           0, sizeof(PBRPushConstants), &pushConstants);
+    };
+    // NOTE: The culling pass only keeps the visible draws, the GPU reads how many there are
+    DrawIndexedBatches(commandBuffer, *culledOpaqueDrawIndirectCommandsBuffer, *culledOpaqueDrawDataBuffer,
+                       opaqueDrawIndirectCommands.size(), opaqueShortDrawCount, drawCountsBuffer.get(),
+                       phase == DrawPhase::Early ? earlyOpaqueDrawCountsOffset : lateOpaqueDrawCountsOffset,
+                       pushDrawData);
+    if (phase == DrawPhase::Late) {
+        DrawIndexedBatches(commandBuffer, *culledTransparentDrawIndirectCommandsBuffer,
+                           *culledTransparentDrawDataBuffer, transparentDrawIndirectCommands.size(),
+                           transparentShortDrawCount, drawCountsBuffer.get(), transparentDrawCountsOffset,
+                           pushDrawData);
+    }
+}
 
-    pushConstants.drawDataBufferAddress = transparentDrawDataBuffer->GetAddress();
-    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
-                       sizeof(PBRPushConstants), &pushConstants);
-    vkCmdDrawIndexedIndirect(commandBuffer, transparentDrawIndirectCommandsBuffer->GetBuffer(), 0,
-                             transparentDrawIndirectCommands.size(), sizeof(VkDrawIndexedIndirectCommand));
+void Scene::DrawIndexedBatches(VkCommandBuffer commandBuffer, const Buffer &commandsBuffer,
+                               const Buffer &drawDataBuffer, size_t drawCount, size_t shortDrawCount,
+                               const Buffer *drawCountsBuffer, VkDeviceSize drawCountsOffset,
+                               const std::function<void(VkDeviceAddress)> &pushDrawData) const {
+    const auto drawBatch = [&](VkDeviceSize firstDraw, size_t maxDrawCount, VkDeviceSize countOffset) {
+        const VkDeviceSize offset = firstDraw * sizeof(VkDrawIndexedIndirectCommand);
+        if (drawCountsBuffer) {
+            vkCmdDrawIndexedIndirectCount(commandBuffer, commandsBuffer.GetBuffer(), offset,
+                                          drawCountsBuffer->GetBuffer(), countOffset,
+                                          static_cast<uint32_t>(maxDrawCount), sizeof(VkDrawIndexedIndirectCommand));
+        } else {
+            vkCmdDrawIndexedIndirect(commandBuffer, commandsBuffer.GetBuffer(), offset,
+                                     static_cast<uint32_t>(maxDrawCount), sizeof(VkDrawIndexedIndirectCommand));
+        }
+    };
+
+    if (shortDrawCount > 0) {
+        vkCmdBindIndexBuffer(commandBuffer, shortIndexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT16);
+        pushDrawData(drawDataBuffer.GetAddress());
+        drawBatch(0, shortDrawCount, drawCountsOffset);
+    }
+    if (drawCount > shortDrawCount) {
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+        pushDrawData(drawDataBuffer.GetAddress() + shortDrawCount * sizeof(DrawData));
+        drawBatch(shortDrawCount, drawCount - shortDrawCount, drawCountsOffset + sizeof(uint32_t));
+    }
 }
 
 void Scene::DrawShadowMap(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
-    VkDeviceSize offsets[] = {0};
-    VkBuffer vertexBuffers[] = {vertexBuffer->GetBuffer()};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer->GetBuffer(), 0, VK_INDEX_TYPE_UINT32);
+    // NOTE: shadowmap.vert only pulls positions, the other streams are never read
 
     struct shadowPushConstants {
         VkDeviceAddress lightBufferAddress;
         VkDeviceAddress drawDataBufferAddress;
         VkDeviceAddress modelMatricesBufferAddress;
+        VkDeviceAddress instancesBufferAddress;
+        VkDeviceAddress meshesBufferAddress;
+        VkDeviceAddress positionsBufferAddress;
         int32_t directionalLightIndex;
-    } pushConstants{lightsBuffer->GetAddress(), opaqueDrawDataBuffer->GetAddress(), modelMatricesBuffer->GetAddress(),
-                    0};
-    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants),
-                       &pushConstants);
-    vkCmdDrawIndexedIndirect(commandBuffer, opaqueDrawIndirectCommandsBuffer->GetBuffer(), 0,
-                             opaqueDrawIndirectCommands.size(), sizeof(VkDrawIndexedIndirectCommand));
-
-    pushConstants.drawDataBufferAddress = transparentDrawDataBuffer->GetAddress();
-    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(shadowPushConstants),
-                       &pushConstants);
-    vkCmdDrawIndexedIndirect(commandBuffer, transparentDrawIndirectCommandsBuffer->GetBuffer(), 0,
-                             transparentDrawIndirectCommands.size(), sizeof(VkDrawIndexedIndirectCommand));
+    } pushConstants{lightsBuffer->GetAddress(),        opaqueDrawDataBuffer->GetAddress(),
+                    modelMatricesBuffer->GetAddress(), instancesBuffer->GetAddress(),
+                    meshesBuffer->GetAddress(),        positionsBuffer->GetAddress(),
+                    shadowLightIndex};
+
+    const auto pushDrawData = [&](VkDeviceAddress drawDataAddress) {
+        pushConstants.drawDataBufferAddress = drawDataAddress;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(shadowPushConstants),
+                           &pushConstants);
+    };
+    DrawIndexedBatches(commandBuffer, *culledShadowOpaqueDrawIndirectCommandsBuffer,
+                       *culledShadowOpaqueDrawDataBuffer, opaqueDrawIndirectCommands.size(), opaqueShortDrawCount,
+                       drawCountsBuffer.get(), shadowOpaqueDrawCountsOffset, pushDrawData);
+    DrawIndexedBatches(commandBuffer, *culledShadowTransparentDrawIndirectCommandsBuffer,
+                       *culledShadowTransparentDrawDataBuffer, transparentDrawIndirectCommands.size(),
+                       transparentShortDrawCount, drawCountsBuffer.get(), shadowTransparentDrawCountsOffset,
+                       pushDrawData);
 }
 
 void Scene::DrawSkybox(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) {
@@ -581,25 +1247,128 @@ void Scene::DrawSkybox(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineL
     vkCmdDraw(commandBuffer, 36, 1, 0, 0);
 }
 
-void Scene::GenerateDrawCommands(DebugDraw &debugDraw, bool frustumCulling) {
-    globalModelMatrices.resize(localModelMatrices.size());
+void Scene::GenerateDrawCommands(DebugDraw &debugDraw, bool frustumCulling, bool meshletDraws) {
+    DebugMarkers::ScopedMarker marker("Scene::GenerateDrawCommands");
+    if (hierarchy.UpdateTransforms()) {
+        modelMatricesChanged = true;
+        worldBoundsChanged = true;
+    }
     opaqueDrawData.clear();
     transparentDrawData.clear();
     opaqueDrawIndirectCommands.clear();
     transparentDrawIndirectCommands.clear();
 
-    // Render all nodes at top-level
-    for (const auto &node: nodes) {
-        DrawNode(node, debugDraw, frustumCulling);
+    instanceModelMatrixIndices.clear();
+    meshInstances.resize(meshes.size());
+    for (MeshInstances &instances: meshInstances) {
+        instances.modelMatrixIndices.clear();
+    }
+
+    const AABBArrays &worldBounds = hierarchy.GetWorldBounds();
+    if (bvh.GetBoxCount() != worldBounds.Size()) {
+        bvh.Build(worldBounds);
+    } else if (worldBoundsChanged) {
+        bvh.Refit(worldBounds);
+    }
+    worldBoundsChanged = false;
+
+    if (frustumCulling) {
+        bvh.CullFrustum(cameras[0].GetFrustum(), cullingVisibility);
+    }
+    for (size_t i = 0; i < cullingMeshIndices.size(); i++) {
+        if (frustumCulling && (cullingVisibility[i / 64] & (uint64_t{1} << (i % 64))) == 0) {
+            // debugDraw.DrawAABB(worldBounds.Get(i), {1.0f, 0.0f, 0.0f});
+            continue;
+        }
+
+        const AABB aabb = worldBounds.Get(i);
+        MeshInstances &instances = meshInstances[cullingMeshIndices[i]];
+        if (instances.modelMatrixIndices.empty()) {
+            instances.bounds = aabb;
+        } else {
+            instances.bounds = {.min = glm::min(instances.bounds.min, aabb.min),
+                                .max = glm::max(instances.bounds.max, aabb.max)};
+        }
+        instances.modelMatrixIndices.push_back(cullingMatrixIndices[i]);
+    }
+
+    // Every mesh is drawn once, with an instance per node that references it.
+    // NOTE: Meshes with 16-bit indices go first, they are drawn with their own index buffer
+    for (const bool shortIndices: {true, false}) {
+        for (uint32_t meshIndex = 0; meshIndex < meshes.size(); meshIndex++) {
+            if (!meshInstances[meshIndex].modelMatrixIndices.empty() &&
+                meshes[meshIndex].UsesShortIndices() == shortIndices) {
+                AddMeshDraws(meshIndex, meshletDraws);
+            }
+        }
+        if (shortIndices) {
+            opaqueShortDrawCount = opaqueDrawIndirectCommands.size();
+            transparentShortDrawCount = transparentDrawIndirectCommands.size();
+        }
+    }
+
+    // NOTE: Toggling meshlet draws or CPU culling moves the draws to other slots
+    const auto drawKey = [](const DrawData &drawData) { return std::pair(drawData.meshIndex, drawData.meshletIndex); };
+    if (!std::ranges::equal(opaqueDrawData | std::views::transform(drawKey), opaqueDrawKeys)) {
+        opaqueDrawKeys = std::ranges::to<std::vector>(opaqueDrawData | std::views::transform(drawKey));
+        drawVisibilityInvalid = true;
+    }
+}
+
+void Scene::AddMeshDraws(uint32_t meshIndex, bool meshletDraws) {
+    const MeshInstances &instances = meshInstances[meshIndex];
+    const auto &mesh = meshes[meshIndex];
+    const auto &material = mesh.materialIndex != -1 ? materials[mesh.materialIndex] : defaultMaterial;
+    const auto firstInstance = static_cast<uint32_t>(instanceModelMatrixIndices.size());
+    const auto instanceCount = static_cast<uint32_t>(instances.modelMatrixIndices.size());
+    instanceModelMatrixIndices.insert(instanceModelMatrixIndices.end(), instances.modelMatrixIndices.begin(),
+                                      instances.modelMatrixIndices.end());
+
+    const VkDrawIndexedIndirectCommand drawIndirectCommand{
+            .indexCount = mesh.indexCount,
+            .instanceCount = instanceCount,
+            .firstIndex = mesh.firstIndex,
+            .vertexOffset = static_cast<int32_t>(mesh.vertexOffset),
+            .firstInstance = firstInstance,
+    };
+    const DrawData drawData{.modelMatrixIndex = instances.modelMatrixIndices.front(),
+                            .materialIndex = static_cast<uint32_t>(mesh.materialIndex),
+                            .meshIndex = meshIndex,
+                            .boundingBox = instances.bounds};
+
+    // NOTE: Meshlet culling needs the transform of the draw, so only single instances are split into meshlets
+    if (material.alphaMask != 1.0f && meshletDraws && mesh.meshletCount > 0 && instanceCount == 1) {
+        // One draw per meshlet, they are culled by the frustum culling pass
+        for (uint32_t m = mesh.firstMeshlet; m < mesh.firstMeshlet + mesh.meshletCount; m++) {
+            opaqueDrawIndirectCommands.push_back({.indexCount = meshlets[m].indexCount,
+                                                  .instanceCount = 1,
+                                                  .firstIndex = meshlets[m].firstIndex,
+                                                  .vertexOffset = static_cast<int32_t>(mesh.vertexOffset),
+                                                  .firstInstance = firstInstance});
+            DrawData meshletDrawData = drawData;
+            meshletDrawData.meshletIndex = m;
+            opaqueDrawData.push_back(meshletDrawData);
+        }
+    } else if (material.alphaMask != 1.0f) {
+        opaqueDrawIndirectCommands.push_back(drawIndirectCommand);
+        opaqueDrawData.push_back(drawData);
+    }
+    if (material.alphaMask != 0.0f) {
+        transparentDrawIndirectCommands.push_back(drawIndirectCommand);
+        transparentDrawData.push_back(drawData);
     }
 }
+
 void Scene::UploadToGPU(GPUDataUploader &uploader) {
+    DebugMarkers::ScopedMarker marker("Scene::UploadToGPU");
     uploader.AddCopy(materials, materialsBuffer->GetBuffer());
     uploader.AddCopy(lights, lightsBuffer->GetBuffer());
 
     auto camerasGPUData = std::ranges::to<std::vector>(
             cameras | std::views::transform([](const Camera &camera) { return camera.GetGPUData(); }));
     uploader.AddCopy(camerasGPUData, camerasBuffer->GetBuffer());
+    const Camera::GPUData shadowView = GetShadowView();
+    uploader.AddCopy(std::span(&shadowView, 1), shadowViewsBuffer->GetBuffer());
 
     uploader.AddCopy(opaqueDrawIndirectCommands, opaqueDrawIndirectCommandsBuffer->GetBuffer());
     uploader.AddCopy(opaqueDrawData, opaqueDrawDataBuffer->GetBuffer());
@@ -607,85 +1376,60 @@ void Scene::UploadToGPU(GPUDataUploader &uploader) {
     uploader.AddCopy(transparentDrawIndirectCommands, transparentDrawIndirectCommandsBuffer->GetBuffer());
     uploader.AddCopy(transparentDrawData, transparentDrawDataBuffer->GetBuffer());
 
-    uploader.AddCopy(globalModelMatrices, modelMatricesBuffer->GetBuffer());
-}
-
-void Scene::DrawNode(Node *node, DebugDraw &debugDraw, bool frustumCulling) {
-    if (!node->meshIndices.empty()) {
-        // Pass the node's matrix via push constants
-        // Traverse the node hierarchy to the top-most parent to get the final matrix of the current node
-        // TODO: Inefficient? -> Search for different scene graph implementations
-        glm::mat4 nodeMatrix = localModelMatrices.at(node->modelMatrixIndex);
-        Node *currentParent = node->parent;
-        while (currentParent) {
-            glm::mat4 parentMatrix = localModelMatrices.at(currentParent->modelMatrixIndex);
-            nodeMatrix = parentMatrix * nodeMatrix;
-            currentParent = currentParent->parent;
-        }
-        globalModelMatrices.at(node->modelMatrixIndex) = nodeMatrix;
-
-        for (const auto meshIndex: node->meshIndices) {
-            const auto &mesh = meshes[meshIndex];
-            if (mesh.indexCount > 0) {
-
-                Camera &camera = cameras[0];
-
-                const std::array corners = {
-                        mesh.boundingBox.min,
-                        glm::vec3(mesh.boundingBox.max.x, mesh.boundingBox.min.y, mesh.boundingBox.min.z),
-                        glm::vec3(mesh.boundingBox.min.x, mesh.boundingBox.max.y, mesh.boundingBox.min.z),
-                        glm::vec3(mesh.boundingBox.min.x, mesh.boundingBox.min.y, mesh.boundingBox.max.z),
-                        glm::vec3(mesh.boundingBox.max.x, mesh.boundingBox.max.y, mesh.boundingBox.min.z),
-                        glm::vec3(mesh.boundingBox.max.x, mesh.boundingBox.min.y, mesh.boundingBox.max.z),
-                        glm::vec3(mesh.boundingBox.min.x, mesh.boundingBox.max.y, mesh.boundingBox.max.z),
-                        mesh.boundingBox.max};
-
-                glm::vec3 newMin(std::numeric_limits<float>::max());
-                glm::vec3 newMax(std::numeric_limits<float>::lowest());
-                for (size_t i = 0; i < 8; ++i) {
-                    glm::vec4 transformed = nodeMatrix * glm::vec4(corners[i], 1.0f);
-                    auto p = glm::vec3(transformed);
-                    newMin = glm::min(newMin, p);
-                    newMax = glm::max(newMax, p);
-                }
-                AABB aabb = {.min = newMin, .max = newMax};
-                if (frustumCulling) {
-                    if (camera.IsAABBFullyOutsideFrustum(aabb)) {
-                        // debugDraw.DrawAABB(aabb, {1.0f, 0.0f, 0.0f});
-                        continue;
-                    }
-                    // debugDraw.DrawAABB(aabb, {0.0f, 1.0f, 0.0f});
-                }
+    if (modelMatricesChanged) {
+        uploader.AddCopy(hierarchy.GetWorldTransforms(), modelMatricesBuffer->GetBuffer());
+        modelMatricesChanged = false;
+    }
+    uploader.AddCopy(instanceModelMatrixIndices, instancesBuffer->GetBuffer());
+    uploader.AddCopy(meshes, meshesBuffer->GetBuffer());
+}
 
-                // Get the texture index for this primitive
-                const auto &material = mesh.materialIndex != -1 ? materials[mesh.materialIndex] : defaultMaterial;
-
-                VkDrawIndexedIndirectCommand drawIndirectCommand{
-                        .indexCount = mesh.indexCount,
-                        .instanceCount = 1,
-                        .firstIndex = mesh.firstIndex,
-                        .vertexOffset = 0,
-                        .firstInstance = 0,
-                };
-                if (material.alphaMask != 1.0f) {
-                    opaqueDrawIndirectCommands.emplace_back(drawIndirectCommand);
-                    opaqueDrawData.push_back(DrawData{.modelMatrixIndex = node->modelMatrixIndex,
-                                                      .materialIndex = static_cast<uint32_t>(mesh.materialIndex),
-                                                      .boundingBox = aabb});
-                }
-                if (material.alphaMask != 0.0f) {
-                    transparentDrawIndirectCommands.emplace_back(drawIndirectCommand);
-                    transparentDrawData.push_back(DrawData{.modelMatrixIndex = node->modelMatrixIndex,
-                                                           .materialIndex = static_cast<uint32_t>(mesh.materialIndex),
-                                                           .boundingBox = aabb});
-                }
+void Scene::CreateCullingBounds() {
+    // One box per drawn mesh of every node, in node order so the instances keep their order within a mesh
+    cullingMatrixIndices.clear();
+    cullingMeshIndices.clear();
+    for (uint32_t node = 0; node < nodeMeshes.size(); node++) {
+        const NodeMeshes &drawnMeshes = nodeMeshes[node];
+        for (uint32_t meshIndex = drawnMeshes.firstMesh; meshIndex < drawnMeshes.firstMesh + drawnMeshes.meshCount;
+             meshIndex++) {
+            if (meshes[meshIndex].indexCount > 0) {
+                cullingMatrixIndices.push_back(node);
+                cullingMeshIndices.push_back(meshIndex);
             }
         }
     }
 
-    for (const auto &child: node->children) {
-        DrawNode(child, debugDraw, frustumCulling);
+    AABBArrays localBounds;
+    localBounds.Resize(cullingMeshIndices.size());
+    for (size_t i = 0; i < cullingMeshIndices.size(); i++) {
+        localBounds.Set(i, meshes[cullingMeshIndices[i]].boundingBox);
     }
+    // NOTE: The boxes were added in node order, so their world bounds can be updated with the transforms
+    hierarchy.SetBounds(cullingMatrixIndices, localBounds);
+}
+
+void Scene::UpdateTransforms(JobSystem &jobSystem, bool validate) {
+    DebugMarkers::ScopedMarker marker("Scene::UpdateTransforms");
+    if (validate && !hierarchy.IsParallelUpdateBitIdentical(jobSystem)) {
+        std::cerr << "Parallel transform update differs from the serial one!" << std::endl;
+    }
+    if (hierarchy.UpdateTransforms(jobSystem)) {
+        modelMatricesChanged = true;
+        worldBoundsChanged = true;
+    }
+}
+
+std::optional<Scene::RayHit> Scene::RayCast(const glm::vec3 &origin, const glm::vec3 &direction,
+                                            float maxDistance) const {
+    const AABBArrays &worldBounds = hierarchy.GetWorldBounds();
+    const std::optional<BVH::Hit> hit = bvh.RayCast(origin, direction, maxDistance, worldBounds);
+    if (!hit) {
+        return std::nullopt;
+    }
+    return RayHit{.node = cullingMatrixIndices[hit->box],
+                  .meshIndex = cullingMeshIndices[hit->box],
+                  .distance = hit->distance,
+                  .bounds = worldBounds.Get(hit->box)};
 }
 
 void Scene::CreateLights() {
@@ -716,12 +1460,22 @@ void Scene::CreateBuffers() {
                                                                          .size = sizeof(Camera::GPUData) * maxCameras,
                                                                          .type = BufferType::GPU});
 
-    modelMatricesBuffer =
-            std::make_unique<Buffer>(device, BufferSpecification{.name = "Model Matrices Buffer",
-                                                                 .size = globalModelMatrices.size() * sizeof(glm::mat4),
-                                                                 .type = BufferType::GPU});
+    shadowViewsBuffer = std::make_unique<Buffer>(device, BufferSpecification{.name = "Shadow Views Buffer",
+                                                                             .size = sizeof(Camera::GPUData),
+                                                                             .type = BufferType::GPU});
+
+    modelMatricesBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Model Matrices Buffer",
+                                        .size = std::max<size_t>(hierarchy.GetNodeCount(), 1) * sizeof(glm::mat4),
+                                        .type = BufferType::GPU});
 
-    constexpr size_t maxDrawIndirectCommands = 8192;
+    // NOTE: Maps the instances of every draw to their model matrices, instances of one draw are contiguous
+    instancesBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Instances Buffer",
+                                        .size = std::max<size_t>(GetMaxInstanceCount(), 1) * sizeof(uint32_t),
+                                        .type = BufferType::GPU});
+
+    const size_t maxDrawIndirectCommands = std::max<size_t>(GetMaxDrawCount(), 1);
     opaqueDrawIndirectCommandsBuffer = std::make_unique<Buffer>(
             device, BufferSpecification{.name = "Opaque Draw Indirect Commands Buffer",
                                         .size = maxDrawIndirectCommands * sizeof(VkDrawIndexedIndirectCommand),
@@ -742,7 +1496,107 @@ void Scene::CreateBuffers() {
                                                                  .size = maxDrawIndirectCommands * sizeof(DrawData),
                                                                  .type = BufferType::GPU});
 
-    constexpr size_t maxMeshes = 16384;
+    culledOpaqueDrawIndirectCommandsBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Culled Opaque Draw Indirect Commands Buffer",
+                                        .size = maxDrawIndirectCommands * sizeof(VkDrawIndexedIndirectCommand),
+                                        .type = BufferType::GPU_INDIRECT});
+
+    culledTransparentDrawIndirectCommandsBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Culled Transparent Draw Indirect Commands Buffer",
+                                        .size = maxDrawIndirectCommands * sizeof(VkDrawIndexedIndirectCommand),
+                                        .type = BufferType::GPU_INDIRECT});
+
+    culledOpaqueDrawDataBuffer =
+            std::make_unique<Buffer>(device, BufferSpecification{.name = "Culled Opaque Draw Data Buffer",
+                                                                 .size = maxDrawIndirectCommands * sizeof(DrawData),
+                                                                 .type = BufferType::GPU});
+
+    culledTransparentDrawDataBuffer =
+            std::make_unique<Buffer>(device, BufferSpecification{.name = "Culled Transparent Draw Data Buffer",
+                                                                 .size = maxDrawIndirectCommands * sizeof(DrawData),
+                                                                 .type = BufferType::GPU});
+
+    culledShadowOpaqueDrawIndirectCommandsBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Culled Shadow Opaque Draw Indirect Commands Buffer",
+                                        .size = maxDrawIndirectCommands * sizeof(VkDrawIndexedIndirectCommand),
+                                        .type = BufferType::GPU_INDIRECT});
+
+    culledShadowTransparentDrawIndirectCommandsBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Culled Shadow Transparent Draw Indirect Commands Buffer",
+                                        .size = maxDrawIndirectCommands * sizeof(VkDrawIndexedIndirectCommand),
+                                        .type = BufferType::GPU_INDIRECT});
+
+    culledShadowOpaqueDrawDataBuffer =
+            std::make_unique<Buffer>(device, BufferSpecification{.name = "Culled Shadow Opaque Draw Data Buffer",
+                                                                 .size = maxDrawIndirectCommands * sizeof(DrawData),
+                                                                 .type = BufferType::GPU});
+
+    culledShadowTransparentDrawDataBuffer =
+            std::make_unique<Buffer>(device, BufferSpecification{.name = "Culled Shadow Transparent Draw Data Buffer",
+                                                                 .size = maxDrawIndirectCommands * sizeof(DrawData),
+                                                                 .type = BufferType::GPU});
+
+    // NOTE: Cleared with vkCmdFillBuffer before every culling pass
+    drawCountsBuffer = std::make_unique<Buffer>(
+            device, BufferSpecification{.name = "Draw Counts Buffer",
+                                        .size = shadowTransparentDrawCountsOffset + 2 * sizeof(uint32_t),
+                                        .type = BufferType::GPU_INDIRECT});
+
+    drawVisibilityBuffer =
+            std::make_unique<Buffer>(device, BufferSpecification{.name = "Draw Visibility Buffer",
+                                                                 .size = maxDrawIndirectCommands * sizeof(uint32_t),
+                                                                 .type = BufferType::GPU});
+
+    // NOTE: Read by the vertex shaders to dequantize positions
     meshesBuffer = std::make_unique<Buffer>(
-            device, BufferSpecification{.name = "Meshes Buffer", .size = maxMeshes * sizeof(DrawData), .type = BufferType::GPU});
+            device, BufferSpecification{.name = "Meshes Buffer",
+                                        .size = std::max<size_t>(meshes.size(), 1) * sizeof(Mesh),
+                                        .type = BufferType::GPU});
+
+    // NOTE: Meshlets and levels of detail never change after loading, so they are uploaded once
+    meshletsBuffer = CreateStaticBuffer("Meshlets Buffer", std::span<const Meshlet>(meshlets));
+    meshLodsBuffer = CreateStaticBuffer("Mesh LODs Buffer", std::span<const MeshLod>(meshLods));
+}
+
+template<typename T>
+std::unique_ptr<Buffer> Scene::CreateStaticBuffer(const std::string &name, std::span<const T> data,
+                                                  BufferType type) const {
+    const VkDeviceSize size = std::max<size_t>(data.size(), 1) * sizeof(T);
+    auto buffer = std::make_unique<Buffer>(device, BufferSpecification{.name = name, .size = size, .type = type});
+    if (!data.empty()) {
+        const auto stagingBuffer = std::make_unique<Buffer>(
+                device,
+                BufferSpecification{.name = name + " Staging Buffer", .size = size, .type = BufferType::STAGING});
+        stagingBuffer->From(data.data(), data.size_bytes());
+        buffer->FromBuffer(stagingBuffer.get());
+        stagingBuffer->Destroy();
+    }
+    return buffer;
+}
+
+size_t Scene::GetMaxDrawCount() const {
+    // NOTE: Every mesh is drawn at most once, all the nodes that reference it are instances of that draw
+    size_t drawCount = 0;
+    for (const Mesh &mesh: meshes) {
+        drawCount += std::max<size_t>(mesh.meshletCount, 1);
+    }
+    return drawCount;
+}
+
+size_t Scene::GetMaxInstanceCount() const {
+    size_t instanceCount = 0;
+    for (const NodeMeshes &drawnMeshes: nodeMeshes) {
+        instanceCount += drawnMeshes.meshCount;
+    }
+    return instanceCount;
+}
+
+Camera::GPUData Scene::GetShadowView() const {
+    const Light &light = lights.at(shadowLightIndex);
+    return {
+            .view = light.view,
+            .proj = light.proj,
+            .position = glm::vec3(glm::inverse(light.view)[3]),
+            .frustumPlanes = Frustum::FromMatrix(light.proj * light.view).planes,
+    };
 }
@@ -1,13 +1,20 @@
 #pragma once
 
+#include <functional>
+#include <span>
+
 #include "Vulkan/Buffer.h"
 #include "Vulkan/VulkanTexture.h"
 
+#include "BVH.h"
 #include "Camera.h"
+#include "SceneHierarchy.h"
 
 
 class GPUDataUploader;
 class DebugDraw;
+class JobSystem;
+class SceneCache;
 
 struct AABB {
     glm::vec3 min;
@@ -18,19 +25,52 @@ class Scene {
 public:
     enum AlphaMode { OPAQUE, MASK, BLEND };
 
+    // Quantized vertex, split into streams so depth only passes fetch nothing but positions. Vertex colors live in
+    // their own stream since most scenes don't have any
+    // NOTE: The shaders pull these through buffer addresses, the unpacking lives in common.glsl
+    struct VertexPosition {
+        uint16_t position[4]{}; // R16G16B16A16_UNORM inside the mesh's bounding box, w is unused
+    };
+    static_assert(sizeof(VertexPosition) == 8);
+
     struct Vertex {
-        glm::vec3 pos;
-        glm::vec3 normal;
-        glm::vec3 color;
-        glm::vec2 texCoord0;
-        glm::vec2 texCoord1;
+        uint32_t normal{0}; // R16G16_SNORM, octahedral encoded
+        uint32_t texCoord0{0}; // R16G16_SFLOAT
+        uint32_t texCoord1{0}; // R16G16_SFLOAT
+    };
+    static_assert(sizeof(Vertex) == 12);
+
+    // Cluster of up to 64 vertices and 124 triangles, a contiguous range of the index buffer
+    struct Meshlet {
+        glm::vec4 boundingSphere{}; // xyz center, w radius, in mesh space
+        glm::vec4 cone{0.0f, 0.0f, 0.0f, 1.0f}; // xyz axis, w cutoff. A cutoff of 1 never culls
+        uint32_t firstIndex{0};
+        uint32_t indexCount{0};
+    };
+
+    // Index range of one level of detail, the levels of a mesh share its vertices
+    struct MeshLod {
+        uint32_t firstIndex{0};
+        uint32_t indexCount{0};
+        // Quadric error of the simplification, the square root of the costliest collapse summed over the levels up to
+        // this one, in mesh space. SelectLod in frustumCulling.comp projects it to pixels
+        float error{0.0f};
     };
 
     struct Mesh {
         uint32_t firstIndex{0};
         uint32_t indexCount{0};
         int32_t materialIndex{-1};
-        AABB boundingBox{};
+        uint32_t firstMeshlet{0};
+        uint32_t meshletCount{0};
+        uint32_t firstLod{0};
+        uint32_t lodCount{0}; // Level 0 is the full mesh, meshes without levels are always drawn in full
+        uint32_t vertexOffset{0}; // The indices are relative to this vertex, draws pass it as vertexOffset
+        uint32_t vertexCount{0};
+        AABB boundingBox{}; // Also the quantization range of the mesh's vertex positions
+
+        // Meshes with fewer than 65536 vertices store their indices, levels and meshlets in the 16-bit index pool
+        [[nodiscard]] bool UsesShortIndices() const { return vertexCount <= std::numeric_limits<uint16_t>::max(); }
     };
 
     struct Material {
@@ -54,20 +94,14 @@ public:
     };
 
     struct Texture {
-        int32_t imageIndex;
+        int32_t imageIndex{-1};
+        int32_t samplerIndex{-1};
     };
 
-    struct Node {
-        Node *parent;
-        std::vector<Node *> children;
-        std::vector<uint32_t> meshIndices;
-        uint32_t modelMatrixIndex{0};
-
-        ~Node() {
-            for (const auto &child: children) {
-                delete child;
-            }
-        }
+    // Meshes drawn with a node's world transform, the node's index is also its model matrix index
+    struct NodeMeshes {
+        uint32_t firstMesh{0};
+        uint32_t meshCount{0};
     };
 
     struct Light {
@@ -82,22 +116,44 @@ public:
         Type type{};
     };
 
+    static constexpr uint32_t noMeshlet = std::numeric_limits<uint32_t>::max();
+
     struct DrawData {
         uint32_t modelMatrixIndex{0};
         uint32_t materialIndex{0};
+        uint32_t meshIndex{0};
+        uint32_t meshletIndex{noMeshlet}; // Only set when the draw covers a single meshlet
         AABB boundingBox{};
     };
 
     Scene() = default;
     Scene(std::shared_ptr<VulkanDevice> device, const std::filesystem::path &scenePath,
-          std::shared_ptr<TextureCube> skyboxTexture, DebugDraw &debugDraw);
+          std::shared_ptr<TextureCube> skyboxTexture, DebugDraw &debugDraw, JobSystem &jobSystem);
     void Destroy();
 
-    void Draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+    // Occlusion culling draws the scene in two phases: the early one draws the opaque draws that were visible last
+    // frame, the late one the newly visible opaque draws and the transparent draws
+    enum class DrawPhase { Early, Late };
+    void Draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, DrawPhase phase) const;
     void DrawSkybox(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout);
     void DrawShadowMap(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
 
-    void GenerateDrawCommands(DebugDraw &debugDraw, bool frustumCulling = false);
+    // Every mesh is one draw with an instance per node that uses it. With meshletDraws opaque meshes with a single
+    // instance are drawn per meshlet, so the culling pass can cull the meshlets
+    void GenerateDrawCommands(DebugDraw &debugDraw, bool frustumCulling = false, bool meshletDraws = false);
+    // Updates the world transforms and bounds of changed nodes across the jobs. Whatever is left is updated serially
+    // by GenerateDrawCommands. With validate, a parallel update that isn't bit-identical to the serial one is logged
+    void UpdateTransforms(JobSystem &jobSystem, bool validate = false);
+
+    struct RayHit {
+        uint32_t node;
+        uint32_t meshIndex;
+        float distance;
+        AABB bounds; // World space bounds of the mesh that was hit
+    };
+    // Closest mesh whose world bounds the ray enters, as of the last GenerateDrawCommands
+    [[nodiscard]] std::optional<RayHit> RayCast(const glm::vec3 &origin, const glm::vec3 &direction,
+                                                float maxDistance = std::numeric_limits<float>::max()) const;
 
     void UploadToGPU(GPUDataUploader& uploader);
 
@@ -110,36 +166,111 @@ public:
     Material defaultMaterial;
 
 private:
-    void DrawNode(Node *node, DebugDraw &debugDraw, bool frustumCulling = true);
+    // Attaches a box for every mesh of every node to the hierarchy, they are culled as one batch each frame
+    void CreateCullingBounds();
+    // Upper bound of the draws GenerateDrawCommands emits
+    [[nodiscard]] size_t GetMaxDrawCount() const;
+    // Upper bound of the instances of all draws, every mesh of every node is one
+    [[nodiscard]] size_t GetMaxInstanceCount() const;
+    // The shadow map's light seen as a camera, so the culling pass can cull against its frustum
+    [[nodiscard]] Camera::GPUData GetShadowView() const;
+
+    // Emits the draws of the mesh's instances collected in meshInstances
+    void AddMeshDraws(uint32_t meshIndex, bool meshletDraws);
+    // Draws the 16-bit index commands, then the 32-bit ones. pushDrawData receives the draw data of each batch's
+    // first draw, since gl_DrawID starts at 0 again for every call. With a drawCountsBuffer the batches are drawn
+    // with the two counts at drawCountsOffset, drawCount and shortDrawCount only bound them
+    void DrawIndexedBatches(VkCommandBuffer commandBuffer, const Buffer &commandsBuffer, const Buffer &drawDataBuffer,
+                            size_t drawCount, size_t shortDrawCount, const Buffer *drawCountsBuffer,
+                            VkDeviceSize drawCountsOffset,
+                            const std::function<void(VkDeviceAddress)> &pushDrawData) const;
+
+    // GPU buffer filled once from the data, at least one element large so it always has an address
+    template<typename T>
+    [[nodiscard]] std::unique_ptr<Buffer> CreateStaticBuffer(const std::string &name, std::span<const T> data,
+                                                             BufferType type = BufferType::GPU) const;
+
+    void CreateIndexBuffers(std::span<const uint32_t> indices, std::span<const uint16_t> shortIndices);
+    void CreateVertexBuffers(std::span<const VertexPosition> positions, std::span<const Vertex> vertices);
+    // An empty span gives a single white color that is repeated for every vertex
+    void CreateColorBuffer(std::span<const uint32_t> colors);
+    void CreateSkyboxVertexBuffer();
+
+    // Encoded image, either kept by the glTF loader or read back through the scene cache
+    struct ImageSource {
+        std::string name;
+        bool generateMipMaps{false};
+        std::vector<unsigned char> encoded;
+        std::filesystem::path path; // read by the decode task when there are no encoded bytes
+    };
 
-    void CreateIndexBuffer(std::vector<uint32_t> &indices);
-    void CreateVertexBuffer(std::vector<Vertex> &vertices);
+    // Parses the glTF file and bakes the result into the cache
+    void LoadFromGLTF(const std::filesystem::path &scenePath, const SceneCache &cache, JobSystem &jobSystem);
+    void LoadFromCache(const SceneCache &cache, JobSystem &jobSystem);
+    void SaveCache(const SceneCache &cache, const tinygltf::Model &input, const std::vector<ImageSource> &imageSources,
+                   std::span<const VertexPosition> positions, std::span<const Vertex> vertices,
+                   std::span<const uint32_t> colors, std::span<const uint32_t> indices,
+                   std::span<const uint16_t> shortIndices) const;
 
-    void LoadImages(tinygltf::Model &input);
+    // Images are decoded on the job system, then uploaded in batches
+    void LoadImages(std::vector<ImageSource> &imageSources, JobSystem &jobSystem);
     void LoadTextures(tinygltf::Model &input);
+    void ApplyTextureSamplers();
     void LoadTextureSamplers(tinygltf::Model &input);
     void LoadMaterials(tinygltf::Model &input);
 
-    void LoadNode(const tinygltf::Model &input, const tinygltf::Node &inputNode, Node *parent,
-                  std::vector<Vertex> &vertexBuffer, std::vector<uint32_t> &indexBuffer);
+    // loadedMeshes maps glTF meshes to the meshes already loaded for them, so nodes reuse the geometry
+    void LoadNode(const tinygltf::Model &input, const tinygltf::Node &inputNode, int32_t parent,
+                  std::vector<VertexPosition> &positionStream, std::vector<Vertex> &vertexBuffer,
+                  std::vector<uint32_t> &colorStream, std::vector<uint32_t> &indexBuffer,
+                  std::vector<uint16_t> &shortIndexBuffer, std::unordered_map<int, NodeMeshes> &loadedMeshes);
+    // Loads every primitive as a mesh and returns their range. The mesh's indices go to either index pool
+    NodeMeshes LoadMesh(const tinygltf::Model &input, const tinygltf::Mesh &inputMesh,
+                        std::vector<VertexPosition> &positionStream, std::vector<Vertex> &vertexBuffer,
+                        std::vector<uint32_t> &colorStream, std::vector<uint32_t> &indexBuffer,
+                        std::vector<uint16_t> &shortIndexBuffer);
 
     void CreateLights();
     void CreateBuffers();
 
+    // Node and mesh of every box culled each frame, the hierarchy keeps their world bounds
+    BVH bvh; // Over the hierarchy's world bounds, built on the first frame and refit when they change
+    std::vector<uint32_t> cullingMatrixIndices;
+    std::vector<uint32_t> cullingMeshIndices;
+    std::vector<uint64_t> cullingVisibility; // One bit per box, set when it is inside the frustum
+    // Mesh and meshlet of every opaque draw as of the last GenerateDrawCommands
+    std::vector<std::pair<uint32_t, uint32_t>> opaqueDrawKeys;
+
+    // Nodes that draw a mesh this frame, collected from the culled boxes
+    struct MeshInstances {
+        std::vector<uint32_t> modelMatrixIndices;
+        AABB bounds{}; // Union of the world space bounds of the instances
+    };
+    std::vector<MeshInstances> meshInstances;
+
 public:
     std::vector<Material> materials;
-    std::vector<Node *> nodes;
+    SceneHierarchy hierarchy;
+    std::vector<NodeMeshes> nodeMeshes; // Indexed like the hierarchy's nodes
     std::vector<Mesh> meshes;
-    std::vector<glm::mat4> localModelMatrices;
-    std::vector<glm::mat4> globalModelMatrices;
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshLod> meshLods;
     std::vector<DrawData> opaqueDrawData;
     std::vector<DrawData> transparentDrawData;
+    std::vector<uint32_t> instanceModelMatrixIndices; // Indexed by gl_InstanceIndex
 
     std::vector<VkDrawIndexedIndirectCommand> opaqueDrawIndirectCommands;
     std::vector<VkDrawIndexedIndirectCommand> transparentDrawIndirectCommands;
+    // The commands of meshes with 16-bit indices come first
+    size_t opaqueShortDrawCount{0};
+    size_t transparentShortDrawCount{0};
 
+    std::unique_ptr<Buffer> positionsBuffer; // The only stream read by depth only passes
     std::unique_ptr<Buffer> vertexBuffer;
+    std::unique_ptr<Buffer> colorBuffer; // RGBA8 per vertex, or a single color when hasVertexColors is false
     std::unique_ptr<Buffer> indexBuffer;
+    std::unique_ptr<Buffer> shortIndexBuffer; // 16-bit indices of the meshes with fewer than 65536 vertices
+    bool hasVertexColors{false};
 
     std::shared_ptr<TextureCube> skyboxTexture;
     std::unique_ptr<Buffer> skyboxVertexBuffer;
@@ -147,18 +278,50 @@ public:
     std::unique_ptr<Buffer> materialsBuffer;
     std::unique_ptr<Buffer> lightsBuffer;
     std::unique_ptr<Buffer> camerasBuffer;
-    std::unique_ptr<Buffer> modelMatricesBuffer; // Global
+    std::unique_ptr<Buffer> shadowViewsBuffer; // Camera::GPUData of the shadow map's light
+    std::unique_ptr<Buffer> modelMatricesBuffer; // World transforms of the hierarchy's nodes
+    bool modelMatricesChanged{true}; // Only uploaded again after a transform changed
+    bool worldBoundsChanged{true}; // The BVH is refit before the next culling
+    std::unique_ptr<Buffer> instancesBuffer;
 
     std::unique_ptr<Buffer> opaqueDrawIndirectCommandsBuffer;
     std::unique_ptr<Buffer> transparentDrawIndirectCommandsBuffer;
     std::unique_ptr<Buffer> opaqueDrawDataBuffer;
     std::unique_ptr<Buffer> transparentDrawDataBuffer;
 
+    // Written by the culling pass, which compacts the visible draws of each batch to the start of its range.
+    // drawCountsBuffer holds the visible 16-bit and 32-bit index draws of the early opaque list, the transparent list,
+    // the late opaque list and the two shadow lists. Both opaque phases write the same culled buffers, the late one
+    // after the early draws
+    std::unique_ptr<Buffer> culledOpaqueDrawIndirectCommandsBuffer;
+    std::unique_ptr<Buffer> culledTransparentDrawIndirectCommandsBuffer;
+    std::unique_ptr<Buffer> culledOpaqueDrawDataBuffer;
+    std::unique_ptr<Buffer> culledTransparentDrawDataBuffer;
+    std::unique_ptr<Buffer> drawCountsBuffer;
+    static constexpr VkDeviceSize earlyOpaqueDrawCountsOffset = 0;
+    static constexpr VkDeviceSize transparentDrawCountsOffset = 2 * sizeof(uint32_t);
+    static constexpr VkDeviceSize lateOpaqueDrawCountsOffset = 4 * sizeof(uint32_t);
+    static constexpr VkDeviceSize shadowOpaqueDrawCountsOffset = 6 * sizeof(uint32_t);
+    static constexpr VkDeviceSize shadowTransparentDrawCountsOffset = 8 * sizeof(uint32_t);
+    // The shadow pass draws the opaque and transparent lists culled against the light's frustum
+    std::unique_ptr<Buffer> culledShadowOpaqueDrawIndirectCommandsBuffer;
+    std::unique_ptr<Buffer> culledShadowTransparentDrawIndirectCommandsBuffer;
+    std::unique_ptr<Buffer> culledShadowOpaqueDrawDataBuffer;
+    std::unique_ptr<Buffer> culledShadowTransparentDrawDataBuffer;
+    // One uint per opaque draw, set by the late culling pass when the draw is visible and read by the next frame
+    std::unique_ptr<Buffer> drawVisibilityBuffer;
+    // Set when drawVisibilityBuffer has to be cleared before the next culling pass: it starts out uninitialized and
+    // its entries belong to other draws once the opaque draws change slots
+    bool drawVisibilityInvalid{true};
+
     std::unique_ptr<Buffer> meshesBuffer;
+    std::unique_ptr<Buffer> meshletsBuffer;
+    std::unique_ptr<Buffer> meshLodsBuffer;
 
     std::filesystem::path resourcePath;
 
     std::vector<Light> lights;
+    static constexpr int32_t shadowLightIndex = 0; // The directional light that casts the shadow map
 
     std::vector<Camera> cameras;
     std::vector<Camera::GPUData> cameraDatas;
@@ -0,0 +1,216 @@
+#include "pch.h"
+
+#include "SceneCache.h"
+#include "Vulkan/DebugMarkers.h"
+#include "Vulkan/Utils.h"
+
+namespace {
+    constexpr uint32_t sceneCacheMagic = 0x43534C56; // "VLSC"
+    constexpr uint64_t sectionAlignment = 16;
+
+    int64_t GetWriteTime(const std::filesystem::path &path) {
+        return std::filesystem::last_write_time(path).time_since_epoch().count();
+    }
+
+    // Appends the values to the file and returns where they were written
+    template<typename T>
+    std::pair<uint64_t, uint64_t> AppendSection(std::vector<char> &file, std::span<const T> values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        file.resize((file.size() + sectionAlignment - 1) / sectionAlignment * sectionAlignment);
+        const uint64_t offset = file.size();
+        const auto bytes = reinterpret_cast<const char *>(values.data());
+        file.insert(file.end(), bytes, bytes + values.size_bytes());
+        return {offset, values.size_bytes()};
+    }
+} // namespace
+
+SceneCache::SceneCache(const std::filesystem::path &scenePath) : scenePath(scenePath) {
+    cachePath = scenePath;
+    cachePath += ".scenecache";
+
+    // NOTE: For .gltf files only the JSON is hashed, the buffers and images are checked by size and write time
+    const MappedFile sceneFile(scenePath);
+    const std::span<const std::byte> sceneData = sceneFile.GetData();
+    sourceHash = HashData(sceneData.data(), sceneData.size());
+}
+
+template<typename T>
+std::span<const T> SceneCache::GetSection(const Header &header, Section section) const {
+    static_assert(std::is_trivially_copyable_v<T> && alignof(T) <= sectionAlignment);
+    const SectionRange &range = header.sections[section];
+    if (range.size % sizeof(T) != 0) {
+        throw std::runtime_error("Section size mismatch!");
+    }
+    // NOTE: Sections are aligned in the file and the mapping is page aligned, so the data is read in place
+    return {reinterpret_cast<const T *>(file.GetData().data() + range.offset), range.size / sizeof(T)};
+}
+
+bool SceneCache::Load() {
+    DebugMarkers::ScopedMarker marker("SceneCache::Load");
+    if (!std::filesystem::exists(cachePath)) {
+        return false;
+    }
+
+    try {
+        file = MappedFile(cachePath);
+        const std::span<const std::byte> data = file.GetData();
+        if (data.size() < sizeof(Header)) {
+            throw std::runtime_error("Missing header!");
+        }
+
+        Header header;
+        std::memcpy(&header, data.data(), sizeof(Header));
+        const Header expected = CreateHeader();
+        if (header.magic != expected.magic || header.version != expected.version ||
+            header.sourceHash != expected.sourceHash || header.fileSize != data.size() ||
+            header.vertexSize != expected.vertexSize || header.meshSize != expected.meshSize ||
+            header.materialSize != expected.materialSize || header.positionSize != expected.positionSize ||
+            header.meshletSize != expected.meshletSize || header.meshLodSize != expected.meshLodSize) {
+            throw std::runtime_error("Header mismatch!");
+        }
+        for (const SectionRange &section: header.sections) {
+            if (section.offset % sectionAlignment != 0 || section.offset > data.size() ||
+                section.size > data.size() - section.offset) {
+                throw std::runtime_error("Section out of range!");
+            }
+        }
+
+        const auto strings = GetSection<char>(header, Strings);
+        const auto getString = [&strings](const StringRange &range) {
+            if (range.offset > strings.size() || range.size > strings.size() - range.offset) {
+                throw std::runtime_error("String out of range!");
+            }
+            return std::string_view(strings.data() + range.offset, range.size);
+        };
+
+        // Any referenced file that changed invalidates the whole cache
+        for (const CachedDependency &dependency: GetSection<CachedDependency>(header, Dependencies)) {
+            if (!IsDependencyUnchanged(getString(dependency.path), dependency.fileSize, dependency.writeTime)) {
+                throw std::runtime_error("Dependency changed!");
+            }
+        }
+
+        const auto imageData = GetSection<unsigned char>(header, ImageData);
+        contents = {
+                .positions = GetSection<Scene::VertexPosition>(header, Positions),
+                .vertices = GetSection<Scene::Vertex>(header, Vertices),
+                .colors = GetSection<uint32_t>(header, Colors),
+                .indices = GetSection<uint32_t>(header, Indices),
+                .shortIndices = GetSection<uint16_t>(header, ShortIndices),
+                .meshes = GetSection<Scene::Mesh>(header, Meshes),
+                .meshlets = GetSection<Scene::Meshlet>(header, Meshlets),
+                .meshLods = GetSection<Scene::MeshLod>(header, MeshLods),
+                .materials = GetSection<Scene::Material>(header, Materials),
+                .localModelMatrices = GetSection<glm::mat4>(header, LocalModelMatrices),
+                .nodes = GetSection<Node>(header, Nodes),
+                .samplers = GetSection<TextureSampler>(header, Samplers),
+                .textures = GetSection<Scene::Texture>(header, Textures),
+        };
+        for (const CachedImage &image: GetSection<CachedImage>(header, Images)) {
+            if (image.dataOffset > imageData.size() || image.dataSize > imageData.size() - image.dataOffset) {
+                throw std::runtime_error("Image out of range!");
+            }
+            contents.images.push_back({.name = getString(image.name),
+                                       .path = getString(image.path),
+                                       .encoded = imageData.subspan(image.dataOffset, image.dataSize),
+                                       .generateMipMaps = image.generateMipMaps != 0});
+        }
+    } catch (const std::runtime_error &) {
+        std::cout << "Scene cache " << cachePath.string() << " is stale, rebuilding it" << std::endl;
+        contents = {};
+        file = {};
+        return false;
+    }
+
+    return true;
+}
+
+void SceneCache::Save(const Contents &sceneContents) const {
+    DebugMarkers::ScopedMarker marker("SceneCache::Save");
+    std::vector<char> strings;
+    const auto addString = [&strings](std::string_view string) {
+        const StringRange range{.offset = strings.size(), .size = string.size()};
+        strings.insert(strings.end(), string.begin(), string.end());
+        return range;
+    };
+
+    std::vector<unsigned char> imageData;
+    std::vector<CachedImage> images;
+    images.reserve(sceneContents.images.size());
+    for (const Image &image: sceneContents.images) {
+        images.push_back({.name = addString(image.name),
+                          .path = addString(image.path),
+                          .dataOffset = imageData.size(),
+                          .dataSize = image.encoded.size(),
+                          .generateMipMaps = image.generateMipMaps});
+        imageData.insert(imageData.end(), image.encoded.begin(), image.encoded.end());
+    }
+
+    std::vector<CachedDependency> dependencies;
+    dependencies.reserve(sceneContents.dependencies.size());
+    for (const std::string &dependency: sceneContents.dependencies) {
+        const std::filesystem::path path = scenePath.parent_path() / dependency;
+        dependencies.push_back({.path = addString(dependency),
+                                .fileSize = std::filesystem::file_size(path),
+                                .writeTime = GetWriteTime(path)});
+    }
+
+    std::vector<char> data(sizeof(Header));
+    data.reserve(sizeof(Header) + SectionCount * sectionAlignment + sceneContents.positions.size_bytes() +
+                 sceneContents.vertices.size_bytes() + sceneContents.colors.size_bytes() +
+                 sceneContents.indices.size_bytes() + sceneContents.shortIndices.size_bytes() +
+                 sceneContents.meshes.size_bytes() + sceneContents.meshlets.size_bytes() +
+                 sceneContents.meshLods.size_bytes() + sceneContents.materials.size_bytes() +
+                 sceneContents.localModelMatrices.size_bytes() + sceneContents.nodes.size_bytes() + imageData.size());
+
+    Header header = CreateHeader();
+    const auto store = [&]<typename T>(Section section, std::span<const T> values) {
+        const auto [offset, size] = AppendSection(data, values);
+        header.sections[section] = {.offset = offset, .size = size};
+    };
+    store(Positions, sceneContents.positions);
+    store(Vertices, sceneContents.vertices);
+    store(Colors, sceneContents.colors);
+    store(Indices, sceneContents.indices);
+    store(ShortIndices, sceneContents.shortIndices);
+    store(Meshes, sceneContents.meshes);
+    store(Meshlets, sceneContents.meshlets);
+    store(MeshLods, sceneContents.meshLods);
+    store(Materials, sceneContents.materials);
+    store(LocalModelMatrices, sceneContents.localModelMatrices);
+    store(Nodes, sceneContents.nodes);
+    store(Samplers, sceneContents.samplers);
+    store(Textures, sceneContents.textures);
+    store(Images, std::span<const CachedImage>(images));
+    store(Dependencies, std::span<const CachedDependency>(dependencies));
+    store(Strings, std::span<const char>(strings));
+    store(ImageData, std::span<const unsigned char>(imageData));
+
+    header.fileSize = data.size();
+    std::memcpy(data.data(), &header, sizeof(Header));
+    WriteFileAtomic(cachePath, data);
+}
+
+SceneCache::Header SceneCache::CreateHeader() const {
+    return {
+            .magic = sceneCacheMagic,
+            .version = loaderVersion,
+            .sourceHash = sourceHash,
+            .vertexSize = sizeof(Scene::Vertex),
+            .meshSize = sizeof(Scene::Mesh),
+            .materialSize = sizeof(Scene::Material),
+            .positionSize = sizeof(Scene::VertexPosition),
+            .meshletSize = sizeof(Scene::Meshlet),
+            .meshLodSize = sizeof(Scene::MeshLod),
+    };
+}
+
+bool SceneCache::IsDependencyUnchanged(std::string_view path, uint64_t fileSize, int64_t writeTime) const {
+    std::error_code error;
+    const std::filesystem::path fullPath = scenePath.parent_path() / path;
+    if (std::filesystem::file_size(fullPath, error) != fileSize || error) {
+        return false;
+    }
+    const auto fileWriteTime = std::filesystem::last_write_time(fullPath, error);
+    return !error && fileWriteTime.time_since_epoch().count() == writeTime;
+}
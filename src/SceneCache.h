@@ -0,0 +1,135 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+
+#include "MappedFile.h"
+#include "Scene.h"
+
+// Binary snapshot of everything Scene builds from a glTF file, written next to it. Every array is stored raw, 16 byte
+// aligned, so the mapped file is read in place and vertices/indices are copied straight into staging memory. The cache
+// is invalidated by the hash of the scene file, the files it references and the loader version.
+class SceneCache {
+public:
+    // Node of the SceneHierarchy with the meshes it draws, parents are always stored before their children
+    struct Node {
+        int32_t parent{-1};
+        uint32_t modelMatrixIndex{0};
+        uint32_t firstMeshIndex{0};
+        uint32_t meshCount{0};
+    };
+
+    struct Image {
+        std::string_view name;
+        std::string_view path; // relative to the scene, empty for images embedded in the scene
+        std::span<const unsigned char> encoded; // only set for embedded images
+        bool generateMipMaps{false};
+    };
+
+    // Views into either the mapped cache or the data of the scene being baked
+    struct Contents {
+        std::span<const Scene::VertexPosition> positions;
+        std::span<const Scene::Vertex> vertices;
+        std::span<const uint32_t> colors; // empty when the scene has no vertex colors
+        std::span<const uint32_t> indices;
+        std::span<const uint16_t> shortIndices; // of the meshes with fewer than 65536 vertices
+        std::span<const Scene::Mesh> meshes;
+        std::span<const Scene::Meshlet> meshlets;
+        std::span<const Scene::MeshLod> meshLods;
+        std::span<const Scene::Material> materials;
+        std::span<const glm::mat4> localModelMatrices;
+        std::span<const Node> nodes;
+        std::span<const TextureSampler> samplers;
+        std::span<const Scene::Texture> textures;
+        std::vector<Image> images;
+        std::vector<std::string> dependencies; // other files the scene was built from, relative to the scene
+    };
+
+    explicit SceneCache(const std::filesystem::path &scenePath);
+
+    // Maps the cache, returns false if it's missing or stale
+    bool Load();
+    void Save(const Contents &sceneContents) const;
+
+    // NOTE: Points into the mapped file, only valid while this object is alive
+    [[nodiscard]] const Contents &GetContents() const { return contents; }
+
+private:
+    enum Section : uint32_t {
+        Positions,
+        Vertices,
+        Colors,
+        Indices,
+        ShortIndices,
+        Meshes,
+        Meshlets,
+        MeshLods,
+        Materials,
+        LocalModelMatrices,
+        Nodes,
+        Samplers,
+        Textures,
+        Images,
+        Dependencies,
+        Strings,
+        ImageData,
+        SectionCount
+    };
+
+    struct SectionRange {
+        uint64_t offset{0}; // bytes from the start of the file
+        uint64_t size{0}; // bytes
+    };
+
+    struct Header {
+        uint32_t magic{0};
+        uint32_t version{0};
+        uint64_t sourceHash{0};
+        uint64_t fileSize{0};
+        // NOTE: Catches layout changes of the stored structs even if the version wasn't bumped
+        uint32_t vertexSize{0};
+        uint32_t meshSize{0};
+        uint32_t materialSize{0};
+        uint32_t positionSize{0};
+        uint32_t meshletSize{0};
+        uint32_t meshLodSize{0};
+        SectionRange sections[SectionCount]{};
+    };
+
+    // Offsets into the Strings section
+    struct StringRange {
+        uint64_t offset{0};
+        uint64_t size{0};
+    };
+
+    struct CachedImage {
+        StringRange name;
+        StringRange path;
+        uint64_t dataOffset{0}; // into the ImageData section
+        uint64_t dataSize{0};
+        uint32_t generateMipMaps{0};
+        uint32_t padding{0};
+    };
+
+    struct CachedDependency {
+        StringRange path;
+        uint64_t fileSize{0};
+        int64_t writeTime{0};
+    };
+
+    [[nodiscard]] Header CreateHeader() const;
+    [[nodiscard]] bool IsDependencyUnchanged(std::string_view path, uint64_t fileSize, int64_t writeTime) const;
+
+    template<typename T>
+    [[nodiscard]] std::span<const T> GetSection(const Header &header, Section section) const;
+
+    // NOTE: Bump whenever Scene's loading output or the file layout changes
+    static constexpr uint32_t loaderVersion = 8;
+
+    std::filesystem::path scenePath;
+    std::filesystem::path cachePath;
+    uint64_t sourceHash{0};
+
+    MappedFile file;
+    Contents contents;
+};
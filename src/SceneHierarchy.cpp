@@ -0,0 +1,218 @@
+#include "pch.h"
+
+#include "SceneHierarchy.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#define SCENE_HIERARCHY_SSE
+#endif
+
+namespace {
+#ifdef SCENE_HIERARCHY_SSE
+    // a * (x, y, z, w) with the products summed left to right, like the scalar version
+    inline __m128 TransformColumn(const glm::mat4 &a, __m128 x, __m128 y, __m128 z, __m128 w) {
+        const __m128 xy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&a[0][0]), x), _mm_mul_ps(_mm_loadu_ps(&a[1][0]), y));
+        const __m128 xyz = _mm_add_ps(xy, _mm_mul_ps(_mm_loadu_ps(&a[2][0]), z));
+        return _mm_add_ps(xyz, _mm_mul_ps(_mm_loadu_ps(&a[3][0]), w));
+    }
+#endif
+
+    glm::mat4 MultiplyTransforms(const glm::mat4 &a, const glm::mat4 &b) {
+        glm::mat4 result;
+#ifdef SCENE_HIERARCHY_SSE
+        for (int column = 0; column < 4; column++) {
+            const __m128 bColumn = _mm_loadu_ps(&b[column][0]);
+            const __m128 x = _mm_shuffle_ps(bColumn, bColumn, _MM_SHUFFLE(0, 0, 0, 0));
+            const __m128 y = _mm_shuffle_ps(bColumn, bColumn, _MM_SHUFFLE(1, 1, 1, 1));
+            const __m128 z = _mm_shuffle_ps(bColumn, bColumn, _MM_SHUFFLE(2, 2, 2, 2));
+            const __m128 w = _mm_shuffle_ps(bColumn, bColumn, _MM_SHUFFLE(3, 3, 3, 3));
+            _mm_storeu_ps(&result[column][0], TransformColumn(a, x, y, z, w));
+        }
+#else
+        for (int column = 0; column < 4; column++) {
+            result[column] = a[0] * b[column].x + a[1] * b[column].y + a[2] * b[column].z + a[3] * b[column].w;
+        }
+#endif
+        return result;
+    }
+
+    // World center is M * (c, 1) and world extent |M| * e with the upper 3x3 of the matrix
+    void TransformBounds(const glm::mat4 &matrix, const AABBArrays &localBounds, size_t index,
+                         AABBArrays &worldBounds) {
+        const float cx = localBounds.centerX[index], cy = localBounds.centerY[index], cz = localBounds.centerZ[index];
+        const float ex = localBounds.extentX[index], ey = localBounds.extentY[index], ez = localBounds.extentZ[index];
+#ifdef SCENE_HIERARCHY_SSE
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        const auto absColumn = [&](int column) { return _mm_and_ps(_mm_loadu_ps(&matrix[column][0]), signMask); };
+        alignas(16) float center[4];
+        alignas(16) float extent[4];
+        _mm_store_ps(center, TransformColumn(matrix, _mm_set1_ps(cx), _mm_set1_ps(cy), _mm_set1_ps(cz),
+                                             _mm_set1_ps(1.0f)));
+        const __m128 extentXY = _mm_add_ps(_mm_mul_ps(absColumn(0), _mm_set1_ps(ex)),
+                                           _mm_mul_ps(absColumn(1), _mm_set1_ps(ey)));
+        _mm_store_ps(extent, _mm_add_ps(extentXY, _mm_mul_ps(absColumn(2), _mm_set1_ps(ez))));
+#else
+        const glm::vec4 center = matrix[0] * cx + matrix[1] * cy + matrix[2] * cz + matrix[3];
+        const glm::vec4 extent = glm::abs(matrix[0]) * ex + glm::abs(matrix[1]) * ey + glm::abs(matrix[2]) * ez;
+#endif
+        worldBounds.centerX[index] = center[0];
+        worldBounds.centerY[index] = center[1];
+        worldBounds.centerZ[index] = center[2];
+        worldBounds.extentX[index] = extent[0];
+        worldBounds.extentY[index] = extent[1];
+        worldBounds.extentZ[index] = extent[2];
+    }
+
+    template<typename T>
+    bool IsBitIdentical(const std::vector<T> &a, const std::vector<T> &b) {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+    }
+} // namespace
+
+uint32_t SceneHierarchy::AddNode(int32_t parent, const glm::mat4 &localTransform) {
+    const auto node = static_cast<uint32_t>(parents.size());
+    if (parent != noParent && (parent < 0 || static_cast<uint32_t>(parent) >= node)) {
+        throw std::runtime_error("Parent node has to be added before its children!");
+    }
+
+    parents.push_back(parent);
+    localTransforms.push_back(localTransform);
+    worldTransforms.push_back(localTransform);
+    dirty.push_back(1);
+    depths.push_back(parent == noParent ? 0 : depths[parent] + 1);
+    firstBoxes.push_back(firstBoxes.back());
+    firstDirty = std::min<size_t>(firstDirty, node);
+    return node;
+}
+
+void SceneHierarchy::SetLocalTransform(uint32_t node, const glm::mat4 &localTransform) {
+    localTransforms[node] = localTransform;
+    dirty[node] = 1;
+    firstDirty = std::min<size_t>(firstDirty, node);
+}
+
+void SceneHierarchy::SetBounds(std::span<const uint32_t> boxNodes, const AABBArrays &bounds) {
+    if (!std::ranges::is_sorted(boxNodes) || (!boxNodes.empty() && boxNodes.back() >= parents.size())) {
+        throw std::runtime_error("Boxes have to be sorted by their node!");
+    }
+
+    firstBoxes.assign(parents.size() + 1, 0);
+    for (const uint32_t node: boxNodes) {
+        firstBoxes[node + 1]++;
+    }
+    for (size_t node = 0; node < parents.size(); node++) {
+        firstBoxes[node + 1] += firstBoxes[node];
+    }
+    localBounds = bounds;
+    worldBounds.Resize(localBounds.Size());
+
+    // Every box needs its world bounds
+    std::ranges::fill(dirty, 1);
+    firstDirty = 0;
+}
+
+bool SceneHierarchy::UpdateTransforms() {
+    const size_t nodeCount = parents.size();
+    if (firstDirty >= nodeCount) {
+        return false;
+    }
+
+    // NOTE: Parents are updated before their children, so a child only has to look one level up to know whether
+    //       anything above it changed
+    for (size_t node = firstDirty; node < nodeCount; node++) {
+        UpdateNode(node);
+    }
+
+    std::fill(dirty.begin() + static_cast<ptrdiff_t>(firstDirty), dirty.end(), 0);
+    firstDirty = nodeCount;
+    return true;
+}
+
+bool SceneHierarchy::UpdateTransforms(JobSystem &jobSystem) {
+    const size_t nodeCount = parents.size();
+    if (nodeCount - std::min(firstDirty, nodeCount) < parallelNodeCount) {
+        return UpdateTransforms();
+    }
+
+    UpdateLevels(jobSystem);
+    return true;
+}
+
+bool SceneHierarchy::IsParallelUpdateBitIdentical(JobSystem &jobSystem) const {
+    if (firstDirty >= parents.size()) {
+        return true;
+    }
+
+    SceneHierarchy serial = *this;
+    serial.UpdateTransforms();
+    SceneHierarchy parallel = *this;
+    parallel.UpdateLevels(jobSystem);
+    return IsBitIdentical(parallel.worldTransforms, serial.worldTransforms) &&
+           IsBitIdentical(parallel.worldBounds.centerX, serial.worldBounds.centerX) &&
+           IsBitIdentical(parallel.worldBounds.centerY, serial.worldBounds.centerY) &&
+           IsBitIdentical(parallel.worldBounds.centerZ, serial.worldBounds.centerZ) &&
+           IsBitIdentical(parallel.worldBounds.extentX, serial.worldBounds.extentX) &&
+           IsBitIdentical(parallel.worldBounds.extentY, serial.worldBounds.extentY) &&
+           IsBitIdentical(parallel.worldBounds.extentZ, serial.worldBounds.extentZ);
+}
+
+void SceneHierarchy::UpdateLevels(JobSystem &jobSystem) {
+    if (levelNodes.size() != parents.size()) {
+        SortLevels();
+    }
+
+    // NOTE: A level only starts once the previous one is done, so every parent is final before its children read it
+    for (size_t level = 0; level + 1 < levelOffsets.size(); level++) {
+        const size_t levelStart = levelOffsets[level];
+        jobSystem.ParallelFor(levelOffsets[level + 1] - levelStart, parallelGrainSize,
+                              [this, levelStart](size_t begin, size_t end) {
+                                  for (size_t i = levelStart + begin; i < levelStart + end; i++) {
+                                      UpdateNode(levelNodes[i]);
+                                  }
+                              });
+    }
+
+    std::fill(dirty.begin() + static_cast<ptrdiff_t>(firstDirty), dirty.end(), 0);
+    firstDirty = parents.size();
+}
+
+void SceneHierarchy::UpdateNode(size_t node) {
+    const int32_t parent = parents[node];
+    if (parent == noParent) {
+        if (!dirty[node]) {
+            return;
+        }
+        worldTransforms[node] = localTransforms[node];
+    } else if (dirty[node] || dirty[parent]) {
+        dirty[node] = 1;
+        worldTransforms[node] = MultiplyTransforms(worldTransforms[parent], localTransforms[node]);
+    } else {
+        return;
+    }
+
+    for (uint32_t box = firstBoxes[node]; box < firstBoxes[node + 1]; box++) {
+        TransformBounds(worldTransforms[node], localBounds, box, worldBounds);
+    }
+}
+
+void SceneHierarchy::SortLevels() {
+    // Counting sort by depth, the nodes of a level keep their order
+    const uint32_t levelCount = depths.empty() ? 0 : *std::ranges::max_element(depths) + 1;
+    levelOffsets.assign(levelCount + 1, 0);
+    for (const uint32_t depth: depths) {
+        levelOffsets[depth + 1]++;
+    }
+    for (uint32_t level = 0; level < levelCount; level++) {
+        levelOffsets[level + 1] += levelOffsets[level];
+    }
+
+    levelNodes.resize(depths.size());
+    std::vector<size_t> nextSlot(levelOffsets.begin(), levelOffsets.end() - 1);
+    for (uint32_t node = 0; node < depths.size(); node++) {
+        levelNodes[nextSlot[depths[node]]++] = node;
+    }
+}
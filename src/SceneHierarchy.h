@@ -0,0 +1,68 @@
+#pragma once
+
+#include <span>
+
+#include "Camera.h"
+
+class JobSystem;
+
+// Transform hierarchy stored as parallel arrays in topological order, parents always come before their children.
+// World transforms are updated in one linear pass that only touches dirty nodes and their descendants.
+class SceneHierarchy {
+public:
+    static constexpr int32_t noParent = -1;
+
+    // Returns the index of the new node, the parent has to be added before it
+    uint32_t AddNode(int32_t parent, const glm::mat4 &localTransform);
+
+    void SetLocalTransform(uint32_t node, const glm::mat4 &localTransform);
+
+    // Attaches boxes to the nodes, their world bounds are updated along with the node's world transform.
+    // boxNodes holds the node of every box and has to be sorted
+    void SetBounds(std::span<const uint32_t> boxNodes, const AABBArrays &bounds);
+
+    // Recomputes the world transforms below every node changed since the last update.
+    // Returns whether any world transform changed
+    bool UpdateTransforms();
+    // Same as UpdateTransforms, one level of the hierarchy at a time with the nodes of a level spread across the jobs.
+    // The results are bit-identical to the serial update
+    bool UpdateTransforms(JobSystem &jobSystem);
+    // Runs the serial and the parallel update on copies of the hierarchy, regardless of how many nodes are dirty, and
+    // returns whether their results are bit-identical. The hierarchy itself isn't updated
+    [[nodiscard]] bool IsParallelUpdateBitIdentical(JobSystem &jobSystem) const;
+
+    [[nodiscard]] size_t GetNodeCount() const { return parents.size(); }
+    [[nodiscard]] int32_t GetParent(uint32_t node) const { return parents[node]; }
+    [[nodiscard]] std::span<const glm::mat4> GetLocalTransforms() const { return localTransforms; }
+    // NOTE: Only up to date after UpdateTransforms
+    [[nodiscard]] std::span<const glm::mat4> GetWorldTransforms() const { return worldTransforms; }
+    // Indexed like the boxes passed to SetBounds, only up to date after UpdateTransforms
+    [[nodiscard]] const AABBArrays &GetWorldBounds() const { return worldBounds; }
+
+private:
+    // Fewer dirty nodes than this are updated on the calling thread
+    static constexpr size_t parallelNodeCount = 4096;
+    static constexpr size_t parallelGrainSize = 512;
+
+    // Shared by both updates, only reads the parent, so the nodes of one level can be updated concurrently
+    void UpdateNode(size_t node);
+    void UpdateLevels(JobSystem &jobSystem);
+    void SortLevels();
+
+    std::vector<int32_t> parents;
+    std::vector<glm::mat4> localTransforms;
+    std::vector<glm::mat4> worldTransforms;
+    std::vector<uint8_t> dirty; // Set for changed nodes, the update propagates it to their descendants
+
+    // Nodes before the first dirty one can't be below a dirty node, so the update starts there
+    size_t firstDirty{0};
+
+    // Nodes grouped by their depth, levelOffsets[d] is the first node of depth d in levelNodes
+    std::vector<uint32_t> depths;
+    std::vector<uint32_t> levelNodes;
+    std::vector<size_t> levelOffsets;
+
+    std::vector<uint32_t> firstBoxes{0}; // Boxes of node n are [firstBoxes[n], firstBoxes[n + 1])
+    AABBArrays localBounds;
+    AABBArrays worldBounds;
+};
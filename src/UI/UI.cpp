@@ -95,6 +95,32 @@ void UI::Draw(VkCommandBuffer cmd) {
 
     ImGui::Text("Frame time: %.3f ms", 1000.0f / io.Framerate);
     ImGui::Text("FPS: %.1f", io.Framerate);
+    if (const auto gpuResult = app->gpuProfiler.GetLatestResult()) {
+        ImGui::Text("GPU frame time: %.3f ms", gpuResult->frameTime);
+
+        if (ImGui::BeginTable("GPU Passes", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+            ImGui::TableSetupColumn("Pass");
+            ImGui::TableSetupColumn("GPU (ms)");
+            ImGui::TableSetupColumn("VS invocations");
+            ImGui::TableHeadersRow();
+            for (const auto &pass: gpuResult->passes) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(pass.name.c_str());
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", pass.time);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(pass.vertexInvocations));
+            }
+            ImGui::EndTable();
+        }
+
+        ImGui::BeginDisabled(app->gpuProfiler.IsCapturing());
+        if (ImGui::Button("Capture CPU/GPU trace (F6)")) {
+            app->gpuProfiler.BeginCapture(Application::traceFrameCount, "trace.json");
+        }
+        ImGui::EndDisabled();
+    }
 
     ImGui::Separator();
 
@@ -114,6 +140,24 @@ void UI::Draw(VkCommandBuffer cmd) {
         }
         ImGui::EndCombo();
     }
+    if (app->IsSceneLoading()) {
+        ImGui::Text("Loading scene...");
+    }
+    ImGui::Checkbox("Meshlet culling", &app->meshletCulling);
+    ImGui::Checkbox("Occlusion culling", &app->occlusionCulling);
+    ImGui::SliderFloat("LOD error (px)", &app->lodErrorThreshold, 0.0f, 8.0f);
+
+    ImGui::Separator();
+
+    if (const auto &pickedMesh = app->pickedMesh) {
+        ImGui::Text("Picked mesh %u of node %u at distance %.2f", pickedMesh->meshIndex, pickedMesh->node,
+                    pickedMesh->distance);
+        const AABB &bounds = pickedMesh->bounds;
+        ImGui::Text("Bounds: (%.2f, %.2f, %.2f) - (%.2f, %.2f, %.2f)", bounds.min.x, bounds.min.y, bounds.min.z,
+                    bounds.max.x, bounds.max.y, bounds.max.z);
+    } else {
+        ImGui::Text("Left click a mesh to pick it");
+    }
 
     ImGui::End();
 
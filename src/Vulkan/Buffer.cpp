@@ -20,6 +20,8 @@ Buffer::Buffer(const std::shared_ptr<VulkanDevice>& device, const BufferSpecific
         usageFlags = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     } else if (specification.type == BufferType::GPU_INDIRECT) {
         usageFlags = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    } else if (specification.type == BufferType::READBACK) {
+        usageFlags = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     }
 
     const VkBufferCreateInfo bufferInfo{
@@ -40,6 +42,8 @@ Buffer::Buffer(const std::shared_ptr<VulkanDevice>& device, const BufferSpecific
         allocationFlags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
     } else if (specification.type == BufferType::GPU_INDIRECT) {
         allocationFlags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    } else if (specification.type == BufferType::READBACK) {
+        allocationFlags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
     }
 
     VmaAllocationCreateInfo allocInfo = {};
@@ -76,13 +80,13 @@ void Buffer::Unmap() {
     isMapped = false;
 }
 
-void Buffer::From(void *src, VkDeviceSize srcSize) {
+void Buffer::From(const void *src, VkDeviceSize srcSize) {
     if (allocationInfo.pMappedData == nullptr)
         throw std::runtime_error("Tried to copy to unmapped buffer");
     memcpy(allocationInfo.pMappedData, src, srcSize);
 }
 
-void Buffer::From(void *src, VkDeviceSize srcSize, uint32_t offset) {
+void Buffer::From(const void *src, VkDeviceSize srcSize, uint32_t offset) {
     if (allocationInfo.pMappedData == nullptr)
         throw std::runtime_error("Tried to copy to unmapped buffer");
     memcpy(static_cast<uint8_t *>(allocationInfo.pMappedData) + offset, src, srcSize);
@@ -8,6 +8,7 @@ enum class BufferType {
     INDEX,
     GPU,
     GPU_INDIRECT,
+    READBACK,
 };
 
 struct BufferSpecification {
@@ -34,8 +35,8 @@ public:
     void Unmap();
 
     // TODO: Make name more clear
-    void From(void *src, VkDeviceSize srcSize);
-    void From(void *src, VkDeviceSize srcSize, uint32_t offset);
+    void From(const void *src, VkDeviceSize srcSize);
+    void From(const void *src, VkDeviceSize srcSize, uint32_t offset);
     void Fill(uint8_t data, VkDeviceSize srcSize);
     void FromBuffer(Buffer *src);
 
@@ -43,6 +44,7 @@ public:
     [[nodiscard]] VkDeviceAddress GetAddress() const { return address; }
     [[nodiscard]] BufferType GetType() const { return specification.type; }
     [[nodiscard]] size_t GetSize() const { return specification.size; }
+    [[nodiscard]] void *GetMappedData() const { return allocationInfo.pMappedData; }
 
 private:
     VkBuffer buffer{VK_NULL_HANDLE};
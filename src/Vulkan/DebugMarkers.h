@@ -3,6 +3,7 @@
 
 #include <string_view>
 
+#include "CPUProfiler.h"
 #include "VulkanDevice.h"
 
 namespace DebugMarkers {
@@ -27,10 +28,20 @@ namespace DebugMarkers {
         vkSetDebugUtilsObjectNameEXT(device->GetDevice(), &imageMarkerInfo);
     }
 
+    // Debug utils label around the commands recorded in its scope, and a CPU profiling scope while profiling is enabled
     class ScopedMarker {
     public:
         ScopedMarker() = delete;
-        ScopedMarker(VkCommandBuffer commandBuffer, std::string_view name) : commandBuffer(commandBuffer) {
+
+        // CPU profiling scope only. NOTE: name has to be a string literal, see CPUProfiler::Record
+        explicit ScopedMarker(std::string_view name) : name(name.data()) {
+            if (CPUProfiler::IsEnabled()) {
+                start = CPUProfiler::Now();
+            }
+        }
+
+        ScopedMarker(VkCommandBuffer commandBuffer, std::string_view name) : ScopedMarker(name) {
+            this->commandBuffer = commandBuffer;
             const VkDebugUtilsLabelEXT debugUtil = {
                     .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT,
                     .pLabelName = name.data(),
@@ -44,8 +55,20 @@ namespace DebugMarkers {
         ScopedMarker(const ScopedMarker &other) = delete;
         ScopedMarker &operator=(ScopedMarker &&other) = delete;
 
-        ~ScopedMarker() { vkCmdEndDebugUtilsLabelEXT(commandBuffer); }
+        ~ScopedMarker() {
+            if (commandBuffer != VK_NULL_HANDLE) {
+                vkCmdEndDebugUtilsLabelEXT(commandBuffer);
+            }
+            // NOTE: Scopes that started before profiling was enabled are dropped
+            if (start != 0 && CPUProfiler::IsEnabled()) {
+                CPUProfiler::Record(name, start, CPUProfiler::Now());
+            }
+        }
+
+        VkCommandBuffer commandBuffer{VK_NULL_HANDLE};
 
-        VkCommandBuffer commandBuffer;
+    private:
+        const char *name;
+        uint64_t start{0};
     };
 } // namespace DebugMarkers
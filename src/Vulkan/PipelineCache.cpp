@@ -0,0 +1,242 @@
+#include "pch.h"
+
+#include "PipelineCache.h"
+#include "Utils.h"
+
+namespace {
+    constexpr uint32_t pipelineCacheMagic = 0x43504C56; // "VLPC"
+    constexpr uint32_t reflectionCacheMagic = 0x43524C56; // "VLRC"
+
+    // Minimal binary (de)serialization for trivially copyable values
+    template<typename T>
+    void Write(std::vector<char> &data, const T &value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto bytes = reinterpret_cast<const char *>(&value);
+        data.insert(data.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<typename T>
+    void WriteVector(std::vector<char> &data, const std::vector<T> &values) {
+        Write(data, static_cast<uint32_t>(values.size()));
+        for (const auto &value: values) {
+            Write(data, value);
+        }
+    }
+
+    class Reader {
+    public:
+        explicit Reader(const std::vector<char> &data) : data(data) {}
+
+        template<typename T>
+        T Read() {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (offset + sizeof(T) > data.size()) {
+                throw std::runtime_error("Unexpected end of cache file!");
+            }
+            T value;
+            std::memcpy(&value, data.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return value;
+        }
+
+        template<typename T>
+        std::vector<T> ReadVector() {
+            std::vector<T> values(Read<uint32_t>());
+            for (auto &value: values) {
+                value = Read<T>();
+            }
+            return values;
+        }
+
+    private:
+        const std::vector<char> &data;
+        size_t offset{0};
+    };
+} // namespace
+
+PipelineCache::PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, std::filesystem::path directory) :
+    device(device) {
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+            .pNext = &idProperties,
+    };
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+    properties = properties2.properties;
+
+    // NOTE: One file per GPU, so machines with several GPUs don't keep invalidating each other's cache
+    pipelineCachePath =
+            directory / std::format("pipeline_cache_{:04x}_{:04x}.bin", properties.vendorID, properties.deviceID);
+    reflectionCachePath = directory / "shader_reflection.bin";
+
+    loadedData = LoadPipelineCacheData();
+    LoadReflections();
+
+    const VkPipelineCacheCreateInfo cacheInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+            .initialDataSize = loadedData.size(),
+            .pInitialData = loadedData.empty() ? nullptr : loadedData.data(),
+    };
+    VK_CHECK(vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache), "Failed to create pipeline cache!");
+}
+
+void PipelineCache::Destroy() {
+    try {
+        std::filesystem::create_directories(pipelineCachePath.parent_path());
+        SavePipelineCacheData();
+        SaveReflections();
+    } catch (const std::exception &e) {
+        // NOTE: Losing the cache only costs startup time, so this never fails the shutdown
+        std::cerr << "Failed to save pipeline cache - " << e.what() << std::endl;
+    }
+
+    vkDestroyPipelineCache(device, cache, nullptr);
+}
+
+std::optional<PipelineCache::ShaderReflection> PipelineCache::FindReflection(uint64_t codeHash) const {
+    std::lock_guard lock(reflectionsMutex);
+    if (const auto it = reflections.find(codeHash); it != reflections.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+void PipelineCache::StoreReflection(uint64_t codeHash, const ShaderReflection &reflection) {
+    std::lock_guard lock(reflectionsMutex);
+    reflections[codeHash] = reflection;
+    reflectionsDirty = true;
+}
+
+PipelineCache::PipelineCacheHeader PipelineCache::CreateHeader() const {
+    PipelineCacheHeader header{
+            .magic = pipelineCacheMagic,
+            .version = pipelineCacheVersion,
+            .vendorID = properties.vendorID,
+            .deviceID = properties.deviceID,
+            .driverVersion = properties.driverVersion,
+    };
+    std::memcpy(header.driverUUID, idProperties.driverUUID, VK_UUID_SIZE);
+    std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    return header;
+}
+
+std::vector<char> PipelineCache::LoadPipelineCacheData() const {
+    if (!std::filesystem::exists(pipelineCachePath)) {
+        return {};
+    }
+
+    const std::vector<char> file = ReadFile(pipelineCachePath);
+    if (file.size() < sizeof(PipelineCacheHeader)) {
+        return {};
+    }
+
+    PipelineCacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(PipelineCacheHeader));
+
+    const PipelineCacheHeader expected = CreateHeader();
+    if (header.magic != expected.magic || header.version != expected.version ||
+        header.vendorID != expected.vendorID || header.deviceID != expected.deviceID ||
+        header.driverVersion != expected.driverVersion ||
+        std::memcmp(header.driverUUID, expected.driverUUID, VK_UUID_SIZE) != 0 ||
+        std::memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0 ||
+        header.dataSize != file.size() - sizeof(PipelineCacheHeader)) {
+        std::cout << "Pipeline cache is stale, rebuilding it" << std::endl;
+        return {};
+    }
+
+    return {file.begin() + sizeof(PipelineCacheHeader), file.end()};
+}
+
+void PipelineCache::SavePipelineCacheData() const {
+    size_t dataSize = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &dataSize, nullptr), "Failed to get pipeline cache size!");
+    std::vector<char> data(dataSize);
+    VK_CHECK(vkGetPipelineCacheData(device, cache, &dataSize, data.data()), "Failed to get pipeline cache data!");
+    data.resize(dataSize);
+
+    // Nothing new was compiled, so there's no need to touch the file
+    if (data == loadedData) {
+        return;
+    }
+
+    PipelineCacheHeader header = CreateHeader();
+    header.dataSize = data.size();
+
+    std::vector<char> file;
+    file.reserve(sizeof(PipelineCacheHeader) + data.size());
+    Write(file, header);
+    file.insert(file.end(), data.begin(), data.end());
+    WriteFileAtomic(pipelineCachePath, file);
+}
+
+void PipelineCache::LoadReflections() {
+    if (!std::filesystem::exists(reflectionCachePath)) {
+        return;
+    }
+
+    const std::vector<char> file = ReadFile(reflectionCachePath);
+    try {
+        Reader reader(file);
+        if (reader.Read<uint32_t>() != reflectionCacheMagic || reader.Read<uint32_t>() != reflectionCacheVersion) {
+            return;
+        }
+
+        const auto count = reader.Read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto codeHash = reader.Read<uint64_t>();
+
+            ShaderReflection reflection{.stage = reader.Read<VkShaderStageFlagBits>()};
+            reflection.inputAttributes = reader.ReadVector<VkVertexInputAttributeDescription>();
+
+            reflection.sets.resize(reader.Read<uint32_t>());
+            for (auto &set: reflection.sets) {
+                set.set = reader.Read<uint32_t>();
+                set.bindings.resize(reader.Read<uint32_t>());
+                for (auto &binding: set.bindings) {
+                    binding.binding = reader.Read<uint32_t>();
+                    binding.descriptorType = reader.Read<VkDescriptorType>();
+                    binding.descriptorCount = reader.Read<uint32_t>();
+                    binding.stageFlags = reader.Read<VkShaderStageFlags>();
+                }
+            }
+
+            reflection.pushConstantRanges = reader.ReadVector<VkPushConstantRange>();
+            reflections[codeHash] = std::move(reflection);
+        }
+    } catch (const std::runtime_error &) {
+        std::cout << "Shader reflection cache is corrupted, rebuilding it" << std::endl;
+        reflections.clear();
+    }
+}
+
+void PipelineCache::SaveReflections() const {
+    std::lock_guard lock(reflectionsMutex);
+    if (!reflectionsDirty) {
+        return;
+    }
+
+    std::vector<char> file;
+    Write(file, reflectionCacheMagic);
+    Write(file, reflectionCacheVersion);
+    Write(file, static_cast<uint32_t>(reflections.size()));
+    for (const auto &[codeHash, reflection]: reflections) {
+        Write(file, codeHash);
+        Write(file, reflection.stage);
+        WriteVector(file, reflection.inputAttributes);
+
+        Write(file, static_cast<uint32_t>(reflection.sets.size()));
+        for (const auto &set: reflection.sets) {
+            Write(file, set.set);
+            Write(file, static_cast<uint32_t>(set.bindings.size()));
+            for (const auto &binding: set.bindings) {
+                Write(file, binding.binding);
+                Write(file, binding.descriptorType);
+                Write(file, binding.descriptorCount);
+                Write(file, binding.stageFlags);
+            }
+        }
+
+        WriteVector(file, reflection.pushConstantRanges);
+    }
+    WriteFileAtomic(reflectionCachePath, file);
+}
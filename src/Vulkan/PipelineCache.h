@@ -0,0 +1,70 @@
+#pragma once
+#include "../pch.h"
+
+#include <mutex>
+
+// Device-wide VkPipelineCache and SPIRV-Reflect result cache, both persisted to disk across runs
+class PipelineCache {
+public:
+    // Everything VulkanPipeline needs from the reflection of a single shader stage
+    struct ShaderReflection {
+        struct DescriptorSet {
+            uint32_t set{0};
+            std::vector<VkDescriptorSetLayoutBinding> bindings;
+        };
+
+        VkShaderStageFlagBits stage{};
+        std::vector<VkVertexInputAttributeDescription> inputAttributes; // only location and format are set
+        std::vector<DescriptorSet> sets;
+        std::vector<VkPushConstantRange> pushConstantRanges;
+    };
+
+    PipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, std::filesystem::path directory);
+    // Writes both caches to disk
+    void Destroy();
+
+    [[nodiscard]] VkPipelineCache GetCache() const { return cache; }
+
+    // Keyed by the hash of the SPIR-V code
+    [[nodiscard]] std::optional<ShaderReflection> FindReflection(uint64_t codeHash) const;
+    void StoreReflection(uint64_t codeHash, const ShaderReflection &reflection);
+
+private:
+    // Written in front of the driver's cache data, which is discarded if any of these don't match
+    struct PipelineCacheHeader {
+        uint32_t magic{0};
+        uint32_t version{0};
+        uint32_t vendorID{0};
+        uint32_t deviceID{0};
+        uint32_t driverVersion{0};
+        uint8_t driverUUID[VK_UUID_SIZE]{};
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE]{};
+        uint64_t dataSize{0};
+    };
+
+    [[nodiscard]] PipelineCacheHeader CreateHeader() const;
+    [[nodiscard]] std::vector<char> LoadPipelineCacheData() const;
+    void SavePipelineCacheData() const;
+
+    void LoadReflections();
+    void SaveReflections() const;
+
+    // Bump when the file layouts change
+    static constexpr uint32_t pipelineCacheVersion = 1;
+    static constexpr uint32_t reflectionCacheVersion = 1;
+
+    VkPipelineCache cache{VK_NULL_HANDLE};
+    std::vector<char> loadedData;
+
+    VkPhysicalDeviceProperties properties{};
+    VkPhysicalDeviceIDProperties idProperties{};
+
+    mutable std::mutex reflectionsMutex;
+    std::unordered_map<uint64_t, ShaderReflection> reflections;
+    bool reflectionsDirty{false};
+
+    std::filesystem::path pipelineCachePath;
+    std::filesystem::path reflectionCachePath;
+
+    VkDevice device{VK_NULL_HANDLE};
+};
@@ -0,0 +1,260 @@
+#include "pch.h"
+
+#include "UploadContext.h"
+#include "Utils.h"
+
+UploadContext::UploadContext(std::shared_ptr<VulkanDevice> device, VkDeviceSize chunkSize) :
+    chunkSize(chunkSize), device(std::move(device)) {
+    const auto createCommandPool = [this](uint32_t queueFamily) {
+        const VkCommandPoolCreateInfo poolInfo{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                .queueFamilyIndex = queueFamily,
+        };
+        VkCommandPool commandPool;
+        VK_CHECK(vkCreateCommandPool(this->device->GetDevice(), &poolInfo, nullptr, &commandPool),
+                 "Failed to create upload command pool!");
+        return commandPool;
+    };
+    graphicsCommandPool = createCommandPool(this->device->GetGraphicsQueueFamily());
+    if (this->device->HasDedicatedTransferQueue()) {
+        transferCommandPool = createCommandPool(this->device->GetTransferQueueFamily());
+    }
+
+    for (auto &chunk: chunks) {
+        VkCommandBufferAllocateInfo allocInfo{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = graphicsCommandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1,
+        };
+        VK_CHECK(vkAllocateCommandBuffers(this->device->GetDevice(), &allocInfo, &chunk.graphicsCommandBuffer),
+                 "Failed to allocate upload command buffer!");
+
+        if (transferCommandPool != VK_NULL_HANDLE) {
+            allocInfo.commandPool = transferCommandPool;
+            VK_CHECK(vkAllocateCommandBuffers(this->device->GetDevice(), &allocInfo, &chunk.transferCommandBuffer),
+                     "Failed to allocate upload command buffer!");
+        }
+    }
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeInfo{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+            .initialValue = 0,
+    };
+    const VkSemaphoreCreateInfo semaphoreInfo{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            .pNext = &semaphoreTypeInfo,
+    };
+    VK_CHECK(vkCreateSemaphore(this->device->GetDevice(), &semaphoreInfo, nullptr, &timelineSemaphore),
+             "Failed to create upload timeline semaphore!");
+}
+
+void UploadContext::Destroy() {
+    WaitForValue(timelineValue);
+
+    for (auto &chunk: chunks) {
+        if (chunk.buffer) {
+            chunk.buffer->Destroy();
+            chunk.buffer.reset();
+        }
+        chunk.uploads.clear();
+    }
+
+    vkDestroySemaphore(device->GetDevice(), timelineSemaphore, nullptr);
+    vkDestroyCommandPool(device->GetDevice(), graphicsCommandPool, nullptr);
+    if (transferCommandPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device->GetDevice(), transferCommandPool, nullptr);
+    }
+}
+
+void UploadContext::AddImage(std::shared_ptr<VulkanImage> image, const void *pixels, VkDeviceSize size,
+                             VkFormat format, uint32_t mipLevelCount) {
+    if (!chunks[currentChunk].uploads.empty() && chunks[currentChunk].offset + size > chunkSize) {
+        Flush();
+    }
+
+    StagingChunk &chunk = chunks[currentChunk];
+    if (!chunk.buffer || chunk.buffer->GetSize() < size) {
+        if (chunk.buffer) {
+            chunk.buffer->Destroy();
+        }
+        // NOTE: Images larger than a chunk get a staging buffer of their own size
+        chunk.buffer = std::make_unique<Buffer>(device, BufferSpecification{.name = "Upload Staging Arena",
+                                                                            .size = std::max(chunkSize, size),
+                                                                            .type = BufferType::STAGING});
+    }
+
+    chunk.buffer->From(const_cast<void *>(pixels), size, static_cast<uint32_t>(chunk.offset));
+    chunk.uploads.push_back(
+            {.image = std::move(image), .offset = chunk.offset, .format = format, .mipLevelCount = mipLevelCount});
+
+    // Copy offsets must be a multiple of the texel size
+    chunk.offset = (chunk.offset + size + 15) & ~VkDeviceSize{15};
+}
+
+void UploadContext::Flush() {
+    StagingChunk &chunk = chunks[currentChunk];
+    if (chunk.uploads.empty()) {
+        return;
+    }
+
+    constexpr VkCommandBufferBeginInfo beginInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+
+    VK_CHECK(vkBeginCommandBuffer(chunk.graphicsCommandBuffer, &beginInfo), "Failed to begin upload commands!");
+    if (device->HasDedicatedTransferQueue()) {
+        VK_CHECK(vkBeginCommandBuffer(chunk.transferCommandBuffer, &beginInfo), "Failed to begin upload commands!");
+        RecordCopies(chunk.transferCommandBuffer, chunk);
+        RecordOwnershipTransfer(chunk.transferCommandBuffer, chunk, true);
+        VK_CHECK(vkEndCommandBuffer(chunk.transferCommandBuffer), "Failed to record upload commands!");
+
+        RecordOwnershipTransfer(chunk.graphicsCommandBuffer, chunk, false);
+    } else {
+        RecordCopies(chunk.graphicsCommandBuffer, chunk);
+    }
+    RecordFinalLayouts(chunk.graphicsCommandBuffer, chunk);
+    VK_CHECK(vkEndCommandBuffer(chunk.graphicsCommandBuffer), "Failed to record upload commands!");
+
+    // Copies signal copiesDone on the transfer queue, the graphics queue waits on it before taking ownership
+    uint64_t copiesDone = 0;
+    if (device->HasDedicatedTransferQueue()) {
+        copiesDone = ++timelineValue;
+        const VkCommandBufferSubmitInfo transferCommandBufferInfo{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+                .commandBuffer = chunk.transferCommandBuffer,
+        };
+        const VkSemaphoreSubmitInfo signalInfo{
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+                .semaphore = timelineSemaphore,
+                .value = copiesDone,
+                .stageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+        };
+        const VkSubmitInfo2 submitInfo{
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+                .commandBufferInfoCount = 1,
+                .pCommandBufferInfos = &transferCommandBufferInfo,
+                .signalSemaphoreInfoCount = 1,
+                .pSignalSemaphoreInfos = &signalInfo,
+        };
+        const auto queueLock = device->LockQueues();
+        VK_CHECK(vkQueueSubmit2(device->GetTransferQueue(), 1, &submitInfo, VK_NULL_HANDLE),
+                 "Failed to submit upload commands!");
+    }
+
+    const uint64_t uploadsDone = ++timelineValue;
+    const VkCommandBufferSubmitInfo graphicsCommandBufferInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
+            .commandBuffer = chunk.graphicsCommandBuffer,
+    };
+    const VkSemaphoreSubmitInfo waitInfo{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = timelineSemaphore,
+            .value = copiesDone,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+    };
+    const VkSemaphoreSubmitInfo signalInfo{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+            .semaphore = timelineSemaphore,
+            .value = uploadsDone,
+            .stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+    };
+    const VkSubmitInfo2 submitInfo{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2,
+            .waitSemaphoreInfoCount = device->HasDedicatedTransferQueue() ? 1u : 0u,
+            .pWaitSemaphoreInfos = &waitInfo,
+            .commandBufferInfoCount = 1,
+            .pCommandBufferInfos = &graphicsCommandBufferInfo,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos = &signalInfo,
+    };
+    {
+        const auto queueLock = device->LockQueues();
+        VK_CHECK(vkQueueSubmit2(device->GetGraphicsQueue(), 1, &submitInfo, VK_NULL_HANDLE),
+                 "Failed to submit upload commands!");
+    }
+    chunk.completionValue = uploadsDone;
+
+    // Switch to the other chunk, which can be refilled once the GPU is done reading it
+    currentChunk = (currentChunk + 1) % chunks.size();
+    StagingChunk &nextChunk = chunks[currentChunk];
+    WaitForValue(nextChunk.completionValue);
+    nextChunk.offset = 0;
+    nextChunk.uploads.clear();
+}
+
+void UploadContext::Wait() {
+    Flush();
+    WaitForValue(timelineValue);
+}
+
+void UploadContext::RecordCopies(VkCommandBuffer commandBuffer, const StagingChunk &chunk) const {
+    for (const auto &upload: chunk.uploads) {
+        upload.image->TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        upload.image->CopyBufferData(commandBuffer, *chunk.buffer, upload.offset);
+    }
+}
+
+void UploadContext::RecordOwnershipTransfer(VkCommandBuffer commandBuffer, const StagingChunk &chunk,
+                                            bool release) const {
+    // NOTE: The release on the transfer queue and the acquire on the graphics queue must use identical barriers,
+    // except for the stage and access masks of the queue that doesn't execute them
+    std::vector<VkImageMemoryBarrier2> barriers;
+    barriers.reserve(chunk.uploads.size());
+    for (const auto &upload: chunk.uploads) {
+        VkImageMemoryBarrier2 barrier{
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+                .srcStageMask = release ? VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT : VK_PIPELINE_STAGE_2_NONE,
+                .srcAccessMask = release ? VK_ACCESS_2_TRANSFER_WRITE_BIT : VK_ACCESS_2_NONE,
+                .dstStageMask = release ? VK_PIPELINE_STAGE_2_NONE : VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT,
+                .dstAccessMask = release ? VK_ACCESS_2_NONE
+                                         : VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                .srcQueueFamilyIndex = device->GetTransferQueueFamily(),
+                .dstQueueFamilyIndex = device->GetGraphicsQueueFamily(),
+                .image = upload.image->GetImage(),
+        };
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        barriers.push_back(barrier);
+    }
+
+    const VkDependencyInfo dependencyInfo{
+            .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+            .imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size()),
+            .pImageMemoryBarriers = barriers.data(),
+    };
+    vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+void UploadContext::RecordFinalLayouts(VkCommandBuffer commandBuffer, const StagingChunk &chunk) const {
+    for (const auto &upload: chunk.uploads) {
+        if (upload.mipLevelCount > 1) {
+            upload.image->GenerateMipMaps(commandBuffer, upload.format, upload.mipLevelCount);
+        } else {
+            upload.image->TransitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+}
+
+void UploadContext::WaitForValue(uint64_t value) const {
+    if (value == 0) {
+        return;
+    }
+
+    const VkSemaphoreWaitInfo waitInfo{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            .semaphoreCount = 1,
+            .pSemaphores = &timelineSemaphore,
+            .pValues = &value,
+    };
+    VK_CHECK(vkWaitSemaphores(device->GetDevice(), &waitInfo, UINT64_MAX), "Failed to wait for uploads!");
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Buffer.h"
+#include "VulkanDevice.h"
+#include "VulkanImage.h"
+
+// Batches image uploads into a double-buffered staging arena. Copies run on the dedicated transfer queue when the
+// device has one, and ownership is handed to the graphics queue, which generates the mip chains. Completion is tracked
+// with a timeline semaphore, so no queue is ever idled.
+class UploadContext {
+public:
+    explicit UploadContext(std::shared_ptr<VulkanDevice> device, VkDeviceSize chunkSize = 128 * 1024 * 1024);
+    // Waits for all submitted uploads
+    void Destroy();
+
+    // Copies the pixels to staging memory, so they can be freed right after. The image ends up in
+    // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL once the upload completed.
+    void AddImage(std::shared_ptr<VulkanImage> image, const void *pixels, VkDeviceSize size, VkFormat format,
+                  uint32_t mipLevelCount);
+
+    // Submits the uploads added so far without waiting for them
+    void Flush();
+    // Flushes and blocks until every upload completed
+    void Wait();
+
+private:
+    struct PendingUpload {
+        std::shared_ptr<VulkanImage> image;
+        VkDeviceSize offset{0};
+        VkFormat format{VK_FORMAT_UNDEFINED};
+        uint32_t mipLevelCount{1};
+    };
+
+    // Filled by the CPU while the GPU copies from the other one
+    struct StagingChunk {
+        std::unique_ptr<Buffer> buffer;
+        VkDeviceSize offset{0};
+        std::vector<PendingUpload> uploads;
+
+        VkCommandBuffer transferCommandBuffer{VK_NULL_HANDLE};
+        VkCommandBuffer graphicsCommandBuffer{VK_NULL_HANDLE};
+        uint64_t completionValue{0}; // timeline value signaled once the GPU is done with this chunk
+    };
+
+    void RecordCopies(VkCommandBuffer commandBuffer, const StagingChunk &chunk) const;
+    void RecordOwnershipTransfer(VkCommandBuffer commandBuffer, const StagingChunk &chunk, bool release) const;
+    void RecordFinalLayouts(VkCommandBuffer commandBuffer, const StagingChunk &chunk) const;
+
+    void WaitForValue(uint64_t value) const;
+
+    std::array<StagingChunk, 2> chunks;
+    uint32_t currentChunk{0};
+    VkDeviceSize chunkSize;
+
+    VkCommandPool transferCommandPool{VK_NULL_HANDLE};
+    VkCommandPool graphicsCommandPool{VK_NULL_HANDLE};
+
+    VkSemaphore timelineSemaphore{VK_NULL_HANDLE};
+    uint64_t timelineValue{0};
+
+    std::shared_ptr<VulkanDevice> device;
+};
@@ -1,10 +1,22 @@
 #pragma once
 
 #include "pch.h"
+
+#include <random>
+
 #include "VulkanDevice.h"
 
 #define VK_CHECK(func, msg) if (func != VK_SUCCESS) throw std::runtime_error(msg)
 
+// FNV-1a
+inline uint64_t HashData(const void *data, size_t size, uint64_t hash = 14695981039346656037ull) {
+    const auto bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
 // TODO: Improve
 inline std::vector<char> ReadFile(const std::filesystem::path &filename) {
     std::ifstream file(filename, std::ios::ate | std::ios::binary);
@@ -20,4 +32,19 @@ inline std::vector<char> ReadFile(const std::filesystem::path &filename) {
     file.close();
 
     return buffer;
-}
\ No newline at end of file
+}
+
+// Writes to a temporary file first, so concurrent processes never read a partially written file
+inline void WriteFileAtomic(const std::filesystem::path &path, const std::vector<char> &data) {
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += std::format(".{:08x}.tmp", std::random_device{}());
+
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::format("Failed to open file - {}!", temporaryPath.string()));
+    }
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+    file.close();
+
+    std::filesystem::rename(temporaryPath, path);
+}
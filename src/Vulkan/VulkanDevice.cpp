@@ -1,5 +1,7 @@
 #include "pch.h"
 
+#include <algorithm>
+
 #include "VkBootstrap.h"
 #include "Vulkan/Utils.h"
 #include "VulkanDevice.h"
@@ -11,6 +13,8 @@ VulkanDevice::VulkanDevice(vkb::Instance instance, VkSurfaceKHR surface) : surfa
     CreateCommandPool();
     CreateDescriptorPool();
 
+    pipelineCache = std::make_unique<PipelineCache>(device, physicalDevice, "cache");
+
     VmaAllocatorCreateInfo allocatorCreateInfo = {};
     allocatorCreateInfo.vulkanApiVersion = VK_API_VERSION_1_4;
     allocatorCreateInfo.physicalDevice = physicalDevice;
@@ -26,15 +30,21 @@ VulkanDevice::VulkanDevice(vkb::Instance instance, VkSurfaceKHR surface) : surfa
 }
 
 void VulkanDevice::Destroy() {
+    pipelineCache->Destroy();
     vmaDestroyAllocator(allocator);
     vkDestroyDescriptorPool(device, descriptorPool, nullptr);
     vkDestroyCommandPool(device, commandPool, nullptr);
+    for (const auto &[threadId, threadCommandPool]: threadCommandPools) {
+        vkDestroyCommandPool(device, threadCommandPool, nullptr);
+    }
     vkb::destroy_device(device);
 }
 
 void VulkanDevice::PickPhysicalDevice(vkb::Instance instance) {
     VkPhysicalDeviceFeatures deviceFeatures{
             .multiDrawIndirect = VK_TRUE,
+            // Instanced draws find their model matrices through gl_InstanceIndex, which starts at firstInstance
+            .drawIndirectFirstInstance = VK_TRUE,
             .samplerAnisotropy = VK_TRUE,
     };
 
@@ -68,6 +78,9 @@ void VulkanDevice::PickPhysicalDevice(vkb::Instance instance) {
 
             // Buffer Device Address
             .bufferDeviceAddress = VK_TRUE,
+
+            // Timeline Semaphores (upload completion)
+            .timelineSemaphore = VK_TRUE,
     };
 
     VkPhysicalDeviceVulkan13Features vulkan13Features{
@@ -91,22 +104,53 @@ void VulkanDevice::PickPhysicalDevice(vkb::Instance instance) {
     };
 
     vkb::PhysicalDeviceSelector physicalDeviceSelector(instance);
-    auto physicalDeviceSelectorReturn =
-            physicalDeviceSelector.set_surface(surface)
-                    .add_required_extension(VK_KHR_SWAPCHAIN_EXTENSION_NAME)
-                    // .add_required_extension(VK_EXT_DEVICE_ADDRESS_BINDING_REPORT_EXTENSION_NAME)
-                    .set_required_features(deviceFeatures)
-                    .set_required_features_11(vulkan11Features)
-                    .set_required_features_12(vulkan12Features)
-                    .set_required_features_13(vulkan13Features)
-                    .set_required_features_14(vulkan14Features)
-                    .require_present()
-                    .select();
+    physicalDeviceSelector
+            // .add_required_extension(VK_EXT_DEVICE_ADDRESS_BINDING_REPORT_EXTENSION_NAME)
+            .set_required_features(deviceFeatures)
+            .set_required_features_11(vulkan11Features)
+            .set_required_features_12(vulkan12Features)
+            .set_required_features_13(vulkan13Features)
+            .set_required_features_14(vulkan14Features);
+
+    // NOTE: Headless devices have no surface to present to, so neither presentation nor the swapchain is required
+    if (IsHeadless()) {
+        physicalDeviceSelector.require_present(false);
+    } else {
+        physicalDeviceSelector.set_surface(surface)
+                .add_required_extension(VK_KHR_SWAPCHAIN_EXTENSION_NAME)
+                .require_present();
+    }
+
+    auto physicalDeviceSelectorReturn = physicalDeviceSelector.select_devices();
     if (!physicalDeviceSelectorReturn) {
         throw std::runtime_error("Failed to find a suitable GPU!");
     }
 
-    physicalDevice = physicalDeviceSelectorReturn.value();
+    // NOTE: The culling pass compacts the visible draws with subgroup ballots, core Vulkan only guarantees basic
+    //       subgroup operations
+    const auto supportsComputeBallots = [](const vkb::PhysicalDevice &candidate) {
+        VkPhysicalDeviceSubgroupProperties subgroupProperties{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+        };
+        VkPhysicalDeviceProperties2 properties2{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                .pNext = &subgroupProperties,
+        };
+        vkGetPhysicalDeviceProperties2(candidate.physical_device, &properties2);
+        return (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+               (subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_BALLOT_BIT) != 0;
+    };
+    // Ordered by preference, so the best GPU that supports them is picked
+    const std::vector<vkb::PhysicalDevice> &suitableDevices = physicalDeviceSelectorReturn.value();
+    const auto selectedDevice = std::ranges::find_if(suitableDevices, supportsComputeBallots);
+    if (selectedDevice == suitableDevices.end()) {
+        throw std::runtime_error("Failed to find a GPU with subgroup ballots in compute shaders!");
+    }
+
+    physicalDevice = *selectedDevice;
+
+    // NOTE: Optional, only the vertex invocations per pass in the GPU profiler need it
+    pipelineStatisticsSupported = physicalDevice.enable_features_if_present({.pipelineStatisticsQuery = VK_TRUE});
 }
 
 void VulkanDevice::CreateLogicalDevice() {
@@ -120,8 +164,20 @@ void VulkanDevice::CreateLogicalDevice() {
     volkLoadDevice(device);
 
     graphicsQueue = device.get_queue(vkb::QueueType::graphics).value();
+    graphicsQueueFamily = device.get_queue_index(vkb::QueueType::graphics).value();
     computeQueue = device.get_queue(vkb::QueueType::compute).value();
-    presentQueue = device.get_queue(vkb::QueueType::present).value();
+
+    // NOTE: A transfer-only family usually maps to the copy engines, so uploads don't compete with rendering
+    if (auto dedicatedTransferQueue = device.get_dedicated_queue(vkb::QueueType::transfer)) {
+        transferQueue = dedicatedTransferQueue.value();
+        transferQueueFamily = device.get_dedicated_queue_index(vkb::QueueType::transfer).value();
+    } else {
+        transferQueue = graphicsQueue;
+        transferQueueFamily = graphicsQueueFamily;
+    }
+    if (!IsHeadless()) {
+        presentQueue = device.get_queue(vkb::QueueType::present).value();
+    }
 }
 
 void VulkanDevice::CreateCommandPool() {
@@ -152,10 +208,33 @@ void VulkanDevice::CreateDescriptorPool() {
              "Failed to create descriptor pool!");
 }
 
+VkCommandPool VulkanDevice::GetThreadCommandPool() {
+    std::lock_guard lock(threadCommandPoolsMutex);
+    VkCommandPool &pool = threadCommandPools[std::this_thread::get_id()];
+    if (pool == VK_NULL_HANDLE) {
+        VkCommandPoolCreateInfo poolInfo{
+                .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                .queueFamilyIndex = graphicsQueueFamily,
+        };
+        VK_CHECK(vkCreateCommandPool(device, &poolInfo, nullptr, &pool), "Failed to create command pool!");
+    }
+    return pool;
+}
+
+void VulkanDevice::ReleaseThreadCommandPool() {
+    std::lock_guard lock(threadCommandPoolsMutex);
+    const auto it = threadCommandPools.find(std::this_thread::get_id());
+    if (it != threadCommandPools.end()) {
+        vkDestroyCommandPool(device, it->second, nullptr);
+        threadCommandPools.erase(it);
+    }
+}
+
 VkCommandBuffer VulkanDevice::BeginSingleTimeCommands() {
     VkCommandBufferAllocateInfo allocInfo{
             .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-            .commandPool = commandPool,
+            .commandPool = GetThreadCommandPool(),
             .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
             .commandBufferCount = 1,
     };
@@ -181,8 +260,22 @@ void VulkanDevice::EndSingleTimeCommands(VkCommandBuffer commandBuffer) {
             .pCommandBuffers = &commandBuffer,
     };
 
-    VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE), "Failed to submit command buffer!");
-    VK_CHECK(vkQueueWaitIdle(graphicsQueue), "Failed to wait for command buffer submission!");
+    // NOTE: Waits on a fence instead of the whole queue, so other threads can keep submitting in the meantime
+    VkFenceCreateInfo fenceInfo{.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    VkFence fence;
+    VK_CHECK(vkCreateFence(device, &fenceInfo, nullptr, &fence), "Failed to create fence!");
+    {
+        const auto queueLock = LockQueues();
+        VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, fence), "Failed to submit command buffer!");
+    }
+    VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX),
+             "Failed to wait for command buffer submission!");
+    vkDestroyFence(device, fence, nullptr);
+
+    vkFreeCommandBuffers(device, GetThreadCommandPool(), 1, &commandBuffer);
+}
 
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+void VulkanDevice::WaitIdle() const {
+    const auto queueLock = LockQueues();
+    vkDeviceWaitIdle(device);
 }
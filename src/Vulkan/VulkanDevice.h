@@ -1,46 +1,80 @@
 #pragma once
 #include "../pch.h"
 
+#include <mutex>
+#include <thread>
+
 #include "VkBootstrap.h"
+#include "PipelineCache.h"
 
 class VulkanDevice {
 public:
+    // A VK_NULL_HANDLE surface creates a headless device
     VulkanDevice(vkb::Instance instance, VkSurfaceKHR surface);
     void Destroy();
 
     [[nodiscard]] vkb::Device GetDevice() const { return device; }
     [[nodiscard]] VkPhysicalDevice GetPhysicalDevice() const { return physicalDevice; }
     [[nodiscard]] VkSurfaceKHR GetSurface() const { return surface; }
+    [[nodiscard]] bool IsHeadless() const { return surface == VK_NULL_HANDLE; }
     [[nodiscard]] VkQueue GetPresentQueue() const { return presentQueue; }
     [[nodiscard]] VkQueue GetGraphicsQueue() const { return graphicsQueue; }
+    [[nodiscard]] uint32_t GetGraphicsQueueFamily() const { return graphicsQueueFamily; }
+    // Falls back to the graphics queue when the device has no dedicated transfer queue
+    [[nodiscard]] VkQueue GetTransferQueue() const { return transferQueue; }
+    [[nodiscard]] uint32_t GetTransferQueueFamily() const { return transferQueueFamily; }
+    [[nodiscard]] bool HasDedicatedTransferQueue() const { return transferQueueFamily != graphicsQueueFamily; }
     [[nodiscard]] VkCommandPool GetCommandPool() const { return commandPool; }
     [[nodiscard]] VkDescriptorPool GetDescriptorPool() const { return descriptorPool; }
     [[nodiscard]] VmaAllocator GetAllocator() const { return allocator; }
+    [[nodiscard]] PipelineCache &GetPipelineCache() const { return *pipelineCache; }
+    [[nodiscard]] bool IsPipelineStatisticsSupported() const { return pipelineStatisticsSupported; }
 
+    // Can be used from any thread, each thread records into its own command pool
     VkCommandBuffer BeginSingleTimeCommands();
     void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
+    // Destroys the command pool of the calling thread, for threads that are done submitting and about to exit
+    void ReleaseThreadCommandPool();
+
+    // Queues are shared with the background scene loader, so every submit and present has to hold this lock
+    [[nodiscard]] std::unique_lock<std::mutex> LockQueues() const { return std::unique_lock(queueMutex); }
+    // vkDeviceWaitIdle, which also needs every queue to be externally synchronized
+    void WaitIdle() const;
 
 private:
     void PickPhysicalDevice(vkb::Instance instance);
 
     void CreateLogicalDevice();
     void CreateCommandPool();
+    VkCommandPool GetThreadCommandPool();
 
     /* Logical Device */
     vkb::Device device;
     vkb::PhysicalDevice physicalDevice;
 
-    VkSurfaceKHR surface;
+    VkSurfaceKHR surface{VK_NULL_HANDLE};
 
     VkQueue graphicsQueue;
     VkQueue computeQueue;
-    VkQueue presentQueue;
+    VkQueue presentQueue{VK_NULL_HANDLE};
+    VkQueue transferQueue{VK_NULL_HANDLE};
+
+    uint32_t graphicsQueueFamily{0};
+    uint32_t transferQueueFamily{0};
+
+    bool pipelineStatisticsSupported{false};
 
     VkCommandPool commandPool;
     VkDescriptorPool descriptorPool;
 
+    mutable std::mutex queueMutex;
+    std::mutex threadCommandPoolsMutex;
+    std::unordered_map<std::thread::id, VkCommandPool> threadCommandPools;
+
     VmaAllocator allocator;
 
+    std::unique_ptr<PipelineCache> pipelineCache;
+
 #ifdef NDEBUG
     const bool enableValidationLayers = false;
 #else
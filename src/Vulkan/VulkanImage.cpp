@@ -15,9 +15,11 @@ VulkanImage::VulkanImage(std::shared_ptr<VulkanDevice> device, const ImageSpecif
     }
     if (specification.usage == ImageUsage::Attachment) {
         if (IsDepthFormat(specification.format)) {
-            usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            // Transfer source so that the depth can be copied into the depth pyramid
+            usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
         } else {
-            usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            // Transfer source so that rendered frames can be read back
+            usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
         }
     }
 
@@ -138,6 +140,13 @@ void VulkanImage::TransitionLayout(VkCommandBuffer commandBuffer, VkImageLayout
 
         barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
         barrier.dstStageMask = VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT;
+    } else if (oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL &&
+               newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
     } else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
         barrier.srcAccessMask = 0;
         barrier.dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
@@ -161,6 +170,24 @@ void VulkanImage::TransitionLayout(VkCommandBuffer commandBuffer, VkImageLayout
                 VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
         barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
 
+    } else if (oldLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL &&
+               newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+
+        barrier.srcStageMask =
+                VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+        barrier.dstStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+    } else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL &&
+               newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) {
+        // NOTE: Only the copy has to finish before the depth is written again, it didn't write anything
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask =
+                VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+        barrier.srcStageMask = VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+        barrier.dstStageMask =
+                VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
     } else {
         throw std::invalid_argument("Unsupported layout transition!");
     }
@@ -242,9 +269,14 @@ void VulkanImage::TransitionLayout(VkImageLayout oldLayout, VkImageLayout newLay
 
 void VulkanImage::CopyBufferData(Buffer &buffer, uint32_t layerCount) {
     VkCommandBuffer commandBuffer = device->BeginSingleTimeCommands();
+    CopyBufferData(commandBuffer, buffer, 0, layerCount);
+    device->EndSingleTimeCommands(commandBuffer);
+}
 
+void VulkanImage::CopyBufferData(VkCommandBuffer commandBuffer, Buffer &buffer, VkDeviceSize bufferOffset,
+                                 uint32_t layerCount) {
     VkBufferImageCopy region{
-            .bufferOffset = 0,
+            .bufferOffset = bufferOffset,
             .bufferRowLength = 0,
             .bufferImageHeight = 0,
     };
@@ -258,11 +290,37 @@ void VulkanImage::CopyBufferData(Buffer &buffer, uint32_t layerCount) {
 
     vkCmdCopyBufferToImage(commandBuffer, buffer.GetBuffer(), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
                            &region);
+}
+
+void VulkanImage::CopyToBuffer(Buffer &buffer) {
+    VkCommandBuffer commandBuffer = device->BeginSingleTimeCommands();
+
+    VkBufferImageCopy region{
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+    };
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {width, height, 1};
+
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer.GetBuffer(), 1,
+                           &region);
 
     device->EndSingleTimeCommands(commandBuffer);
 }
 
 void VulkanImage::GenerateMipMaps(VkFormat format, uint32_t mipLevelCount, bool cube) {
+    VkCommandBuffer commandBuffer = device->BeginSingleTimeCommands();
+    GenerateMipMaps(commandBuffer, format, mipLevelCount, cube);
+    device->EndSingleTimeCommands(commandBuffer);
+}
+
+void VulkanImage::GenerateMipMaps(VkCommandBuffer commandBuffer, VkFormat format, uint32_t mipLevelCount, bool cube) {
     // Check if image format supports linear blitting
     VkFormatProperties formatProperties;
     vkGetPhysicalDeviceFormatProperties(device->GetPhysicalDevice(), format, &formatProperties);
@@ -270,8 +328,6 @@ void VulkanImage::GenerateMipMaps(VkFormat format, uint32_t mipLevelCount, bool
         throw std::runtime_error("VulkanTexture image format does not support linear blitting!");
     }
 
-    VkCommandBuffer commandBuffer = device->BeginSingleTimeCommands();
-
     for (size_t face = 0; face < (cube ? 6 : 1); face++) {
 
         VkImageMemoryBarrier barrier{
@@ -338,8 +394,6 @@ void VulkanImage::GenerateMipMaps(VkFormat format, uint32_t mipLevelCount, bool
         vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
                              nullptr, 0, nullptr, 1, &barrier);
     }
-
-    device->EndSingleTimeCommands(commandBuffer);
 }
 
 bool IsDepthFormat(ImageFormat format) {
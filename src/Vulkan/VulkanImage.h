@@ -48,7 +48,12 @@ public:
     void TransitionLayout(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout);
 
     void CopyBufferData(Buffer &buffer, uint32_t layerCount = 1);
+    void CopyBufferData(VkCommandBuffer commandBuffer, Buffer &buffer, VkDeviceSize bufferOffset = 0,
+                        uint32_t layerCount = 1);
+    // Image must be in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+    void CopyToBuffer(Buffer &buffer);
     void GenerateMipMaps(VkFormat format, uint32_t mipLevelCount, bool cube = false);
+    void GenerateMipMaps(VkCommandBuffer commandBuffer, VkFormat format, uint32_t mipLevelCount, bool cube = false);
 
     [[nodiscard]] uint32_t GetWidth() const { return width; }
     [[nodiscard]] uint32_t GetHeight() const { return height; }
@@ -1,5 +1,6 @@
 #include "pch.h"
 
+#include <algorithm>
 #include <utility>
 
 #include "VulkanPipeline.h"
@@ -395,135 +396,65 @@ VulkanPipeline::VulkanPipeline(std::shared_ptr<VulkanDevice> device, PipelineSpe
     bool isCompute = !pipelineSpecification.compShaderPath.empty();
     std::vector<std::vector<char>> shaderSources;
     if (!isCompute) {
-        auto vertShaderCode = ReadFile(pipelineSpecification.vertShaderPath);
-        auto fragShaderCode = ReadFile(pipelineSpecification.fragShaderPath);
+        auto vertShaderCode = ReadFile(SHADER_BINARY_DIR / pipelineSpecification.vertShaderPath);
+        auto fragShaderCode = ReadFile(SHADER_BINARY_DIR / pipelineSpecification.fragShaderPath);
         shaderSources.push_back(vertShaderCode);
         shaderSources.push_back(fragShaderCode);
     } else {
-        shaderSources.push_back(ReadFile(pipelineSpecification.compShaderPath));
+        shaderSources.push_back(ReadFile(SHADER_BINARY_DIR / pipelineSpecification.compShaderPath));
     }
 
     std::unordered_map<uint32_t, DescriptorSetLayoutData> setLayouts;
     std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
     std::vector<VkPushConstantRange> pushConstantRanges;
-    VkVertexInputBindingDescription bindingDescription{};
-    for (auto code: shaderSources) {
-        SpvReflectShaderModule module = {};
-        SpvReflectResult result = spvReflectCreateShaderModule(code.size(), code.data(), &module);
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        uint32_t count = 0;
-        result = spvReflectEnumerateInputVariables(&module, &count, nullptr);
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        std::vector<SpvReflectInterfaceVariable *> inputVars(count);
-        result = spvReflectEnumerateInputVariables(&module, &count, inputVars.data());
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        count = 0;
-        result = spvReflectEnumerateOutputVariables(&module, &count, nullptr);
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        std::vector<SpvReflectInterfaceVariable *> outputVars(count);
-        result = spvReflectEnumerateOutputVariables(&module, &count, outputVars.data());
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        count = 0;
-        result = spvReflectEnumerateDescriptorSets(&module, &count, nullptr);
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        std::vector<SpvReflectDescriptorSet *> sets(count);
-        result = spvReflectEnumerateDescriptorSets(&module, &count, sets.data());
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        count = 0;
-        result = spvReflectEnumeratePushConstantBlocks(&module, &count, nullptr);
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        std::vector<SpvReflectBlockVariable *> pushConstantBlocks(count);
-        result = spvReflectEnumeratePushConstantBlocks(&module, &count, pushConstantBlocks.data());
-        assert(result == SPV_REFLECT_RESULT_SUCCESS);
-
-        if (module.shader_stage == SPV_REFLECT_SHADER_STAGE_VERTEX_BIT) {
-            bindingDescription.binding = 0;
-            bindingDescription.stride = 0; // computed below
-            bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-            attributeDescriptions.reserve(inputVars.size());
-            for (auto &inputVar: inputVars) {
-                const SpvReflectInterfaceVariable &reflVar = *inputVar;
-                // ignore built-in variables
-                if (reflVar.decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) {
-                    continue;
+    std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+    for (const auto &code: shaderSources) {
+        const PipelineCache::ShaderReflection reflection = ReflectShader(code);
+
+        if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT) {
+            // Already sorted by location, every input is stored with its shader format and tightly packed in binding 0
+            attributeDescriptions = reflection.inputAttributes;
+            VkVertexInputBindingDescription bindingDescription{.binding = 0,
+                                                               .stride = 0,
+                                                               .inputRate = VK_VERTEX_INPUT_RATE_VERTEX};
+            for (auto &attribute: attributeDescriptions) {
+                const uint32_t formatSize = FormatSize(attribute.format);
+                if (formatSize == 0) {
+                    throw std::runtime_error(std::format("Unsupported vertex format for location {} in {}!",
+                                                         attribute.location,
+                                                         pipelineSpecification.vertShaderPath.string()));
                 }
-
-                VkVertexInputAttributeDescription attr_desc{};
-                attr_desc.location = reflVar.location;
-                attr_desc.binding = bindingDescription.binding;
-                attr_desc.format = static_cast<VkFormat>(reflVar.format);
-                attr_desc.offset = 0; // final offset computed below after sorting.
-
-                attributeDescriptions.push_back(attr_desc);
+                attribute.binding = bindingDescription.binding;
+                attribute.offset = bindingDescription.stride;
+                bindingDescription.stride += formatSize;
             }
 
-            // Sort attributes by location
-            std::sort(std::begin(attributeDescriptions), std::end(attributeDescriptions),
-                      [](const auto &a, const auto &b) { return a.location < b.location; });
-
-            // Compute final offsets of each attribute, and total vertex stride.
-            for (auto &attribute: attributeDescriptions) {
-                // TODO: Change
-                // uint32_t format_size = FormatSize(attribute.format);
-                uint32_t format_size = 16;
-                if (attribute.format == VK_FORMAT_R32G32_SFLOAT)
-                    format_size = 8;
-
-                attribute.offset = bindingDescription.stride;
-                bindingDescription.stride += format_size;
+            // NOTE: Shaders that pull their vertices from buffers have no inputs and no binding
+            if (!attributeDescriptions.empty()) {
+                bindingDescriptions.push_back(bindingDescription);
             }
         }
 
         // TODO: Handle sets and binding defined in different shader files
-        for (auto &set: sets) {
-            const SpvReflectDescriptorSet &reflSet = *set;
-
+        for (const auto &reflSet: reflection.sets) {
             DescriptorSetLayoutData layout = setLayouts[reflSet.set];
-            if (layout.bindings.size() < reflSet.binding_count) {
-                layout.bindings.resize(reflSet.binding_count);
+            if (layout.bindings.size() < reflSet.bindings.size()) {
+                layout.bindings.resize(reflSet.bindings.size());
             }
 
-            for (uint32_t iBinding = 0; iBinding < reflSet.binding_count; ++iBinding) {
-                const SpvReflectDescriptorBinding &reflBinding = *(reflSet.bindings[iBinding]);
-                VkDescriptorSetLayoutBinding &layoutBinding = layout.bindings[iBinding];
-                layoutBinding.binding = reflBinding.binding;
-                layoutBinding.descriptorType = static_cast<VkDescriptorType>(reflBinding.descriptor_type);
-
-                layoutBinding.descriptorCount = 1;
-                for (uint32_t iDim = 0; iDim < reflBinding.array.dims_count; ++iDim) {
-                    layoutBinding.descriptorCount *= reflBinding.array.dims[iDim];
-                }
-                // NOTE: Bindless case
-                if (layoutBinding.descriptorCount == 0) {
-                    layoutBinding.descriptorCount = 1000;
-                }
-
-                layoutBinding.stageFlags = static_cast<VkShaderStageFlagBits>(module.shader_stage);
+            for (uint32_t iBinding = 0; iBinding < reflSet.bindings.size(); ++iBinding) {
+                layout.bindings[iBinding] = reflSet.bindings[iBinding];
             }
             layout.setNumber = reflSet.set;
             layout.createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-            layout.createInfo.bindingCount = reflSet.binding_count;
+            layout.createInfo.bindingCount = static_cast<uint32_t>(reflSet.bindings.size());
             layout.createInfo.pBindings = layout.bindings.data();
 
             setLayouts[reflSet.set] = layout;
         }
 
-        for (auto &pushConstantBlock: pushConstantBlocks) {
-            VkPushConstantRange pushConstant;
-            pushConstant.offset = pushConstantBlock->offset;
-            pushConstant.size = pushConstantBlock->size;
-            pushConstant.stageFlags = static_cast<VkShaderStageFlagBits>(module.shader_stage);
-            pushConstantRanges.push_back(pushConstant);
-        }
+        pushConstantRanges.insert(pushConstantRanges.end(), reflection.pushConstantRanges.begin(),
+                                  reflection.pushConstantRanges.end());
     }
 
     descriptorSetLayouts.resize(setLayouts.size());
@@ -544,8 +475,8 @@ VulkanPipeline::VulkanPipeline(std::shared_ptr<VulkanDevice> device, PipelineSpe
         bindingFlags.pBindingFlags = &flags;
         bindingFlags.bindingCount = 1;
 
-        if (i == 0 && (pipelineSpecification.fragShaderPath == "shaders/pbr_bindless.frag.spv" ||
-                       pipelineSpecification.fragShaderPath == "shaders/skybox.frag.spv")) {
+        if (i == 0 && (pipelineSpecification.fragShaderPath == "pbr_bindless.frag.spv" ||
+                       pipelineSpecification.fragShaderPath == "skybox.frag.spv")) {
             layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
             layoutInfo.pNext = &bindingFlags;
         }
@@ -605,8 +536,8 @@ VulkanPipeline::VulkanPipeline(std::shared_ptr<VulkanDevice> device, PipelineSpe
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo{
             .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-            .vertexBindingDescriptionCount = 1,
-            .pVertexBindingDescriptions = &bindingDescription,
+            .vertexBindingDescriptionCount = (uint32_t) bindingDescriptions.size(),
+            .pVertexBindingDescriptions = bindingDescriptions.data(),
             .vertexAttributeDescriptionCount = (uint32_t) attributeDescriptions.size(),
             .pVertexAttributeDescriptions = attributeDescriptions.data(),
     };
@@ -722,9 +653,9 @@ VulkanPipeline::VulkanPipeline(std::shared_ptr<VulkanDevice> device, PipelineSpe
                 .stage = shaderStages[0],
                 .layout = layout,
         };
-        VK_CHECK(
-                vkCreateComputePipelines(this->device->GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline),
-                "Failed to create graphics pipeline!");
+        VK_CHECK(vkCreateComputePipelines(this->device->GetDevice(), this->device->GetPipelineCache().GetCache(), 1,
+                                          &pipelineInfo, nullptr, &pipeline),
+                 "Failed to create graphics pipeline!");
     } else {
         VkGraphicsPipelineCreateInfo pipelineInfo{
                 .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
@@ -746,8 +677,8 @@ VulkanPipeline::VulkanPipeline(std::shared_ptr<VulkanDevice> device, PipelineSpe
                 .basePipelineHandle = VK_NULL_HANDLE,
         };
 
-        VK_CHECK(vkCreateGraphicsPipelines(this->device->GetDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr,
-                                           &pipeline),
+        VK_CHECK(vkCreateGraphicsPipelines(this->device->GetDevice(), this->device->GetPipelineCache().GetCache(), 1,
+                                           &pipelineInfo, nullptr, &pipeline),
                  "Failed to create graphics pipeline!");
     }
 
@@ -757,6 +688,102 @@ VulkanPipeline::VulkanPipeline(std::shared_ptr<VulkanDevice> device, PipelineSpe
     }
 }
 
+PipelineCache::ShaderReflection VulkanPipeline::ReflectShader(const std::vector<char> &code) const {
+    PipelineCache &pipelineCache = device->GetPipelineCache();
+    const uint64_t codeHash = HashData(code.data(), code.size());
+    if (auto cached = pipelineCache.FindReflection(codeHash)) {
+        return *cached;
+    }
+
+    SpvReflectShaderModule module = {};
+    SpvReflectResult result = spvReflectCreateShaderModule(code.size(), code.data(), &module);
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    uint32_t count = 0;
+    result = spvReflectEnumerateInputVariables(&module, &count, nullptr);
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    std::vector<SpvReflectInterfaceVariable *> inputVars(count);
+    result = spvReflectEnumerateInputVariables(&module, &count, inputVars.data());
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    count = 0;
+    result = spvReflectEnumerateDescriptorSets(&module, &count, nullptr);
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    std::vector<SpvReflectDescriptorSet *> sets(count);
+    result = spvReflectEnumerateDescriptorSets(&module, &count, sets.data());
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    count = 0;
+    result = spvReflectEnumeratePushConstantBlocks(&module, &count, nullptr);
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    std::vector<SpvReflectBlockVariable *> pushConstantBlocks(count);
+    result = spvReflectEnumeratePushConstantBlocks(&module, &count, pushConstantBlocks.data());
+    assert(result == SPV_REFLECT_RESULT_SUCCESS);
+
+    PipelineCache::ShaderReflection reflection{.stage = static_cast<VkShaderStageFlagBits>(module.shader_stage)};
+
+    if (module.shader_stage == SPV_REFLECT_SHADER_STAGE_VERTEX_BIT) {
+        reflection.inputAttributes.reserve(inputVars.size());
+        for (auto &inputVar: inputVars) {
+            const SpvReflectInterfaceVariable &reflVar = *inputVar;
+            // ignore built-in variables
+            if (reflVar.decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) {
+                continue;
+            }
+
+            VkVertexInputAttributeDescription attr_desc{};
+            attr_desc.location = reflVar.location;
+            attr_desc.format = static_cast<VkFormat>(reflVar.format);
+            reflection.inputAttributes.push_back(attr_desc);
+        }
+
+        // Sort attributes by location
+        std::sort(std::begin(reflection.inputAttributes), std::end(reflection.inputAttributes),
+                  [](const auto &a, const auto &b) { return a.location < b.location; });
+    }
+
+    for (auto &set: sets) {
+        const SpvReflectDescriptorSet &reflSet = *set;
+
+        PipelineCache::ShaderReflection::DescriptorSet &descriptorSet = reflection.sets.emplace_back();
+        descriptorSet.set = reflSet.set;
+        descriptorSet.bindings.resize(reflSet.binding_count);
+        for (uint32_t iBinding = 0; iBinding < reflSet.binding_count; ++iBinding) {
+            const SpvReflectDescriptorBinding &reflBinding = *(reflSet.bindings[iBinding]);
+            VkDescriptorSetLayoutBinding &layoutBinding = descriptorSet.bindings[iBinding];
+            layoutBinding.binding = reflBinding.binding;
+            layoutBinding.descriptorType = static_cast<VkDescriptorType>(reflBinding.descriptor_type);
+
+            layoutBinding.descriptorCount = 1;
+            for (uint32_t iDim = 0; iDim < reflBinding.array.dims_count; ++iDim) {
+                layoutBinding.descriptorCount *= reflBinding.array.dims[iDim];
+            }
+            // NOTE: Bindless case
+            if (layoutBinding.descriptorCount == 0) {
+                layoutBinding.descriptorCount = 1000;
+            }
+
+            layoutBinding.stageFlags = static_cast<VkShaderStageFlagBits>(module.shader_stage);
+        }
+    }
+
+    for (auto &pushConstantBlock: pushConstantBlocks) {
+        VkPushConstantRange pushConstant;
+        pushConstant.offset = pushConstantBlock->offset;
+        pushConstant.size = pushConstantBlock->size;
+        pushConstant.stageFlags = static_cast<VkShaderStageFlagBits>(module.shader_stage);
+        reflection.pushConstantRanges.push_back(pushConstant);
+    }
+
+    spvReflectDestroyShaderModule(&module);
+
+    pipelineCache.StoreReflection(codeHash, reflection);
+    return reflection;
+}
+
 VkShaderModule VulkanPipeline::CreateShaderModule(const std::vector<char> &code) const {
     VkShaderModuleCreateInfo createInfo{
             .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "PipelineCache.h"
 #include "VulkanDevice.h"
 
 class VulkanPipeline {
@@ -13,6 +14,7 @@ public:
     };
 
     struct PipelineSpecification {
+        // NOTE: SPIR-V binaries, relative to the directory the build compiles the shaders into
         std::filesystem::path vertShaderPath;
         std::filesystem::path fragShaderPath;
         std::filesystem::path compShaderPath;
@@ -44,6 +46,8 @@ public:
 
 private:
     [[nodiscard]] VkShaderModule CreateShaderModule(const std::vector<char> &code) const;
+    // Served from the device's pipeline cache when this exact SPIR-V was reflected before
+    [[nodiscard]] PipelineCache::ShaderReflection ReflectShader(const std::vector<char> &code) const;
 
     VkPipelineLayout layout = VK_NULL_HANDLE;
     VkPipeline pipeline = VK_NULL_HANDLE;
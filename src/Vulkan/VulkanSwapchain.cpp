@@ -11,6 +11,28 @@ VulkanSwapchain::VulkanSwapchain(std::shared_ptr<VulkanDevice> device, GLFWwindo
     Create();
 }
 
+VulkanSwapchain::VulkanSwapchain(std::shared_ptr<VulkanDevice> device, VkExtent2D extent) :
+    headless(true), device(std::move(device)) {
+    // NOTE: Only the extent and format of the vkb swapchain are used when running headless
+    swapchain.extent = extent;
+    swapchain.image_format = static_cast<VkFormat>(ImageFormat::R8G8B8A8_SRGB);
+
+    numFramesInFlight = requestedFramesInFlight;
+    images.resize(numFramesInFlight);
+    for (size_t i = 0; i < images.size(); ++i) {
+        ImageSpecification imageSpecification{
+                .name = std::format("Offscreen Image {}", i),
+                .format = ImageFormat::R8G8B8A8_SRGB,
+                .usage = ImageUsage::Attachment,
+                .width = extent.width,
+                .height = extent.height,
+        };
+        images[i] = std::make_shared<VulkanImage>(this->device, imageSpecification);
+    }
+
+    CreateFrameResources();
+}
+
 void VulkanSwapchain::Destroy() {
     for (size_t i = 0; i < numFramesInFlight; i++) {
         vkDestroySemaphore(device->GetDevice(), renderFinishedSemaphores[i], nullptr);
@@ -21,7 +43,9 @@ void VulkanSwapchain::Destroy() {
     for (auto &image: images) {
         image->Destroy();
     }
-    vkb::destroy_swapchain(swapchain);
+    if (!headless) {
+        vkb::destroy_swapchain(swapchain);
+    }
 }
 
 void VulkanSwapchain::Recreate() {
@@ -35,7 +59,7 @@ void VulkanSwapchain::Recreate() {
         glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(device->GetDevice());
+    device->WaitIdle();
 
     vkb::SwapchainBuilder swapchainBuilder{device->GetDevice()};
     auto swapRet = swapchainBuilder.set_old_swapchain(swapchain)
@@ -79,6 +103,10 @@ void VulkanSwapchain::Create() {
         images[i] = std::make_shared<VulkanImage>(device, swapchainImages[i]);
     }
 
+    CreateFrameResources();
+}
+
+void VulkanSwapchain::CreateFrameResources() {
     // Sync objects
     imageAvailableSemaphores.resize(numFramesInFlight);
     renderFinishedSemaphores.resize(numFramesInFlight);
@@ -118,6 +146,11 @@ void VulkanSwapchain::Create() {
 }
 
 uint32_t VulkanSwapchain::AcquireNextImage(uint32_t currentFrame) {
+    // Offscreen images are used in order, one per frame in flight
+    if (headless) {
+        return currentFrame;
+    }
+
     uint32_t imageIndex;
     VkResult result = vkAcquireNextImageKHR(device->GetDevice(), swapchain, UINT64_MAX,
                                             imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -134,6 +167,10 @@ uint32_t VulkanSwapchain::AcquireNextImage(uint32_t currentFrame) {
 }
 
 bool VulkanSwapchain::Present(uint32_t imageIndex, uint32_t currentFrame) {
+    if (headless) {
+        return false;
+    }
+
     VkSwapchainKHR swapChains[] = {swapchain};
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
     VkPresentInfoKHR presentInfo{
@@ -145,7 +182,11 @@ bool VulkanSwapchain::Present(uint32_t imageIndex, uint32_t currentFrame) {
             .pImageIndices = &imageIndex,
     };
 
-    VkResult result = vkQueuePresentKHR(device->GetPresentQueue(), &presentInfo);
+    VkResult result;
+    {
+        const auto queueLock = device->LockQueues();
+        result = vkQueuePresentKHR(device->GetPresentQueue(), &presentInfo);
+    }
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || needsResizing) {
         needsResizing = false;
         Recreate();
@@ -14,6 +14,9 @@ class VulkanSwapchain {
 public:
     VulkanSwapchain() = default;
     VulkanSwapchain(std::shared_ptr<VulkanDevice> device, GLFWwindow *window);
+
+    // Headless swapchain ctor, renders into a ring of offscreen images
+    VulkanSwapchain(std::shared_ptr<VulkanDevice> device, VkExtent2D extent);
     void Destroy();
 
     void Recreate();
@@ -32,11 +35,13 @@ public:
     [[nodiscard]] uint32_t GetWidth() const { return swapchain.extent.width; }
     [[nodiscard]] VkExtent2D GetExtent() const { return swapchain.extent; }
     [[nodiscard]] VkFormat GetImageFormat() const { return swapchain.image_format; }
+    [[nodiscard]] bool IsHeadless() const { return headless; }
 
     uint32_t numFramesInFlight {0};
     bool needsResizing = false;
 private:
     void Create();
+    void CreateFrameResources();
 
     static VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats);
     static VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
@@ -46,6 +51,7 @@ private:
     std::vector<std::shared_ptr<VulkanImage>> images;
 
     GLFWwindow *window {nullptr};
+    bool headless{false};
 
     std::vector<VkFence> waitFences;
     std::vector<VkSemaphore> imageAvailableSemaphores;
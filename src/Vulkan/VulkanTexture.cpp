@@ -150,6 +150,31 @@ Texture2D::Texture2D(std::shared_ptr<VulkanDevice> device, TextureSpecification
     SetSampler({.samplerWrap = specification.samplerWrap, .samplerFilter = specification.samplerFilter});
 }
 
+Texture2D::Texture2D(std::shared_ptr<VulkanDevice> device, TextureSpecification &specification, const void *pixels,
+                     UploadContext &uploadContext) {
+    this->device = device;
+
+    uint32_t mipLevelCount = 1;
+    if (specification.generateMipMaps) {
+        mipLevelCount = (uint32_t) (std::floor(std::log2(std::max(specification.width, specification.height))) + 1);
+    }
+
+    ImageSpecification imageSpecification{
+            .name = specification.name,
+            .format = specification.format,
+            .width = specification.width,
+            .height = specification.height,
+            .mipLevels = mipLevelCount,
+            .layers = 1,
+    };
+    image = make_shared<VulkanImage>(device, imageSpecification);
+
+    const VkDeviceSize imageSize = specification.width * specification.height * GetChannels(specification.format);
+    uploadContext.AddImage(image, pixels, imageSize, static_cast<VkFormat>(specification.format), mipLevelCount);
+
+    SetSampler({.samplerWrap = specification.samplerWrap, .samplerFilter = specification.samplerFilter});
+}
+
 void VulkanTexture::Destroy() {
     vkDestroySampler(device->GetDevice(), sampler, nullptr);
     image->Destroy();
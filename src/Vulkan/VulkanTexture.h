@@ -3,6 +3,7 @@
 #include <string>
 #include <memory>
 
+#include "UploadContext.h"
 #include "VulkanImage.h"
 
 enum class TextureWrapMode {
@@ -53,6 +54,9 @@ public:
     Texture2D(std::shared_ptr<VulkanDevice> device, TextureSpecification &specification,
               const std::filesystem::path &path);
     Texture2D(std::shared_ptr<VulkanDevice> device, TextureSpecification &specification, void *pixels);
+    // Upload is deferred to the next uploadContext.Flush()
+    Texture2D(std::shared_ptr<VulkanDevice> device, TextureSpecification &specification, const void *pixels,
+              UploadContext &uploadContext);
     Texture2D(std::shared_ptr<VulkanDevice> device, TextureSpecification &specification);
 };
 
@@ -3,10 +3,49 @@
 #include <iostream>
 #include <cstdlib>
 
-int main() {
-    Application app;
+static ApplicationSpecification ParseArguments(int argc, char **argv) {
+    ApplicationSpecification specification{};
 
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view argument = argv[i];
+        const auto nextValue = [&]() -> std::string_view {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(std::format("Missing value for argument {}!", argument));
+            }
+            return argv[++i];
+        };
+
+        if (argument == "--headless") {
+            specification.headless = true;
+        } else if (argument == "--frames") {
+            specification.headlessFrameCount = std::stoul(std::string(nextValue()));
+        } else if (argument == "--dump-frame") {
+            specification.dumpFrames.push_back(std::stoul(std::string(nextValue())));
+        } else if (argument == "--dump-dir") {
+            specification.dumpDirectory = nextValue();
+        } else if (argument == "--scene") {
+            specification.scenePath = nextValue();
+        } else if (argument == "--benchmark") {
+            specification.benchmark = true;
+        } else if (argument == "--benchmark-frames") {
+            specification.benchmarkFrameCount = std::stoul(std::string(nextValue()));
+        } else if (argument == "--benchmark-output") {
+            specification.benchmarkOutputPath = nextValue();
+        } else if (argument == "--camera-path") {
+            specification.cameraPathFile = nextValue();
+        } else if (argument == "--validate-transforms") {
+            specification.validateTransforms = true;
+        } else {
+            throw std::runtime_error(std::format("Unknown argument {}!", argument));
+        }
+    }
+
+    return specification;
+}
+
+int main(int argc, char **argv) {
     try {
+        Application app(ParseArguments(argc, argv));
         app.Run();
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
@@ -14,4 +53,4 @@ int main() {
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}